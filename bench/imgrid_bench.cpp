@@ -0,0 +1,702 @@
+// Microbenchmarks for the headless layout engine.
+//
+// Builds synthetic grids of 10 / 100 / 1k / 10k entries with random sizes and
+// times the engine operations that run on user interaction. Results are
+// written as JSON in the same shape as Google Benchmark's --benchmark_format
+// =json output so existing comparison tooling can be pointed at it.
+//
+//   imgrid_bench [--benchmark_filter=<substring>]
+//                [--benchmark_min_time=<seconds>]
+//                [--benchmark_max_entries=<count>]
+//                [--benchmark_out=<file>]
+//
+// Sizes above 1k are skipped unless --benchmark_max_entries asks for them:
+// every case runs at least one iteration, and the 10k ones take minutes.
+
+#include "imgrid_grid_engine.h"
+#ifdef IMGRID_BENCH_UI
+#include "imgrid.h"
+#include "imgrid_internal.h"
+#endif
+
+#include <chrono>
+#include <limits.h>
+#include <ctime>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace ImGrid;
+
+namespace {
+
+typedef std::chrono::steady_clock BenchClock;
+
+static const int BenchColumns = 12;
+static const int BenchSizes[] = {10, 100, 1000, 10000};
+static const int BenchDefaultMaxEntries = 1000;
+static const double BenchMaxCaseTimeFactor = 10.0;
+
+struct BenchState {
+  int Range;
+  double MinTime;
+
+  long long Iterations;
+  double RealTime; // seconds spent while not paused
+  double CpuTime;
+
+  bool Started;
+  bool Paused;
+  BenchClock::time_point RealStart;
+  clock_t CpuStart;
+  BenchClock::time_point CaseStart;
+
+  BenchState(int range, double min_time)
+      : Range(range), MinTime(min_time), Iterations(0), RealTime(0),
+        CpuTime(0), Started(false), Paused(true), RealStart(), CpuStart(0),
+        CaseStart() {}
+
+  void PauseTiming() {
+    if (Paused)
+      return;
+    RealTime += std::chrono::duration<double>(BenchClock::now() - RealStart)
+                    .count();
+    CpuTime += double(clock() - CpuStart) / CLOCKS_PER_SEC;
+    Paused = true;
+  }
+
+  void ResumeTiming() {
+    if (!Paused)
+      return;
+    RealStart = BenchClock::now();
+    CpuStart = clock();
+    Paused = false;
+  }
+
+  // for (;state.KeepRunning();) { ... } with setup excluded by
+  // PauseTiming()/ResumeTiming() around it. A case whose setup dwarfs the
+  // timed part also stops once it ran for BenchMaxCaseTimeFactor * MinTime,
+  // setup included.
+  bool KeepRunning() {
+    if (!Started) {
+      Started = true;
+      CaseStart = BenchClock::now();
+      ResumeTiming();
+      return true;
+    }
+    PauseTiming();
+    Iterations++;
+    const double case_time =
+        std::chrono::duration<double>(BenchClock::now() - CaseStart).count();
+    if (RealTime >= MinTime || Iterations >= 1000000 ||
+        case_time >= MinTime * BenchMaxCaseTimeFactor)
+      return false;
+    ResumeTiming();
+    return true;
+  }
+};
+
+struct BenchCase {
+  const char *Name;
+  void (*Run)(BenchState &state);
+  int MaxRange; // 0 = every size in BenchSizes
+};
+
+// xorshift32, the layouts have to be identical between runs and platforms
+struct BenchRandom {
+  unsigned int State;
+  BenchRandom(unsigned int seed) : State(seed) {}
+  int Next(int min, int max) {
+    State ^= State << 13;
+    State ^= State >> 17;
+    State ^= State << 5;
+    return min + static_cast<int>(State % static_cast<unsigned>(max - min + 1));
+  }
+};
+
+// Entry storage is sized up front so the engine's pointers stay valid.
+struct BenchGrid {
+  ImGridEngine Ctx;
+  ImGridVector<ImGridEntry> Storage;
+
+  BenchGrid(int count) {
+    Ctx.Column = BenchColumns;
+    Ctx.Options.Column = {false, BenchColumns};
+    Ctx.ParentContext = NULL;
+    Storage.reserve(count);
+
+    BenchRandom rng(0x1234567u + count);
+    const int rows = IM_MAX(1, count * 4 / BenchColumns);
+    for (int i = 0; i < count; ++i) {
+      const int w = rng.Next(1, 4);
+      const int h = rng.Next(1, 3);
+      ImGridEntry entry(i, ImGridPosition(float(rng.Next(0, BenchColumns - w)),
+                                          float(rng.Next(0, rows)), float(w),
+                                          float(h)));
+      entry.AutoPosition = false;
+      entry.ParentContext = &Ctx;
+      Storage.push_back(entry);
+    }
+  }
+
+  // fills the packed position mirror directly, without resolving overlaps
+  void PackAll() {
+    for (auto &entry : Storage)
+      Ctx.Entries.push_back(&entry);
+    Engine::GridPackedRebuild(Ctx);
+  }
+
+  // same sequence as loading a saved layout
+  void InsertAll() {
+    Engine::GridBatchUpdate(Ctx, true);
+    Ctx.Loading = true;
+    for (auto &entry : Storage)
+      Engine::GridAddNode(Ctx, &entry, false);
+    Ctx.Loading = false;
+    Engine::GridBatchUpdate(Ctx, false);
+  }
+
+  // auto-places every entry first, so the grid starts packed without overlaps
+  void PlaceAll() {
+    Engine::GridBatchUpdate(Ctx, true);
+    for (auto &entry : Storage) {
+      Engine::GridFindSpace(Ctx, &entry, Ctx.Entries, BenchColumns);
+      Engine::GridAddNode(Ctx, &entry, false);
+    }
+    Engine::GridBatchUpdate(Ctx, false);
+  }
+};
+
+void BM_Insert(BenchState &state) {
+  while (state.KeepRunning()) {
+    state.PauseTiming();
+    BenchGrid *grid = new BenchGrid(state.Range);
+    state.ResumeTiming();
+
+    grid->InsertAll();
+
+    state.PauseTiming();
+    delete grid;
+    state.ResumeTiming();
+  }
+}
+
+// Drags one entry across every column of its row and back, the same
+// GridEntryMoveCheck() sequence the UI issues while a title bar is held.
+// Bounded grids cap MaxRow at the loaded height, so every step is a
+// speculative move that is checked against it.
+void DragSweep(BenchState &state, bool bounded) {
+  while (state.KeepRunning()) {
+    state.PauseTiming();
+    BenchGrid *grid = new BenchGrid(state.Range);
+    grid->InsertAll();
+    ImGridEngine &engine = grid->Ctx;
+    if (bounded)
+      engine.MaxRow = Engine::GridGetRow(engine);
+    ImGridEntry *entry = &grid->Storage[state.Range / 2];
+    state.ResumeTiming();
+
+    Engine::GridCleanNodes(engine);
+    Engine::GridBeginUpdate(engine, entry);
+    entry->Moving = true;
+    const float y = entry->Position.y;
+    for (int step = 0; step < BenchColumns * 2; ++step) {
+      const int x = step < BenchColumns ? step : BenchColumns * 2 - 1 - step;
+      ImGridMoveOptions opts;
+      opts.Position = ImGridPosition(float(x), y, entry->Position.w,
+                                     entry->Position.h);
+      Engine::GridEntryMoveCheck(engine, entry, opts);
+    }
+    entry->Moving = false;
+    Engine::GridTriggerChangeEvent(engine);
+    Engine::GridEndUpdate(engine);
+
+    state.PauseTiming();
+    delete grid;
+    state.ResumeTiming();
+  }
+}
+
+void BM_DragSweep(BenchState &state) { DragSweep(state, false); }
+void BM_DragSweepBounded(BenchState &state) { DragSweep(state, true); }
+
+// Times the top gravity pack after each step of a drag that swaps one entry
+// with a neighbour and back, with the move itself left out. The move takes
+// the UI's path (a moving entry with cached rects), so the grid stays packed
+// and free of overlaps. Like GridMoveNode() the pack runs inside the move's
+// occupancy scope. The Full variant forgets which cells changed, so every
+// pack revisits the whole grid.
+void DragPack(BenchState &state, bool full) {
+  BenchGrid *grid = new BenchGrid(state.Range);
+  grid->PlaceAll();
+  ImGridEngine &engine = grid->Ctx;
+
+  // the entry closest to the middle with a neighbour of the same size, right
+  // below it or next to it, so they swap back and forth
+  ImGridEntry *entry = NULL;
+  ImGridEntry *other = NULL;
+  for (int i = 0; i < state.Range && other == NULL; ++i) {
+    entry = &grid->Storage[(state.Range / 2 + i) % state.Range];
+    const ImGridPosition &p = entry->Position;
+    for (auto &next : grid->Storage) {
+      const ImGridPosition &q = next.Position;
+      if (q.w == p.w && q.h == p.h &&
+          ((q.x == p.x && q.y == p.y + p.h) ||
+           (q.y == p.y && q.x == p.x + p.w))) {
+        other = &next;
+        break;
+      }
+    }
+  }
+  IM_ASSERT(other != NULL);
+
+  Engine::GridOccupancyBegin(engine);
+  Engine::GridCleanNodes(engine);
+  Engine::GridBeginUpdate(engine, entry);
+  entry->Moving = true;
+  while (state.KeepRunning()) {
+    state.PauseTiming();
+    for (auto *e : engine.Entries)
+      e->Rect = e->Position;
+    // drop the entry onto the other one, which swaps them
+    ImGridMoveOptions opts;
+    opts.Position = ImGridPosition(other->Position.x, other->Position.y,
+                                   entry->Position.w, entry->Position.h);
+    opts.Rect = opts.Position;
+    Engine::GridMoveNode(engine, entry, opts);
+    if (full)
+      engine.PackRegion.Full = true;
+    state.ResumeTiming();
+
+    Engine::GridPackEntries(engine);
+  }
+  entry->Moving = false;
+  Engine::GridEndUpdate(engine);
+  Engine::GridOccupancyEnd(engine);
+  delete grid;
+}
+
+void BM_DragPack(BenchState &state) { DragPack(state, false); }
+void BM_DragPackFull(BenchState &state) { DragPack(state, true); }
+
+void BM_Compact(BenchState &state) {
+  while (state.KeepRunning()) {
+    state.PauseTiming();
+    BenchGrid *grid = new BenchGrid(state.Range);
+    grid->InsertAll();
+    state.ResumeTiming();
+
+    Engine::GridCompact(grid->Ctx);
+
+    state.PauseTiming();
+    delete grid;
+    state.ResumeTiming();
+  }
+}
+
+void BM_ColumnChange(BenchState &state) {
+  while (state.KeepRunning()) {
+    state.PauseTiming();
+    BenchGrid *grid = new BenchGrid(state.Range);
+    grid->InsertAll();
+    state.ResumeTiming();
+
+    grid->Ctx.Column = BenchColumns / 2;
+    Engine::GridColumnChanged(grid->Ctx, BenchColumns, BenchColumns / 2);
+
+    state.PauseTiming();
+    delete grid;
+    state.ResumeTiming();
+  }
+}
+
+// The same column change served from GridPrecomputeLayouts().
+void BM_ColumnChangePrecomputed(BenchState &state) {
+  ImGridColumnOpts opts;
+  opts.ColumnMax = BenchColumns;
+  opts.Breakpoints.push_back({800, BenchColumns / 2, ImGridColumnFlags_None});
+  while (state.KeepRunning()) {
+    state.PauseTiming();
+    BenchGrid *grid = new BenchGrid(state.Range);
+    grid->InsertAll();
+    Engine::GridPrecomputeLayouts(grid->Ctx, opts);
+    state.ResumeTiming();
+
+    grid->Ctx.Column = BenchColumns / 2;
+    Engine::GridColumnChanged(grid->Ctx, BenchColumns, BenchColumns / 2);
+
+    state.PauseTiming();
+    delete grid;
+    state.ResumeTiming();
+  }
+}
+
+// Only the UI thread's share of an async column change: the snapshot taken by
+// the request and the commit of the solved layout.
+void BM_ColumnChangeAsync(BenchState &state) {
+  while (state.KeepRunning()) {
+    state.PauseTiming();
+    BenchGrid *grid = new BenchGrid(state.Range);
+    grid->InsertAll();
+    state.ResumeTiming();
+
+    Engine::GridColumnChangedAsync(grid->Ctx, BenchColumns, BenchColumns / 2);
+    state.PauseTiming();
+    Engine::GridAsyncSolveWait(grid->Ctx);
+    state.ResumeTiming();
+    const bool committed = Engine::GridAsyncSolvePoll(grid->Ctx);
+    IM_ASSERT(committed);
+    (void)committed;
+
+    state.PauseTiming();
+    delete grid;
+    state.ResumeTiming();
+  }
+}
+
+// Places every entry with GridFindSpace() and appends it, the sequence
+// InsertNewEntry() runs for auto-positioned tiles.
+void BM_AutoPlace(BenchState &state) {
+  while (state.KeepRunning()) {
+    state.PauseTiming();
+    BenchGrid *grid = new BenchGrid(state.Range);
+    state.ResumeTiming();
+
+    ImGridEngine &engine = grid->Ctx;
+    for (auto &entry : grid->Storage) {
+      Engine::GridFindSpace(engine, &entry, engine.Entries, BenchColumns);
+      engine.Entries.push_back(&entry);
+    }
+
+    state.PauseTiming();
+    delete grid;
+    state.ResumeTiming();
+  }
+}
+
+// Scans the whole packed mirror for each query, as GridCollideAll() does when
+// the occupancy index can't answer. 64 queries per iteration.
+template <ImU32 (*Kernel)(const ImGridPackedPositions &, int, const ImS16[4],
+                          int, int)>
+void BM_InterceptScanImpl(BenchState &state) {
+  state.PauseTiming();
+  BenchGrid *grid = new BenchGrid(state.Range);
+  grid->PackAll();
+  const ImGridPackedPositions &packed = grid->Ctx.Packed;
+  const int rows = IM_MAX(1, state.Range * 4 / BenchColumns);
+  ImS16 areas[64][4];
+  BenchRandom rng(0x7654321u);
+  for (auto &area : areas) {
+    area[2] = (ImS16)rng.Next(1, 4);
+    area[3] = (ImS16)rng.Next(1, 3);
+    area[0] = (ImS16)rng.Next(0, BenchColumns - area[2]);
+    area[1] = (ImS16)rng.Next(0, rows);
+  }
+  state.ResumeTiming();
+
+  int hits = 0;
+  while (state.KeepRunning()) {
+    for (auto &area : areas) {
+      for (int i = 0; i < packed.Size(); i += IMGRID_PACKED_BATCH) {
+        for (ImU32 mask = Kernel(packed, i, area, 0, INT_MIN); mask != 0;
+             mask &= mask - 1)
+          hits++;
+      }
+    }
+  }
+
+  state.PauseTiming();
+  if (hits < 0) // keeps the loop from being optimized out
+    fprintf(stderr, "%d\n", hits);
+  delete grid;
+}
+
+void BM_InterceptScan(BenchState &state) {
+  BM_InterceptScanImpl<Engine::GridPackedInterceptMask>(state);
+}
+
+void BM_InterceptScanScalar(BenchState &state) {
+  BM_InterceptScanImpl<Engine::GridPackedInterceptMaskScalar>(state);
+}
+
+#ifdef IMGRID_BENCH_UI
+// Only built when linking the full library, these run complete ImGui frames
+// without a renderer.
+
+// Sets up an ImGui context able to run frames with a current grid context,
+// destroying both when it goes out of scope.
+struct BenchUIContext {
+  ImGuiContext *ImGuiCtx;
+
+  BenchUIContext(const ImVec2 &display_size) {
+    ImGuiCtx = ImGui::CreateContext();
+    ImGuiIO &io = ImGui::GetIO();
+    io.IniFilename = NULL;
+    io.DisplaySize = display_size;
+    unsigned char *pixels;
+    int width, height;
+    io.Fonts->GetTexDataAsRGBA32(&pixels, &width, &height);
+    ImGrid::SetCurrentContext(ImGrid::CreateContext());
+  }
+  BenchUIContext(const BenchUIContext &) = delete;
+  BenchUIContext &operator=(const BenchUIContext &) = delete;
+  ~BenchUIContext() {
+    ImGrid::DestroyContext();
+    ImGui::DestroyContext(ImGuiCtx);
+  }
+};
+
+void BenchUIFrame(int count, bool reversed,
+                  ImGridEntryFlags flags = ImGridEntryFlags_None) {
+  ImGuiIO &io = ImGui::GetIO();
+  io.DeltaTime = 1.0f / 60.0f;
+  ImGui::NewFrame();
+  ImGui::SetNextWindowPos(ImVec2(0, 0));
+  ImGui::SetNextWindowSize(io.DisplaySize);
+  ImGui::Begin("Grid");
+  ImGrid::BeginGrid();
+  for (int i = 0; i < count; ++i) {
+    const int id = reversed ? count - 1 - i : i;
+    if (ImGrid::BeginEntry(id, flags))
+      ImGui::Text("Entry %d", id);
+    ImGrid::EndEntry();
+  }
+  ImGrid::EndGrid();
+  ImGui::End();
+  ImGui::Render();
+}
+
+// Entries are created in id order, then submitted in reverse every frame so
+// EndGrid() has to move every draw channel pair back into depth order.
+void BM_FrameReversedDepth(BenchState &state) {
+  // large enough for every entry to pass the canvas culling
+  BenchUIContext context(ImVec2(16384, 16384));
+  for (int frame = 0; frame < 3; ++frame)
+    BenchUIFrame(state.Range, false);
+
+  while (state.KeepRunning())
+    BenchUIFrame(state.Range, true);
+}
+
+// Frames of an idle grid, nothing hovered or moving, with the entries
+// submitted with the given flags.
+void FrameIdle(BenchState &state, ImGridEntryFlags flags) {
+  BenchUIContext context(ImVec2(16384, 16384));
+  for (int frame = 0; frame < 3; ++frame)
+    BenchUIFrame(state.Range, false, flags);
+
+  while (state.KeepRunning())
+    BenchUIFrame(state.Range, false, flags);
+}
+
+void BM_FrameIdle(BenchState &state) {
+  FrameIdle(state, ImGridEntryFlags_None);
+}
+
+// Same, replaying the entries' cached draw commands.
+void BM_FrameIdleRetained(BenchState &state) {
+  FrameIdle(state, ImGridEntryFlags_Retained);
+}
+
+// The first frame of a new grid, where EndGrid() adds every entry to the
+// engine. Each iteration swaps the fixture's grid context for a new one.
+void BM_FirstFrame(BenchState &state) {
+  BenchUIContext context(ImVec2(1280, 720));
+
+  while (state.KeepRunning()) {
+    ImGrid::DestroyContext();
+    ImGrid::SetCurrentContext(ImGrid::CreateContext());
+    BenchUIFrame(state.Range, false);
+  }
+}
+
+// Saves the laid out grid once, then restores it over the live entries
+// either from the binary snapshot or from the INI text.
+void LoadGridState(BenchState &state, bool binary) {
+  BenchUIContext context(ImVec2(1280, 720));
+  for (int frame = 0; frame < 3; ++frame)
+    BenchUIFrame(state.Range, false);
+
+  size_t size = 0;
+  const char *saved =
+      binary ? (const char *)ImGrid::SaveCurrentGridStateToMemory(&size)
+             : ImGrid::SaveCurrentGridStateToIniString(&size);
+  ImVector<char> data;
+  data.resize((int)size);
+  memcpy(data.Data, saved, size);
+
+  while (state.KeepRunning()) {
+    if (binary)
+      ImGrid::LoadCurrentGridStateFromMemory(data.Data, size);
+    else
+      ImGrid::LoadCurrentGridStateFromIniString(data.Data, size);
+  }
+}
+
+void BM_LoadGridStateBinary(BenchState &state) { LoadGridState(state, true); }
+void BM_LoadGridStateIni(BenchState &state) { LoadGridState(state, false); }
+
+// Fills an id map in random order and then looks every id up, the pattern
+// the entry pool sees when a grid is first submitted. Compares the pool's
+// hash map against the sorted ImGuiStorage it replaced.
+template <typename Map>
+void IdLookup(BenchState &state, void (*set)(Map &, ImGuiID, int),
+              int (*get)(const Map &, ImGuiID)) {
+  ImVector<ImGuiID> ids;
+  ids.resize(state.Range);
+  for (int i = 0; i < state.Range; ++i)
+    ids[i] = (ImGuiID)i;
+  BenchRandom rng(0x1234567u + state.Range);
+  for (int i = state.Range - 1; i > 0; --i)
+    ImSwap(ids[i], ids[rng.Next(0, i)]);
+
+  long long found = 0;
+  while (state.KeepRunning()) {
+    Map map;
+    for (int i = 0; i < ids.Size; ++i)
+      set(map, ids[i], i);
+    for (int pass = 0; pass < 8; ++pass)
+      for (ImGuiID id : ids)
+        found += get(map, id);
+  }
+  if (found < 0)
+    fprintf(stderr, "unreachable\n");
+}
+
+void BM_IdLookupHashMap(BenchState &state) {
+  IdLookup<ImIdIndexMap>(
+      state,
+      [](ImIdIndexMap &map, ImGuiID id, int index) { map.SetIndex(id, index); },
+      [](const ImIdIndexMap &map, ImGuiID id) { return map.GetIndex(id); });
+}
+
+void BM_IdLookupStorage(BenchState &state) {
+  IdLookup<ImGuiStorage>(
+      state,
+      [](ImGuiStorage &map, ImGuiID id, int index) { map.SetInt(id, index); },
+      [](const ImGuiStorage &map, ImGuiID id) { return map.GetInt(id, -1); });
+}
+#endif
+
+const BenchCase GBenchCases[] = {
+    {"BM_Insert", BM_Insert, 0},
+    {"BM_DragSweep", BM_DragSweep, 0},
+    {"BM_DragSweepBounded", BM_DragSweepBounded, 0},
+    {"BM_DragPack", BM_DragPack, 0},
+    {"BM_DragPackFull", BM_DragPackFull, 0},
+    {"BM_Compact", BM_Compact, 0},
+    {"BM_ColumnChange", BM_ColumnChange, 0},
+    {"BM_ColumnChangePrecomputed", BM_ColumnChangePrecomputed, 0},
+    {"BM_ColumnChangeAsync", BM_ColumnChangeAsync, 0},
+    {"BM_AutoPlace", BM_AutoPlace, 0},
+    {"BM_InterceptScan", BM_InterceptScan, 0},
+    {"BM_InterceptScanScalar", BM_InterceptScanScalar, 0},
+#ifdef IMGRID_BENCH_UI
+    {"BM_FrameReversedDepth", BM_FrameReversedDepth, 1000},
+    {"BM_FrameIdle", BM_FrameIdle, 1000},
+    {"BM_FrameIdleRetained", BM_FrameIdleRetained, 1000},
+    {"BM_FirstFrame", BM_FirstFrame, 2000},
+    {"BM_LoadGridStateBinary", BM_LoadGridStateBinary, 10000},
+    {"BM_LoadGridStateIni", BM_LoadGridStateIni, 10000},
+    {"BM_IdLookupHashMap", BM_IdLookupHashMap, 0},
+    {"BM_IdLookupStorage", BM_IdLookupStorage, 0},
+#endif
+};
+
+void WriteContext(FILE *out, const char *executable) {
+  char date[64];
+  time_t now = time(NULL);
+  strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+  fprintf(out, "  \"context\": {\n");
+  fprintf(out, "    \"date\": \"%s\",\n", date);
+  fprintf(out, "    \"executable\": \"%s\",\n", executable);
+  fprintf(out, "    \"packed_kernel\": \"%s\",\n",
+          Engine::GridPackedKernelName());
+#ifdef NDEBUG
+  fprintf(out, "    \"library_build_type\": \"release\"\n");
+#else
+  fprintf(out, "    \"library_build_type\": \"debug\"\n");
+#endif
+  fprintf(out, "  },\n");
+}
+
+const char *ArgValue(const char *arg, const char *flag) {
+  const size_t len = strlen(flag);
+  if (strncmp(arg, flag, len) == 0 && arg[len] == '=')
+    return arg + len + 1;
+  return NULL;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  const char *filter = NULL;
+  const char *out_path = NULL;
+  double min_time = 0.5;
+  int max_entries = BenchDefaultMaxEntries;
+  for (int i = 1; i < argc; ++i) {
+    const char *value;
+    if ((value = ArgValue(argv[i], "--benchmark_filter")) != NULL) {
+      filter = value;
+    } else if ((value = ArgValue(argv[i], "--benchmark_min_time")) != NULL) {
+      min_time = atof(value);
+    } else if ((value = ArgValue(argv[i], "--benchmark_max_entries")) !=
+               NULL) {
+      max_entries = atoi(value);
+    } else if ((value = ArgValue(argv[i], "--benchmark_out")) != NULL) {
+      out_path = value;
+    } else {
+      fprintf(stderr,
+              "usage: %s [--benchmark_filter=<substring>] "
+              "[--benchmark_min_time=<seconds>] "
+              "[--benchmark_max_entries=<count>] [--benchmark_out=<file>]\n",
+              argv[0]);
+      return 1;
+    }
+  }
+
+  FILE *out = out_path != NULL ? fopen(out_path, "w") : stdout;
+  if (out == NULL) {
+    fprintf(stderr, "cannot open %s\n", out_path);
+    return 1;
+  }
+
+  fprintf(out, "{\n");
+  WriteContext(out, argv[0]);
+  fprintf(out, "  \"benchmarks\": [");
+  bool first = true;
+  for (const BenchCase &bench : GBenchCases) {
+    for (int size : BenchSizes) {
+      char name[128];
+      snprintf(name, sizeof(name), "%s/%d", bench.Name, size);
+      if (size > max_entries ||
+          (bench.MaxRange > 0 && size > bench.MaxRange) ||
+          (filter != NULL && strstr(name, filter) == NULL))
+        continue;
+
+      BenchState state(size, min_time);
+      bench.Run(state);
+      const double real_ns = state.RealTime * 1e9 / state.Iterations;
+      const double cpu_ns = state.CpuTime * 1e9 / state.Iterations;
+      fprintf(stderr, "%-24s %12.0f ns %12.0f ns %10lld\n", name, real_ns,
+              cpu_ns, state.Iterations);
+
+      fprintf(out, "%s\n    {\n", first ? "" : ",");
+      fprintf(out, "      \"name\": \"%s\",\n", name);
+      fprintf(out, "      \"run_name\": \"%s\",\n", name);
+      fprintf(out, "      \"run_type\": \"iteration\",\n");
+      fprintf(out, "      \"iterations\": %lld,\n", state.Iterations);
+      fprintf(out, "      \"real_time\": %.3f,\n", real_ns);
+      fprintf(out, "      \"cpu_time\": %.3f,\n", cpu_ns);
+      fprintf(out, "      \"time_unit\": \"ns\",\n");
+      fprintf(out, "      \"entries\": %d\n", size);
+      fprintf(out, "    }");
+      first = false;
+    }
+  }
+  fprintf(out, "\n  ]\n}\n");
+
+  if (out != stdout)
+    fclose(out);
+  return 0;
+}
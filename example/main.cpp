@@ -367,8 +367,7 @@ int main(int, char **) {
     if (ImGui::Begin("Grid")) {
 
       ImGrid::BeginGrid();
-      ImGrid::BeginEntry(0);
-      {
+      if (ImGrid::BeginEntry(0)) {
         ImGrid::BeginEntryTitleBar();
         ImGui::Text("Entry 0");
         ImGrid::EndEntryTitleBar();
@@ -386,8 +385,7 @@ int main(int, char **) {
       ImGrid::EndEntry();
       int i = 1;
       for (i = 1; i < 3; i++) {
-        ImGrid::BeginEntry(i);
-        {
+        if (ImGrid::BeginEntry(i)) {
           ImGrid::BeginEntryTitleBar();
           ImGui::Text("Entry %d", i);
           ImGrid::EndEntryTitleBar();
@@ -411,8 +409,7 @@ int main(int, char **) {
       }
 
       for (; i < 5; i++) {
-        ImGrid::BeginEntry(i);
-        {
+        if (ImGrid::BeginEntry(i)) {
           ImGrid::BeginEntryTitleBar();
           ImGui::Text("Entry %d", i);
           ImGrid::EndEntryTitleBar();
@@ -424,8 +421,7 @@ int main(int, char **) {
       }
 
       for (; i < 6; i++) {
-        ImGrid::BeginEntry(i);
-        {
+        if (ImGrid::BeginEntry(i)) {
           ImGrid::BeginEntryTitleBar();
           ImGui::Text("Entry %d", i);
           ImGrid::EndEntryTitleBar();
@@ -436,8 +432,7 @@ int main(int, char **) {
         ImGrid::EndEntry();
       }
       for (; i < 8; i++) {
-        ImGrid::BeginEntry(i);
-        {
+        if (ImGrid::BeginEntry(i)) {
           ImGrid::BeginEntryTitleBar();
           ImGui::Text("Entry %d", i);
           ImGrid::EndEntryTitleBar();
@@ -450,8 +445,7 @@ int main(int, char **) {
         ImGrid::EndEntry();
       }
       for (; i < 8; i++) {
-        ImGrid::BeginEntry(i);
-        {
+        if (ImGrid::BeginEntry(i)) {
           ImGrid::BeginEntryTitleBar();
           ImGui::Text("Entry %d", i);
           ImGrid::EndEntryTitleBar();
@@ -12,6 +12,18 @@
 #include <stdlib.h>
 #include <string.h> // strlen, strncmp
 
+#ifdef IMGRID_ENABLE_STATS
+#include <chrono>
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define IMGRID_HAS_MMAP
+#endif
+
 // Use secure CRT function variants to avoid MSVC compiler errors
 #ifdef _MSC_VER
 #define sscanf sscanf_s
@@ -24,33 +36,6 @@ ImGridIO::ImGridIO()
 
 ImGridIO::MultipleSelectModifier::MultipleSelectModifier() : Modifier(NULL) {}
 
-ImGridEntry::ImGridEntry(const int id, ImGridPosition pos)
-    : Id(id), Position(pos), ParentContext(NULL), AutoPosition(true), MinW(-1),
-      MinH(-1), MaxW(-1), MaxH(-1), NoResize(false), NoMove(false),
-      Locked(false), AutoSize(true), Dirty(false), Updating(false),
-      SkipDown(false), PrevPosition(), Rect(), LastUIPosition(), LastTried(),
-      WillFitPos(), MovingPosition(), Moving(false), PreviewPosition(),
-      HasPreview(false), BorderHovered(false), BorderHeld(false), ColorStyle(),
-      LayoutStyle() {}
-
-ImGridEntry::ImGridEntry(const int id)
-    : Id(id), Position({}), ParentContext(NULL), AutoPosition(true), MinW(-1),
-      MinH(-1), MaxW(-1), MaxH(-1), NoResize(false), NoMove(false),
-      Locked(false), AutoSize(true), Dirty(false), Updating(false),
-      SkipDown(false), PrevPosition(), Rect(), LastUIPosition(), LastTried(),
-      WillFitPos(), MovingPosition(), Moving(false), PreviewPosition(),
-      HasPreview(false), BorderHovered(false), BorderHeld(false), ColorStyle(),
-      LayoutStyle() {}
-
-ImGridEntry::ImGridEntry(ImGridPosition pos)
-    : Id(-1), Position(pos), ParentContext(NULL), AutoPosition(true), MinW(-1),
-      MinH(-1), MaxW(-1), MaxH(-1), NoResize(false), NoMove(false),
-      Locked(false), AutoSize(true), Dirty(false), Updating(false),
-      SkipDown(false), PrevPosition(), Rect(), LastUIPosition(), LastTried(),
-      WillFitPos(), MovingPosition(), Moving(false), PreviewPosition(),
-      HasPreview(false), BorderHovered(false), BorderHeld(false), ColorStyle(),
-      LayoutStyle() {}
-
 ImGridStyle::ImGridStyle()
     : GridSpacing(50.f), EntryCornerRounding(4.f), EntryPadding(8.f, 8.f),
       EntryBorderThickness(1.f), Flags(ImGridStyleFlags_None), Colors() {}
@@ -64,10 +49,59 @@ void Initialize(ImGridContext *ctx) {
   ctx->HoveredEntryTitleBarIdx = -1;
   ctx->CurrentScope = ImGridScope_None;
   ctx->Zoom = 1.0f;
+  ctx->CurrentEntryVisible = true;
+  ctx->CulledEntryCount = 0;
+  ctx->CurrentRetainedIdx = -1;
+  ctx->PrecomputeLayouts = false;
+  ctx->EntriesRemovedFunc = NULL;
+  ctx->EntriesRemovedUserData = NULL;
+  ctx->FrameStatsHistoryIdx = 0;
+  ctx->EntryStartTime = 0.0;
 
   StyleColorsDark();
 }
 
+// Frames kept for the RenderDebug() plots
+const int FrameStatsHistorySize = 120;
+
+#ifdef IMGRID_ENABLE_STATS
+// milliseconds on a monotonic clock
+inline double StatsTime() {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+#define IMGRID_STATS_TIMER(start) const double start = StatsTime()
+#define IMGRID_STATS_TIME(stats, field, start)                                 \
+  ((stats).field += (float)(StatsTime() - (start)))
+#else
+#define IMGRID_STATS_TIMER(start) ((void)0)
+#define IMGRID_STATS_TIME(stats, field, start) ((void)0)
+#endif
+
+// Folds the engine counters into the frame stats, stores them as the last
+// complete frame and starts counting the next one.
+void FrameStatsFinish(ImGridContext &ctx) {
+  ImGridFrameStats &stats = ctx.FrameStats;
+  if (ctx.Engine != NULL) {
+    ImGridEngineStats &engine_stats = ctx.Engine->Stats;
+    stats.CollideCalls = engine_stats.CollideCalls;
+    stats.EntriesScanned = engine_stats.EntriesScanned;
+    stats.MoveNodeDepth = engine_stats.MaxMoveNodeDepth;
+    stats.PackIterations = engine_stats.PackIterations;
+    engine_stats = ImGridEngineStats();
+  }
+
+  ImVector<ImGridFrameStats> &history = ctx.FrameStatsHistory;
+  if (history.Size < FrameStatsHistorySize)
+    history.push_back(stats);
+  else
+    history[ctx.FrameStatsHistoryIdx] = stats;
+  ctx.FrameStatsHistoryIdx =
+      (ctx.FrameStatsHistoryIdx + 1) % FrameStatsHistorySize;
+  stats = ImGridFrameStats();
+}
+
 inline ImRect GetItemRectInternal() {
   return ImRect(ImGui::GetItemRectMin(), ImGui::GetItemRectMax());
 }
@@ -107,12 +141,15 @@ void DrawListSet(ImDrawList *window_draw_list) {
 }
 
 void ImDrawListGrowChannels(ImDrawList *draw_list, const int num_channels) {
+  IMGRID_PROFILE_ZONE("GrowChannels");
   ImDrawListSplitter &splitter = draw_list->_Splitter;
 
   if (splitter._Count == 1) {
+    IMGRID_STATS_ADD(GImGrid->FrameStats, DrawChannels, num_channels + 1);
     splitter.Split(draw_list, num_channels + 1);
     return;
   }
+  IMGRID_STATS_ADD(GImGrid->FrameStats, DrawChannels, num_channels);
 
   // NOTE: this logic has been lifted from ImDrawListSplitter::Split with
   // slight modifications to allow nested splits. The main modification is
@@ -250,50 +287,320 @@ void DrawListSwapSubmissionIndices(const int lhs_idx, const int rhs_idx) {
 }
 
 void DrawListSortChannelsByDepth(const ImVector<int> &node_idx_depth_order) {
+  IMGRID_PROFILE_ZONE("SortChannelsByDepth");
   if (GImGrid->EntryIdxToSubmissionIdx.Data.Size < 2) {
     return;
   }
 
   IM_ASSERT(node_idx_depth_order.Size == GImGrid->EntryIdxSubmissionOrder.Size);
 
-  int start_idx = node_idx_depth_order.Size - 1;
-
-  while (node_idx_depth_order[start_idx] ==
-         GImGrid->EntryIdxSubmissionOrder[start_idx]) {
-    if (--start_idx == 0) {
+  const int entry_count = node_idx_depth_order.Size;
+  int first_idx = 0;
+  while (node_idx_depth_order[first_idx] ==
+         GImGrid->EntryIdxSubmissionOrder[first_idx]) {
+    if (++first_idx == entry_count) {
       // early out if submission order and depth order are the same
       return;
     }
   }
 
-  // TODO: this is an O(N^2) algorithm. It might be worthwhile revisiting
-  // this to see if the time complexity can be reduced.
+  // source[depth_idx] is the submission idx whose channels have to end up at
+  // depth_idx. Applying that permutation one cycle at a time needs at most
+  // one channel pair swap per entry.
+  ImVector<int> &source = GImGrid->DepthSortSource;
+  source.resize(entry_count);
+  for (int depth_idx = 0; depth_idx < entry_count; ++depth_idx) {
+    source[depth_idx] = GImGrid->EntryIdxToSubmissionIdx.GetInt(
+        static_cast<ImGuiID>(node_idx_depth_order[depth_idx]), -1);
+    IM_ASSERT(source[depth_idx] >= 0);
+  }
+
+  for (int cycle_start = first_idx; cycle_start < entry_count; ++cycle_start) {
+    int depth_idx = cycle_start;
+    while (source[depth_idx] != depth_idx) {
+      const int submission_idx = source[depth_idx];
+      source[depth_idx] = depth_idx;
+      if (submission_idx == cycle_start)
+        break;
+      DrawListSwapSubmissionIndices(depth_idx, submission_idx);
+      depth_idx = submission_idx;
+    }
+  }
 
-  for (int depth_idx = start_idx; depth_idx > 0; --depth_idx) {
+  for (int depth_idx = first_idx; depth_idx < entry_count; ++depth_idx) {
     const int node_idx = node_idx_depth_order[depth_idx];
+    GImGrid->EntryIdxSubmissionOrder[depth_idx] = node_idx;
+    GImGrid->EntryIdxToSubmissionIdx.SetInt(static_cast<ImGuiID>(node_idx),
+                                            depth_idx);
+  }
+}
 
-    // Find the current index of the node_idx in the submission order array
-    int submission_idx = -1;
-    for (int i = 0; i < GImGrid->EntryIdxSubmissionOrder.Size; ++i) {
-      if (GImGrid->EntryIdxSubmissionOrder[i] == node_idx) {
-        submission_idx = i;
-        break;
-      }
+// SECTION[DrawCache]
+// Retained entries keep a copy of their draw commands, see
+// ImGridEntryFlags_Retained. Only the vertices a command indexes are copied,
+// so a command taken out of a shared channel doesn't drag its neighbours'
+// vertices along.
+
+void DrawCacheClear(ImGridDrawCache &cache) {
+  cache.VtxBuffer.resize(0);
+  cache.IdxBuffer.resize(0);
+  cache.CmdBuffer.resize(0);
+  cache.Valid = false;
+}
+
+void DrawCacheAddCmd(ImGridDrawCache &cache, const ImDrawIdx *idx,
+                     const int idx_count, const ImDrawVert *vtx,
+                     const ImVec4 &clip_rect, ImTextureID texture_id) {
+  if (idx_count == 0)
+    return;
+
+  unsigned int min_idx = idx[0];
+  unsigned int max_idx = idx[0];
+  for (int i = 1; i < idx_count; ++i) {
+    min_idx = ImMin(min_idx, (unsigned int)idx[i]);
+    max_idx = ImMax(max_idx, (unsigned int)idx[i]);
+  }
+  const int vtx_count = (int)(max_idx - min_idx) + 1;
+
+  const int vtx_start = cache.VtxBuffer.Size;
+  cache.VtxBuffer.resize(vtx_start + vtx_count);
+  memcpy(cache.VtxBuffer.Data + vtx_start, vtx + min_idx,
+         vtx_count * sizeof(ImDrawVert));
+
+  const int idx_start = cache.IdxBuffer.Size;
+  cache.IdxBuffer.resize(idx_start + idx_count);
+  for (int i = 0; i < idx_count; ++i)
+    cache.IdxBuffer.Data[idx_start + i] = (ImDrawIdx)(idx[i] - min_idx);
+
+  ImGridDrawCacheCmd cmd = {clip_rect, texture_id, vtx_count, idx_count};
+  cache.CmdBuffer.push_back(cmd);
+}
+
+// Appends the commands of draw_list from its idx_start-th index on. Without
+// keep_clip they are replayed under whatever clip rect is current then.
+// Callbacks can't be replayed, returns false when one is found.
+bool DrawCacheAddList(ImGridDrawCache &cache, const ImDrawList &draw_list,
+                      const int idx_start, const bool keep_clip) {
+  const ImVec4 no_clip(-FLT_MAX, -FLT_MAX, FLT_MAX, FLT_MAX);
+  for (const ImDrawCmd &cmd : draw_list.CmdBuffer) {
+    const int idx_end = (int)(cmd.IdxOffset + cmd.ElemCount);
+    if (idx_end < idx_start)
+      continue;
+    if (cmd.UserCallback != NULL)
+      return false;
+    const int idx_first = ImMax((int)cmd.IdxOffset, idx_start);
+    DrawCacheAddCmd(cache, draw_list.IdxBuffer.Data + idx_first,
+                    idx_end - idx_first,
+                    draw_list.VtxBuffer.Data + cmd.VtxOffset,
+                    keep_clip ? cmd.ClipRect : no_clip, cmd.TextureId);
+  }
+  return true;
+}
+
+// Appends the cached commands to the current channel of draw_list, moved by
+// offset. The clip rects are intersected with the current one.
+void DrawCacheReplay(ImDrawList *draw_list, const ImGridDrawCache &cache,
+                     const ImVec2 &offset) {
+  IM_ASSERT(cache.Valid);
+  const ImDrawVert *vtx = cache.VtxBuffer.Data;
+  const ImDrawIdx *idx = cache.IdxBuffer.Data;
+  for (const ImGridDrawCacheCmd &cmd : cache.CmdBuffer) {
+    draw_list->PushClipRect(ImVec2(cmd.ClipRect.x, cmd.ClipRect.y) + offset,
+                            ImVec2(cmd.ClipRect.z, cmd.ClipRect.w) + offset,
+                            true);
+    draw_list->PushTextureID(cmd.TextureId);
+
+    draw_list->PrimReserve(cmd.IdxCount, cmd.VtxCount);
+    const unsigned int vtx_base = draw_list->_VtxCurrentIdx;
+    for (int i = 0; i < cmd.VtxCount; ++i) {
+      draw_list->_VtxWritePtr[i] = vtx[i];
+      draw_list->_VtxWritePtr[i].pos += offset;
     }
-    IM_ASSERT(submission_idx >= 0);
+    for (int i = 0; i < cmd.IdxCount; ++i)
+      draw_list->_IdxWritePtr[i] = (ImDrawIdx)(vtx_base + idx[i]);
+    draw_list->_VtxWritePtr += cmd.VtxCount;
+    draw_list->_IdxWritePtr += cmd.IdxCount;
+    draw_list->_VtxCurrentIdx += cmd.VtxCount;
+
+    draw_list->PopTextureID();
+    draw_list->PopClipRect();
+    vtx += cmd.VtxCount;
+    idx += cmd.IdxCount;
+  }
+}
 
-    if (submission_idx == depth_idx) {
+// SECTION[EntryBuckets]
+
+inline int EntryBucketsCell(float offset, float bucket_size, int count) {
+  const float cell = offset / bucket_size;
+  if (!(cell > 0.0f)) // also catches NaN
+    return 0;
+  return cell >= count ? count - 1 : static_cast<int>(cell);
+}
+
+inline int EntryBucketsColumn(const ImGridEntryBuckets &buckets, float x) {
+  return EntryBucketsCell(x - buckets.Origin.x, buckets.BucketSize,
+                          buckets.Columns);
+}
+
+inline int EntryBucketsRow(const ImGridEntryBuckets &buckets, float y) {
+  return EntryBucketsCell(y - buckets.Origin.y, buckets.BucketSize,
+                          buckets.Rows);
+}
+
+void EntryBucketsBuild(ImGridContext &ctx) {
+  ImGridEntryBuckets &buckets = ctx.EntryBuckets;
+  const int pool_size = ctx.Entries.Pool.size();
+
+  buckets.Valid = true;
+  buckets.BuiltPanning = ctx.Panning;
+  buckets.BuiltZoom = ctx.Zoom;
+  buckets.EntryRects.resize(pool_size);
+  buckets.QueryStamp.resize(pool_size, 0);
+
+  ScreenSpaceRect bounds(FLT_MAX, FLT_MAX, -FLT_MAX, -FLT_MAX);
+  int indexed_count = 0;
+  for (int entry_idx = 0; entry_idx < pool_size; ++entry_idx) {
+    ScreenSpaceRect &rect = buckets.EntryRects[entry_idx];
+    rect = ScreenSpaceRect(FLT_MAX, FLT_MAX, -FLT_MAX, -FLT_MAX);
+    if (!ctx.Entries.InUse[entry_idx])
       continue;
+    const ScreenSpaceRect entry_rect =
+        GetNodeScreenRect(ctx, ctx.Entries.Pool[entry_idx]);
+    if (entry_rect.IsInverted())
+      continue;
+    rect = entry_rect;
+    bounds.Add(entry_rect);
+    indexed_count++;
+  }
+
+  buckets.Origin = bounds.Min;
+  buckets.Columns = buckets.Rows = 0;
+  buckets.BucketStart.resize(1);
+  buckets.BucketStart[0] = 0;
+  buckets.Items.resize(0);
+  if (indexed_count == 0)
+    return;
+
+  // a few grid cells per bucket, coarser when the entries are spread out
+  float bucket_size = ImMax(ctx.Style.GridSpacing * ctx.Zoom * 4.0f, 1.0f);
+  const int max_buckets = ImMax(64, indexed_count * 2);
+  for (;;) {
+    buckets.Columns = static_cast<int>(bounds.GetWidth() / bucket_size) + 1;
+    buckets.Rows = static_cast<int>(bounds.GetHeight() / bucket_size) + 1;
+    if (buckets.Columns * buckets.Rows <= max_buckets)
+      break;
+    bucket_size *= 2.0f;
+  }
+  buckets.BucketSize = bucket_size;
+
+  const int bucket_count = buckets.Columns * buckets.Rows;
+  buckets.BucketStart.resize(bucket_count + 1);
+  memset(buckets.BucketStart.Data, 0, buckets.BucketStart.size_in_bytes());
+
+  for (int pass = 0; pass < 2; ++pass) {
+    for (int entry_idx = 0; entry_idx < pool_size; ++entry_idx) {
+      const ScreenSpaceRect &rect = buckets.EntryRects[entry_idx];
+      if (rect.IsInverted())
+        continue;
+      const int x0 = EntryBucketsColumn(buckets, rect.Min.x);
+      const int x1 = EntryBucketsColumn(buckets, rect.Max.x);
+      const int y0 = EntryBucketsRow(buckets, rect.Min.y);
+      const int y1 = EntryBucketsRow(buckets, rect.Max.y);
+      for (int y = y0; y <= y1; ++y) {
+        for (int x = x0; x <= x1; ++x) {
+          const int bucket = y * buckets.Columns + x;
+          if (pass == 0)
+            buckets.BucketStart[bucket + 1]++;
+          else
+            buckets.Items[buckets.BucketFill[bucket]++] = entry_idx;
+        }
+      }
     }
 
-    for (int j = submission_idx; j < depth_idx; ++j) {
-      DrawListSwapSubmissionIndices(j, j + 1);
-      ImSwap(GImGrid->EntryIdxSubmissionOrder[j],
-             GImGrid->EntryIdxSubmissionOrder[j + 1]);
+    if (pass == 0) {
+      for (int bucket = 0; bucket < bucket_count; ++bucket)
+        buckets.BucketStart[bucket + 1] += buckets.BucketStart[bucket];
+      buckets.Items.resize(buckets.BucketStart[bucket_count]);
+      buckets.BucketFill.resize(bucket_count);
+      memcpy(buckets.BucketFill.Data, buckets.BucketStart.Data,
+             buckets.BucketFill.size_in_bytes());
     }
   }
 }
 
+void EntryBucketsEnsure(ImGridContext &ctx) {
+  const ImGridEntryBuckets &buckets = ctx.EntryBuckets;
+  if (!buckets.Valid || buckets.BuiltPanning != ctx.Panning ||
+      buckets.BuiltZoom != ctx.Zoom ||
+      buckets.EntryRects.Size != ctx.Entries.Pool.size())
+    EntryBucketsBuild(ctx);
+}
+
+// Entries whose screen rect contains pos.
+void EntryBucketsQueryPoint(ImGridContext &ctx, const ScreenSpacePosition &pos,
+                            ImVector<int> &out) {
+  EntryBucketsEnsure(ctx);
+  const ImGridEntryBuckets &buckets = ctx.EntryBuckets;
+  out.resize(0);
+  if (buckets.Columns == 0)
+    return;
+
+  const int bucket = EntryBucketsRow(buckets, pos.y) * buckets.Columns +
+                     EntryBucketsColumn(buckets, pos.x);
+  for (int i = buckets.BucketStart[bucket]; i < buckets.BucketStart[bucket + 1];
+       ++i) {
+    const int entry_idx = buckets.Items[i];
+    if (buckets.EntryRects[entry_idx].Contains(pos))
+      out.push_back(entry_idx);
+  }
+}
+
+// Entries whose screen rect overlaps rect, in entry idx order.
+void EntryBucketsQueryRect(ImGridContext &ctx, const ScreenSpaceRect &rect,
+                           ImVector<int> &out) {
+  EntryBucketsEnsure(ctx);
+  ImGridEntryBuckets &buckets = ctx.EntryBuckets;
+  out.resize(0);
+  if (buckets.Columns == 0)
+    return;
+
+  const int epoch = ++buckets.QueryEpoch;
+  const int x0 = EntryBucketsColumn(buckets, rect.Min.x);
+  const int x1 = EntryBucketsColumn(buckets, rect.Max.x);
+  const int y0 = EntryBucketsRow(buckets, rect.Min.y);
+  const int y1 = EntryBucketsRow(buckets, rect.Max.y);
+  for (int y = y0; y <= y1; ++y) {
+    for (int x = x0; x <= x1; ++x) {
+      const int bucket = y * buckets.Columns + x;
+      for (int i = buckets.BucketStart[bucket];
+           i < buckets.BucketStart[bucket + 1]; ++i) {
+        const int entry_idx = buckets.Items[i];
+        if (buckets.QueryStamp[entry_idx] == epoch)
+          continue;
+        buckets.QueryStamp[entry_idx] = epoch;
+        if (rect.Overlaps(buckets.EntryRects[entry_idx]))
+          out.push_back(entry_idx);
+      }
+    }
+  }
+
+  if (out.Size > 1)
+    ImQsort(out.Data, out.Size, sizeof(int), [](const void *lhs,
+                                                const void *rhs) {
+      return *(const int *)lhs - *(const int *)rhs;
+    });
+}
+
+void UpdateEntryDepthRank(ImGridContext &ctx) {
+  ImVector<int> &depth_rank = ctx.EntryDepthRank;
+  depth_rank.resize(ctx.Entries.Pool.size());
+  for (int entry_idx = 0; entry_idx < depth_rank.Size; ++entry_idx)
+    depth_rank[entry_idx] = -1;
+  for (int depth_idx = 0; depth_idx < ctx.EntryDepthOrder.Size; ++depth_idx)
+    depth_rank[ctx.EntryDepthOrder[depth_idx]] = depth_idx;
+}
+
 bool MouseInCanvas() {
   // This flag should be true either when hovering or clicking something in
   // the canvas.
@@ -414,7 +721,7 @@ void DragOrResize(ImGridContext &ctx, ImGridEngine &engine, ImGridEntry &entry,
         entry.Position.w, entry.Position.h};
 
     entry.LastTried = opts.Position;
-    opts.Skip = NULL;
+    opts.Skip = 0;
     opts.CellWidth = engine.ParentContext->Style.GridSpacing;
     opts.CellHeight = engine.ParentContext->Style.GridSpacing;
     if (Engine::GridEntryMoveCheck(engine, &entry, opts)) {
@@ -487,18 +794,8 @@ void BoxSelectorUpdateSelection(ImGridContext &ctx, ScreenSpaceRect box_rect) {
     ImSwap(box_rect.Min.y, box_rect.Max.y);
   }
 
-  ctx.SelectedEntryIndices.clear();
-
   // Test for overlap against node rectangles
-
-  for (int node_idx = 0; node_idx < ctx.Entries.Pool.size(); ++node_idx) {
-    if (ctx.Entries.InUse[node_idx]) {
-      auto &node = ctx.Entries.Pool[node_idx];
-      if (box_rect.Overlaps(GetNodeScreenRect(ctx, node))) {
-        ctx.SelectedEntryIndices.push_back(node_idx);
-      }
-    }
-  }
+  EntryBucketsQueryRect(ctx, box_rect, ctx.SelectedEntryIndices);
 }
 
 void ClickInteractionUpdate(ImGridContext &ctx) {
@@ -637,22 +934,119 @@ void DrawEntry(ImGridContext &ctx, const int entry_idx) {
   // Adjust rectangle for zoom
   auto entry_rect = GetNodeScreenRect(ctx, entry);
 
-  ctx.CanvasDrawList->AddRectFilled(
-      entry_rect.Min, entry_rect.Max, entry_background,
-      entry.LayoutStyle.CornerRounding * ctx.Zoom);
-
-  ctx.CanvasDrawList->AddRect(
-      entry_rect.Min, entry_rect.Max, entry.ColorStyle.Outline,
-      entry.LayoutStyle.CornerRounding * ctx.Zoom, ImDrawFlags_RoundCornersAll,
-      entry.LayoutStyle.BorderThickness * ctx.Zoom);
+  ImGridRetainedEntry *retained = NULL;
+  const int retained_idx = ObjectPoolFind(ctx.RetainedEntries, entry.Id);
+  if (retained_idx != -1 && ctx.RetainedEntries.InUse[retained_idx])
+    retained = &ctx.RetainedEntries.Pool[retained_idx];
+
+  if (retained != NULL && retained->Replayed && retained->Background.Valid &&
+      retained->BackgroundColor == entry_background &&
+      retained->OutlineColor == entry.ColorStyle.Outline &&
+      retained->Size == entry_rect.GetSize()) {
+    DrawCacheReplay(ctx.CanvasDrawList, retained->Background,
+                    entry_rect.Min - retained->Background.Origin);
+  } else {
+    ImDrawList *draw_list = ctx.CanvasDrawList;
+    const int idx_start = draw_list->IdxBuffer.Size;
+
+    draw_list->AddRectFilled(entry_rect.Min, entry_rect.Max, entry_background,
+                             entry.LayoutStyle.CornerRounding * ctx.Zoom);
+
+    draw_list->AddRect(entry_rect.Min, entry_rect.Max,
+                       entry.ColorStyle.Outline,
+                       entry.LayoutStyle.CornerRounding * ctx.Zoom,
+                       ImDrawFlags_RoundCornersAll,
+                       entry.LayoutStyle.BorderThickness * ctx.Zoom);
+
+    if (retained != NULL) {
+      ImGridDrawCache &cache = retained->Background;
+      DrawCacheClear(cache);
+      cache.Valid = DrawCacheAddList(cache, *draw_list, idx_start, false);
+      cache.Origin = entry_rect.Min;
+      retained->BackgroundColor = entry_background;
+      retained->OutlineColor = entry.ColorStyle.Outline;
+    }
+  }
 
   if (entry_hovered)
     ctx.HoveredEntryIdx = entry_idx;
 
   DrawEntryDecorations(entry);
 }
+
+// Replays the content of the current retained entry into its foreground
+// channel if nothing it was drawn with changed since the capture. Otherwise
+// keys the entry for the capture in EndEntry() and returns false.
+bool RetainedEntryReplay(ImGridContext &ctx, const int entry_idx,
+                         const ImGuiID content_hash) {
+  ImGridRetainedEntry &retained =
+      ctx.RetainedEntries.Pool[ctx.CurrentRetainedIdx];
+  const ImGridEntry &entry = ctx.Entries.Pool[entry_idx];
+  const auto entry_rect = GetNodeScreenRect(ctx, entry);
+  const bool selected = ctx.SelectedEntryIndices.contains(entry_idx);
+
+  // hover covers moving and resizing, both start under the mouse
+  retained.Replayed = retained.Content.Valid &&
+                      retained.ContentHash == content_hash &&
+                      retained.Size == entry_rect.GetSize() &&
+                      retained.Zoom == ctx.Zoom &&
+                      retained.Selected == selected &&
+                      !entry_rect.Contains(ctx.MousePos);
+  if (retained.Replayed) {
+    DrawCacheReplay(ctx.CanvasDrawList, retained.Content,
+                    entry_rect.Min - retained.Content.Origin);
+    return true;
+  }
+
+  retained.ContentHash = content_hash;
+  retained.Size = entry_rect.GetSize();
+  retained.Zoom = ctx.Zoom;
+  retained.Selected = selected;
+  DrawCacheClear(retained.Content);
+  return false;
+}
+
+// Captures the content of the current retained entry: its child window and
+// whatever ImGui drew for that window into the entry's foreground channel,
+// such as its background. Skipped while the content is interacted with or
+// didn't fully land in those two.
+void RetainedEntryCapture(ImGridContext &ctx, const ImGuiWindow &window,
+                          const ScreenSpaceRect &entry_rect) {
+  ImGridRetainedEntry &retained =
+      ctx.RetainedEntries.Pool[ctx.CurrentRetainedIdx];
+  const ImGuiContext &g = *GImGui;
+  // nested child windows and popups have draw lists of their own
+  if (window.DC.ChildWindows.Size > 0 || g.ActiveIdWindow == &window ||
+      g.NavWindow == &window || entry_rect.Contains(ctx.MousePos))
+    return;
+  // cut by the canvas, the clipping would move along with the replay
+  const ImRect clip_rect(ctx.CanvasDrawList->_CmdHeader.ClipRect);
+  if (!clip_rect.Contains(window.Rect()))
+    return;
+  ImGridDrawCache &cache = retained.Content;
+  cache.Valid = DrawCacheAddList(cache, *ctx.CanvasDrawList, 0, true) &&
+                DrawCacheAddList(cache, *window.DrawList, 0, true);
+  cache.Origin = entry_rect.Min;
+}
+
+// defined in SECTION[Serialization]
+void JournalChangeCallback(ImGridEngine &engine,
+                           const ImGridVector<ImGridEntry *> &entries);
+
 namespace {
 
+void EntriesRemovedCallback(ImGridEngine &engine,
+                            const ImGridVector<ImGridEntry *> &entries) {
+  ImGridContext &ctx = *engine.ParentContext;
+  if (ctx.EntriesRemovedFunc == NULL)
+    return;
+  ctx.RemovedIds.resize(0);
+  for (const ImGridEntry *entry : entries)
+    ctx.RemovedIds.push_back(entry->Id);
+  ctx.EntriesRemovedFunc(ctx.RemovedIds.Data, ctx.RemovedIds.Size,
+                         ctx.EntriesRemovedUserData);
+}
+
 float CellWidth(ImGridEngine &engine) { return engine.Options.Column.Columns; }
 
 void UpdateResizeEvent() {}
@@ -671,13 +1065,14 @@ void CellHeight(ImGridEngine &engine, ImGridCellHeightOption *opt = NULL,
     opt = NULL;
   }
 
+  ImGridCellHeightOption auto_opt = {};
   if (opt == NULL) {
     float margin_diff = -engine.Options.MarginRight -
                         engine.Options.MarginLeft + engine.Options.MarginTop +
                         engine.Options.MarginBottom;
-    opt = IM_NEW(ImGridCellHeightOption)();
-    opt->Mode = ImGridCellHeightMode_Auto;
-    opt->HeightPixels = CellWidth(engine) + margin_diff;
+    auto_opt.Mode = ImGridCellHeightMode_Auto;
+    auto_opt.HeightPixels = CellWidth(engine) + margin_diff;
+    opt = &auto_opt;
   }
 
   if (engine.Options.CellHeight.HeightPixels == opt->HeightPixels) {
@@ -691,24 +1086,48 @@ void CellHeight(ImGridEngine &engine, ImGridCellHeightOption *opt = NULL,
   }
 }
 
+// Everything that follows a column change once its layout is in place.
+void ColumnCommitted(ImGridEngine &engine) {
+  if (engine.IsAutoCellHeight) {
+    CellHeight(engine);
+  }
+
+  DoResizeToContentCheck(engine.ParentContext, true);
+  engine.IgnoreLayoutsNodeChange = true;
+  Engine::GridTriggerChangeEvent(engine);
+  engine.IgnoreLayoutsNodeChange = false;
+}
+
+// Solves the breakpoint layouts again if entries changed since the last time.
+void RefreshPrecomputedLayouts(ImGridContext &ctx) {
+  ImGridEngine *engine = ctx.Engine;
+  if (engine == NULL || engine->Options.ColumnOpts == NULL ||
+      Engine::GridAsyncSolvePending(*engine) ||
+      !Engine::GridPrecomputedLayoutsStale(*engine))
+    return;
+  Engine::GridPrecomputeLayouts(*engine, *engine->Options.ColumnOpts);
+}
+
 void Column(ImGridEngine &engine, int column,
             ImGridColumnFlags flags = ImGridColumnFlags_MoveScale) {
-  if (column < 1 || column == engine.Options.Column.Columns)
+  // going back to the current column still has to drop a pending request
+  const bool pending = Engine::GridAsyncSolvePending(engine);
+  if (column < 1 || (column == engine.Options.Column.Columns && !pending))
     return;
 
   int old_column = engine.Options.Column.Columns;
+  if ((engine.Options.AsyncColumnChange && engine.Entries.Size > 0) ||
+      pending) {
+    // keeps the current layout until EndGrid() commits the solved one
+    Engine::GridColumnChangedAsync(engine, old_column, column,
+                                   ImGridColumnOptions{flags});
+    return;
+  }
   engine.Options.Column.Columns = column;
 
   Engine::GridColumnChanged(engine, old_column, column,
                             ImGridColumnOptions{flags});
-  if (engine.IsAutoCellHeight) {
-    CellHeight(engine);
-  }
-
-  DoResizeToContentCheck(engine.ParentContext, true);
-  engine.IgnoreLayoutsNodeChange = true;
-  Engine::GridTriggerChangeEvent(engine);
-  engine.IgnoreLayoutsNodeChange = false;
+  ColumnCommitted(engine);
 }
 
 bool CheckDynamicColumn(ImGridEngine &engine) {
@@ -753,6 +1172,8 @@ void InitializeEngine(ImGridContext *ctx) {
 
   GImGrid->Engine = IM_NEW(ImGridEngine)();
   GImGrid->Engine->ParentContext = GImGrid;
+  GImGrid->Engine->ChangeCallback = JournalChangeCallback;
+  GImGrid->Engine->RemoveCallback = EntriesRemovedCallback;
 
   CheckDynamicColumn(*ctx->Engine);
 
@@ -763,6 +1184,14 @@ void InitializeEngine(ImGridContext *ctx) {
     CellHeight(*ctx->Engine, NULL, false);
   }
 
+  if (ctx->PendingColumn > 0) {
+    // a loaded layout was saved with this column count
+    ctx->Engine->Options.Column.Columns = ctx->PendingColumn;
+    ctx->PendingColumn = 0;
+  }
+  ctx->Engine->CacheLayouts.swap(ctx->PendingCacheLayouts);
+  ctx->PendingCacheLayouts.clear();
+
   GImGrid->Engine->Column = GImGrid->Engine->Options.Column.Columns;
 
   UpdateStyles(GImGrid, false, 0);
@@ -846,8 +1275,8 @@ void BeginEntrySelection(const int entry_idx) {
   }
 }
 
-ImOptionalIndex ResolveHoveredEntry(const ImVector<int> &depth_stack,
-                                    const ImVector<int> OverlappingIndices) {
+ImOptionalIndex ResolveHoveredEntry(const ImVector<int> &depth_rank,
+                                    const ImVector<int> &OverlappingIndices) {
   if (OverlappingIndices.size() == 0) {
     return ImOptionalIndex();
   }
@@ -861,12 +1290,9 @@ ImOptionalIndex ResolveHoveredEntry(const ImVector<int> &depth_stack,
 
   for (int i = 0; i < OverlappingIndices.size(); ++i) {
     const int node_idx = OverlappingIndices[i];
-    for (int depth_idx = 0; depth_idx < depth_stack.size(); ++depth_idx) {
-      if (depth_stack[depth_idx] == node_idx &&
-          (depth_idx > largest_depth_idx)) {
-        largest_depth_idx = depth_idx;
-        node_idx_on_top = node_idx;
-      }
+    if (depth_rank[node_idx] > largest_depth_idx) {
+      largest_depth_idx = depth_rank[node_idx];
+      node_idx_on_top = node_idx;
     }
   }
 
@@ -935,6 +1361,22 @@ ImGridContext *CreateContext() {
   return ctx;
 }
 
+void DestroyContext(ImGridContext *ctx) {
+  if (ctx == NULL)
+    ctx = GImGrid;
+  if (ctx == NULL)
+    return;
+  // the pools only know which entries are alive between frames
+  IM_ASSERT(ctx->CurrentScope == ImGridScope_None);
+  if (ctx->Engine != NULL)
+    IM_DELETE(ctx->Engine);
+  ObjectPoolClear(ctx->Entries);
+  ObjectPoolClear(ctx->RetainedEntries);
+  if (GImGrid == ctx)
+    SetCurrentContext(NULL);
+  IM_DELETE(ctx);
+}
+
 ImGridContext *GetCurrentContext() { return GImGrid; }
 
 void SetCurrentContext(ImGridContext *ctx) { GImGrid = ctx; }
@@ -1088,6 +1530,23 @@ void MakeWidget(ImGridContext *ctx, ImGridEntry *entry) {
   engine.IgnoreLayoutsNodeChange = false;
 }
 
+void RemoveWidget(ImGridContext *ctx, ImGridEntry *entry,
+                  bool trigger_event) {
+  IM_ASSERT(ctx != NULL);
+  IM_ASSERT(ctx->Engine != NULL);
+  IM_ASSERT(entry != NULL);
+  ImGridEngine &engine = *ctx->Engine;
+  IMGRID_STATS_ADD(ctx->FrameStats, RemovedEntries, 1);
+  Engine::GridRemoveEntry(engine, entry, trigger_event);
+  Engine::GridTriggerRemoveEvent(engine);
+  // entries that moved up into the freed cells
+  Engine::GridTriggerChangeEvent(engine);
+  if (!engine.BatchMode)
+    Engine::GridReleaseHandle(engine, entry);
+  entry->ParentContext = NULL;
+  UpdateContainerHeight(ctx);
+}
+
 void UpdateStyles(ImGridContext *ctx, bool force_update, int max_row) {
   (void)force_update;
   IM_ASSERT(ctx != NULL);
@@ -1116,13 +1575,18 @@ void BeginGrid() {
 
   IM_ASSERT(GImGrid->CurrentScope == ImGridScope_None);
   GImGrid->CurrentScope = ImGridScope_Grid;
+  IMGRID_PROFILE_ZONE("BeginGrid");
+  IMGRID_STATS_TIMER(begin_grid_start);
 
   // reset state
   GImGrid->GridContentBounds =
       ScreenSpaceRect(FLT_MAX, FLT_MAX, -FLT_MAX, -FLT_MAX);
   ObjectPoolReset(GImGrid->Entries);
+  ObjectPoolReset(GImGrid->RetainedEntries);
 
   GImGrid->HoveredEntryIdx.Reset();
+  GImGrid->CulledEntryCount = 0;
+  GImGrid->EntryBuckets.Valid = false;
   GImGrid->AutoPanningDelta = ImVec2(0, 0);
   GImGrid->HoveredEntryTitleBarIdx.Reset();
   GImGrid->EntryIndicesOverlappingWithMouse.clear();
@@ -1169,15 +1633,16 @@ void BeginGrid() {
       DrawGrid(*GImGrid, canvas_size);
     }
   }
+  IMGRID_STATS_TIME(GImGrid->FrameStats, BeginGridTime, begin_grid_start);
 }
 
-void InsertNewEntry(ImGridContext *ctx, ImGridEntry *node, bool add_remove) {
+namespace {
 
-  IM_ASSERT(ctx != NULL);
-  IM_ASSERT(ctx->Engine != NULL);
-  IM_ASSERT(node != NULL);
-  ImGridEngine &engine = *ctx->Engine;
+// EndGrid() adds this many new entries or more in one batch
+const int BulkInsertMinEntries = 64;
 
+// Caches the layout of an entry that was saved for a wider grid.
+void CacheWideEntryLayout(ImGridEngine &engine, ImGridEntry *node) {
   ImGridPosition copy = node->Position;
 
   const int column = engine.Column;
@@ -1187,24 +1652,47 @@ void InsertNewEntry(ImGridContext *ctx, ImGridEntry *node, bool add_remove) {
   int max_column = copy.x == -1 ? 0 : copy.x + copy.w;
   if (max_column > column) {
     engine.IgnoreLayoutsNodeChange = true;
-    ImVector<ImGridEntry *> entries;
+    ImGridVector<ImGridEntry *> entries;
     entries.push_back(node);
     Engine::GridCacheLayout(engine, entries, max_column, true);
   }
+}
 
-  // skipped a section here
-
-  BatchUpdate(ctx);
-
-  engine.Loading = true;
-
-  ImVector<ImGridEntry *> updates;
+// Places and adds one entry, the caller holds the engine in batch mode.
+//
+// last_placed maps entry sizes to the last entry of that size placed by the
+// free space search in this batch. Nothing is packed or removed while the
+// batch is open, so cells only fill up: a box that didn't fit before that
+// entry won't fit now either, and the search can start right after it.
+void InsertEntryInBatch(ImGridContext *ctx, ImGridEntry *node, bool add_remove,
+                        ImGuiStorage *last_placed = NULL) {
+  ImGridEngine &engine = *ctx->Engine;
 
   Engine::GridNodeBoundFix(engine, node);
 
   if (node->AutoPosition || node->Position.x == -1 || node->Position.y == -1) {
-    Engine::GridFindSpace(engine, node, engine.Entries, engine.Column);
-  }
+    const ImGridPosition &size = node->Position;
+    if (!(size.w <= 0xffff && size.h <= 0xffff) ||
+        size.w != static_cast<int>(size.w) ||
+        size.h != static_cast<int>(size.h))
+      last_placed = NULL;
+    const ImGuiID size_key =
+        last_placed != NULL ? static_cast<ImGuiID>(size.w) |
+                                  (static_cast<ImGuiID>(size.h) << 16)
+                            : 0;
+
+    ImGridEntry *after =
+        last_placed != NULL
+            ? static_cast<ImGridEntry *>(last_placed->GetVoidPtr(size_key))
+            : NULL;
+    Engine::GridFindSpace(engine, node, engine.Entries, engine.Column, after);
+    if (last_placed != NULL)
+      last_placed->SetVoidPtr(size_key, node);
+  } else if (last_placed != NULL) {
+    // an entry with its own position may push the placed ones away
+    last_placed->Clear();
+  }
+  node->EngineIdx = engine.Entries.Size;
   engine.Entries.push_back(node);
 
   if (add_remove) {
@@ -1212,8 +1700,56 @@ void InsertNewEntry(ImGridContext *ctx, ImGridEntry *node, bool add_remove) {
     Engine::GridPrepareEntry(engine, node);
     MakeWidget(ctx, node);
   }
+}
+
+} // namespace
+
+void InsertNewEntry(ImGridContext *ctx, ImGridEntry *node, bool add_remove) {
+
+  IM_ASSERT(ctx != NULL);
+  IM_ASSERT(ctx->Engine != NULL);
+  IM_ASSERT(node != NULL);
+  ImGridEngine &engine = *ctx->Engine;
+
+  CacheWideEntryLayout(engine, node);
+  IMGRID_STATS_ADD(ctx->FrameStats, NewEntries, 1);
+
+  // skipped a section here
+
+  BatchUpdate(ctx);
+
+  engine.Loading = true;
+  InsertEntryInBatch(ctx, node, add_remove);
+  engine.Loading = false;
+
+  BatchUpdate(ctx, false);
+  engine.IgnoreLayoutsNodeChange = false;
+}
+
+void InsertNewEntries(ImGridContext *ctx, const ImVector<ImGridEntry *> &nodes,
+                      bool add_remove) {
+  IM_ASSERT(ctx != NULL);
+  IM_ASSERT(ctx->Engine != NULL);
+  ImGridEngine &engine = *ctx->Engine;
+  IMGRID_STATS_ADD(ctx->FrameStats, NewEntries, nodes.Size);
+
+  BatchUpdate(ctx);
+  engine.Loading = true;
+
+  // keep the occupancy index open instead of syncing it for every entry
+  Engine::GridOccupancyBegin(engine);
+  // a bounded grid may still move entries while adding them
+  ImGuiStorage last_placed;
+  for (ImGridEntry *node : nodes) {
+    IM_ASSERT(node != NULL);
+    CacheWideEntryLayout(engine, node);
+    InsertEntryInBatch(ctx, node, add_remove,
+                       engine.MaxRow <= 0 ? &last_placed : NULL);
+  }
+  Engine::GridOccupancyEnd(engine);
 
   engine.Loading = false;
+
   BatchUpdate(ctx, false);
   engine.IgnoreLayoutsNodeChange = false;
 }
@@ -1222,6 +1758,8 @@ void EndGrid() {
   IM_ASSERT(GImGrid != NULL);
   IM_ASSERT(GImGrid->CurrentScope == ImGridScope_Grid);
   GImGrid->CurrentScope = ImGridScope_None;
+  IMGRID_PROFILE_ZONE("EndGrid");
+  IMGRID_STATS_TIMER(end_grid_start);
 
   bool no_grid_content = GImGrid->GridContentBounds.IsInverted();
   if (no_grid_content)
@@ -1232,10 +1770,17 @@ void EndGrid() {
 
   if (GImGrid->ClickInteraction.Type == ImGridClickInteractionType_None &&
       MouseInCanvas()) {
+    EntryBucketsQueryPoint(*GImGrid, GImGrid->MousePos,
+                           GImGrid->EntryIndicesOverlappingWithMouse);
+    // the title bar hit area is the whole entry for now
+    GImGrid->EntryTitleBarIndicesOverlappingWithMouse =
+        GImGrid->EntryIndicesOverlappingWithMouse;
+
+    UpdateEntryDepthRank(*GImGrid);
     GImGrid->HoveredEntryIdx = ResolveHoveredEntry(
-        GImGrid->EntryDepthOrder, GImGrid->EntryIndicesOverlappingWithMouse);
+        GImGrid->EntryDepthRank, GImGrid->EntryIndicesOverlappingWithMouse);
     GImGrid->HoveredEntryTitleBarIdx =
-        ResolveHoveredEntry(GImGrid->EntryDepthOrder,
+        ResolveHoveredEntry(GImGrid->EntryDepthRank,
                             GImGrid->EntryTitleBarIndicesOverlappingWithMouse);
   }
 
@@ -1243,16 +1788,56 @@ void EndGrid() {
     InitializeEngine(GImGrid);
   }
 
+  {
+    // add many new entries, e.g. on the first frame, with a single pack
+    ImVector<ImGridEntry *> &new_entries = GImGrid->NewEntries;
+    new_entries.resize(0);
+    for (int entry_idx = 0; entry_idx < GImGrid->Entries.Pool.size();
+         ++entry_idx) {
+      // unused entries are destroyed at the end of the frame
+      ImGridEntry &entry = GImGrid->Entries.Pool[entry_idx];
+      if (GImGrid->Entries.InUse[entry_idx] &&
+          !GridContainsEntry(GImGrid, &entry))
+        new_entries.push_back(&entry);
+    }
+    if (new_entries.Size >= BulkInsertMinEntries) {
+      InsertNewEntries(GImGrid, new_entries);
+      GImGrid->EntryBuckets.Valid = false;
+      GridCacheRects(*GImGrid->Engine, GImGrid->Style.GridSpacing,
+                     GImGrid->Style.GridSpacing, 0, 0, 0, 0);
+    }
+  }
+
+  if (Engine::GridAsyncSolvePending(*GImGrid->Engine)) {
+    ImGridEngine &engine = *GImGrid->Engine;
+    if (GImGrid->ClickInteraction.Type ==
+            ImGridClickInteractionType_Entry ||
+        GImGrid->ClickInteraction.Type ==
+            ImGridClickInteractionType_Resizing) {
+      // the drag supersedes the snapshot, solved again once it is dropped
+      Engine::GridCancelAsyncSolve(engine);
+    } else if (Engine::GridAsyncSolvePoll(engine)) {
+      ColumnCommitted(engine);
+      GImGrid->EntryBuckets.Valid = false;
+      GridCacheRects(engine, GImGrid->Style.GridSpacing,
+                     GImGrid->Style.GridSpacing, 0, 0, 0, 0);
+    }
+  }
+
   for (int entry_idx = 0; entry_idx < GImGrid->Entries.Pool.size();
        ++entry_idx) {
     ImGridEntry &entry = GImGrid->Entries.Pool[entry_idx];
-    if (!GridContainsEntry(GImGrid, &entry)) {
+    if (GImGrid->Entries.InUse[entry_idx] &&
+        !GridContainsEntry(GImGrid, &entry)) {
       InsertNewEntry(GImGrid, &entry);
+      GImGrid->EntryBuckets.Valid = false;
       GridCacheRects(*GImGrid->Engine, GImGrid->Style.GridSpacing,
                      GImGrid->Style.GridSpacing, 0, 0, 0, 0);
       entry.ParentContext = GImGrid->Engine;
     }
-    if (GImGrid->Entries.InUse[entry_idx]) {
+    if (GImGrid->Entries.InUse[entry_idx] &&
+        GImGrid->EntryIdxToSubmissionIdx.GetInt(
+            static_cast<ImGuiID>(entry_idx), -1) != -1) {
       DrawListActivateEntryBackground(entry_idx);
       DrawEntry(*GImGrid, entry_idx);
     }
@@ -1287,13 +1872,43 @@ void EndGrid() {
     GImGrid->Panning += GImGrid->AutoPanningDelta;
   }
 
-  ClickInteractionUpdate(*GImGrid);
+  {
+    IMGRID_STATS_TIMER(click_interaction_start);
+    ClickInteractionUpdate(*GImGrid);
+    IMGRID_STATS_TIME(GImGrid->FrameStats, ClickInteractionTime,
+                      click_interaction_start);
+  }
 
   ObjectPoolUpdate(GImGrid->Entries);
+  ObjectPoolUpdate(GImGrid->RetainedEntries);
+
+  // once this frame's changes are committed, not while a drag is in flight
+  if (GImGrid->PrecomputeLayouts &&
+      GImGrid->ClickInteraction.Type != ImGridClickInteractionType_Entry &&
+      GImGrid->ClickInteraction.Type != ImGridClickInteractionType_Resizing)
+    RefreshPrecomputedLayouts(*GImGrid);
+
+  IMGRID_STATS_TIMER(sort_channels_start);
+  if (GImGrid->CulledEntryCount > 0) {
+    // culled entries have no channels to sort
+    ImVector<int> &visible_depth_order = GImGrid->VisibleEntryDepthOrder;
+    visible_depth_order.resize(0);
+    for (int entry_idx : GImGrid->EntryDepthOrder) {
+      if (GImGrid->EntryIdxToSubmissionIdx.GetInt(
+              static_cast<ImGuiID>(entry_idx), -1) != -1)
+        visible_depth_order.push_back(entry_idx);
+    }
+    DrawListSortChannelsByDepth(visible_depth_order);
+  } else {
+    DrawListSortChannelsByDepth(GImGrid->EntryDepthOrder);
+  }
+  IMGRID_STATS_TIME(GImGrid->FrameStats, SortChannelsTime,
+                    sort_channels_start);
 
-  DrawListSortChannelsByDepth(GImGrid->EntryDepthOrder);
-
-  GImGrid->CanvasDrawList->ChannelsMerge();
+  {
+    IMGRID_PROFILE_ZONE("MergeChannels");
+    GImGrid->CanvasDrawList->ChannelsMerge();
+  }
 
   // pop style
   ImGui::EndChild();      // end scrolling region
@@ -1301,6 +1916,9 @@ void EndGrid() {
   ImGui::PopStyleVar();   // pop window padding
   ImGui::PopStyleVar();   // pop frame padding
   ImGui::EndGroup();
+
+  IMGRID_STATS_TIME(GImGrid->FrameStats, EndGridTime, end_grid_start);
+  FrameStatsFinish(*GImGrid);
 }
 
 void BeginEntryTitleBar() {
@@ -1349,15 +1967,32 @@ void GridSizeConstraintCallback(ImGuiSizeCallbackData *data) {
   data->DesiredSize = size_with_padding - padding;
 }
 
-void BeginEntry(const int entry_id) {
+bool BeginEntry(const int entry_id, ImGridEntryFlags flags,
+                ImGuiID content_hash) {
   // Must call BeginGrid() before BeginEntry()
   IM_ASSERT(GImGrid->CurrentScope == ImGridScope_Grid);
   GImGrid->CurrentScope = ImGridScope_Entry;
+  IMGRID_PROFILE_ZONE("BeginEntry");
+#ifdef IMGRID_ENABLE_STATS
+  GImGrid->EntryStartTime = StatsTime();
+#endif
 
   const int entry_idx = ObjectPoolFindOrCreateIndex(GImGrid->Entries, entry_id);
   GImGrid->CurrentEntryIdx = entry_idx;
+  // before culling, the capture is kept while the entry is scrolled away
+  GImGrid->CurrentRetainedIdx =
+      flags & ImGridEntryFlags_Retained
+          ? ObjectPoolFindOrCreateIndex(GImGrid->RetainedEntries, entry_id)
+          : -1;
 
   ImGridEntry &entry = GImGrid->Entries.Pool[entry_idx];
+  GImGrid->CurrentEntryVisible = IsEntryInsideCanvas(*GImGrid, entry);
+  if (!GImGrid->CurrentEntryVisible) {
+    // keep the layout, skip the child window, draw channels and content
+    GImGrid->CulledEntryCount++;
+    return false;
+  }
+
   entry.ColorStyle.Background =
       GImGrid->Style.Colors[ImGridCol_EntryBackground];
   entry.ColorStyle.BackgroundHovered =
@@ -1379,15 +2014,21 @@ void BeginEntry(const int entry_id) {
   entry.LayoutStyle.Padding = GImGrid->Style.EntryPadding;
   entry.LayoutStyle.BorderThickness = GImGrid->Style.EntryBorderThickness;
 
+  DrawListAddEntry(entry_idx);
+  DrawListActivateCurrentEntryForeground();
+
+  if (GImGrid->CurrentRetainedIdx != -1 &&
+      RetainedEntryReplay(*GImGrid, entry_idx, content_hash)) {
+    IMGRID_STATS_ADD(GImGrid->FrameStats, ReplayedEntries, 1);
+    return false;
+  }
+
   // main content placement
   ImVec2 window_pos = ImGui::GetWindowPos();
   ImVec2 local_pos = GetNodeScreenRect(*GImGrid, entry).Min - window_pos +
                      entry.LayoutStyle.Padding;
   ImGui::SetCursorPos(local_pos);
 
-  DrawListAddEntry(entry_idx);
-  DrawListActivateCurrentEntryForeground();
-
   auto entry_content_size = GetNodeScreenRect(*GImGrid, entry).GetSize();
   if (entry_content_size.x <= GImGrid->Style.GridSpacing ||
       entry_content_size.y <= GImGrid->Style.GridSpacing) {
@@ -1433,6 +2074,7 @@ void BeginEntry(const int entry_id) {
                         ImGuiChildFlags_AlwaysUseWindowPadding,
                     ImGuiWindowFlags_NoScrollWithMouse |
                         ImGuiWindowFlags_NoScrollbar);
+  return true;
 }
 
 bool GridContainsEntry(ImGridContext *ctx, ImGridEntry *entry) {
@@ -1446,6 +2088,17 @@ bool IsNodeSelected(int id) {
   return GImGrid->SelectedEntryIndices.contains(id);
 }
 
+bool IsEntryVisible(int id) {
+  const int entry_idx = ObjectPoolFind(GImGrid->Entries, id);
+  if (entry_idx == -1)
+    return false;
+  return IsEntryInsideCanvas(*GImGrid, GImGrid->Entries.Pool[entry_idx]);
+}
+
+void ReserveEntries(const int count) {
+  ObjectPoolReserve(Context().Entries, count);
+}
+
 ImGridPosition GetEntryPosition(int id) {
   auto idx = ObjectPoolFindOrCreateIndex(GImGrid->Entries, id);
   return GImGrid->Entries.Pool[idx].Position;
@@ -1456,14 +2109,43 @@ void SetEntryPosition(int id, ImGridPosition position) {
   GImGrid->Entries.Pool[idx].Position = position;
 }
 
+void SetEntriesRemovedCallback(ImGridEntriesRemovedFunc func,
+                               void *user_data) {
+  ImGridContext &ctx = Context();
+  ctx.EntriesRemovedFunc = func;
+  ctx.EntriesRemovedUserData = user_data;
+}
+
+void PrecomputeColumnLayouts(bool enabled) {
+  IM_ASSERT(GImGrid != NULL);
+  GImGrid->PrecomputeLayouts = enabled;
+  if (enabled)
+    RefreshPrecomputedLayouts(*GImGrid);
+}
+
 void EndEntry() {
 
   IM_ASSERT(GImGrid->CurrentScope == ImGridScope_Entry);
   GImGrid->CurrentScope = ImGridScope_Grid;
+  IMGRID_PROFILE_ZONE("EndEntry");
 
   // Hack to force the size to be multiples of grid size
   ImGridEntry &entry = GImGrid->Entries.Pool[GImGrid->CurrentEntryIdx];
+  const bool retained = GImGrid->CurrentRetainedIdx != -1;
+
+  if (!GImGrid->CurrentEntryVisible ||
+      (retained &&
+       GImGrid->RetainedEntries.Pool[GImGrid->CurrentRetainedIdx].Replayed)) {
+    // nothing was submitted, the size from the last submitted frame stands
+    const auto screen_rect = GetNodeScreenRect(*GImGrid, entry);
+    GImGrid->GridContentBounds.Add(screen_rect.GetCenter());
+    GImGrid->GridContentBounds.Add(screen_rect.Min);
+    IMGRID_STATS_TIME(GImGrid->FrameStats, EntryTime,
+                      GImGrid->EntryStartTime);
+    return;
+  }
 
+  const ImGuiWindow *content_window = ImGui::GetCurrentWindow();
   ImGui::EndChild();
   ImGui::PopStyleColor();
 
@@ -1480,21 +2162,104 @@ void EndEntry() {
 
   // get the screen coordinates of the entry
   auto screen_rect = GetNodeScreenRect(*GImGrid, entry);
+  if (retained)
+    RetainedEntryCapture(*GImGrid, *content_window, screen_rect);
 
   GImGrid->GridContentBounds.Add(screen_rect.GetCenter());
   GImGrid->GridContentBounds.Add(screen_rect.Min);
+  IMGRID_STATS_TIME(GImGrid->FrameStats, EntryTime, GImGrid->EntryStartTime);
+}
+
+#ifdef IMGRID_ENABLE_STATS
+namespace {
+
+struct ImGridFrameStatsPlot {
+  const char *Label;
+  size_t Offset;
+  bool Time; // float milliseconds, an int count otherwise
+};
+
+const ImGridFrameStatsPlot FrameStatsPlots[] = {
+    {"BeginGrid", offsetof(ImGridFrameStats, BeginGridTime), true},
+    {"Entries", offsetof(ImGridFrameStats, EntryTime), true},
+    {"EndGrid", offsetof(ImGridFrameStats, EndGridTime), true},
+    {"Click interaction", offsetof(ImGridFrameStats, ClickInteractionTime),
+     true},
+    {"Sort channels", offsetof(ImGridFrameStats, SortChannelsTime), true},
+    {"Collide calls", offsetof(ImGridFrameStats, CollideCalls), false},
+    {"Entries scanned", offsetof(ImGridFrameStats, EntriesScanned), false},
+    {"Move depth", offsetof(ImGridFrameStats, MoveNodeDepth), false},
+    {"Pack iterations", offsetof(ImGridFrameStats, PackIterations), false},
+    {"Draw channels", offsetof(ImGridFrameStats, DrawChannels), false},
+    {"New entries", offsetof(ImGridFrameStats, NewEntries), false},
+    {"Removed entries", offsetof(ImGridFrameStats, RemovedEntries), false},
+    {"Replayed entries", offsetof(ImGridFrameStats, ReplayedEntries), false},
+};
+
+struct ImGridFrameStatsPlotData {
+  const ImGridContext *Ctx;
+  const ImGridFrameStatsPlot *Plot;
+};
+
+float FrameStatsValue(const ImGridFrameStats &stats,
+                      const ImGridFrameStatsPlot &plot) {
+  const char *field = reinterpret_cast<const char *>(&stats) + plot.Offset;
+  if (plot.Time) {
+    float value;
+    memcpy(&value, field, sizeof(value));
+    return value;
+  }
+  int value;
+  memcpy(&value, field, sizeof(value));
+  return (float)value;
+}
+
+// PlotLines() callback, oldest frame first
+float FrameStatsPlotValue(void *data, int idx) {
+  const ImGridFrameStatsPlotData &plot_data =
+      *static_cast<const ImGridFrameStatsPlotData *>(data);
+  const ImGridContext &ctx = *plot_data.Ctx;
+  const ImVector<ImGridFrameStats> &history = ctx.FrameStatsHistory;
+  const int oldest =
+      history.Size < FrameStatsHistorySize ? 0 : ctx.FrameStatsHistoryIdx;
+  return FrameStatsValue(history[(oldest + idx) % history.Size],
+                         *plot_data.Plot);
+}
 
-  if (screen_rect.Contains(GImGrid->MousePos))
-    GImGrid->EntryIndicesOverlappingWithMouse.push_back(
-        GImGrid->CurrentEntryIdx);
+void RenderFrameStats(const ImGridContext &ctx) {
+  if (ctx.FrameStatsHistory.empty()) {
+    ImGui::TextDisabled("No complete frame yet");
+    return;
+  }
 
-  // GetEntryTitleRect adds padding and makes it full width
-  if (screen_rect.Contains(GImGrid->MousePos)) {
-    GImGrid->EntryTitleBarIndicesOverlappingWithMouse.push_back(
-        GImGrid->CurrentEntryIdx);
+  const ImGridFrameStats &last = GetFrameStats();
+  for (const ImGridFrameStatsPlot &plot : FrameStatsPlots) {
+    char overlay[32];
+    const float value = FrameStatsValue(last, plot);
+    if (plot.Time)
+      ImFormatString(overlay, IM_ARRAYSIZE(overlay), "%.3f ms", value);
+    else
+      ImFormatString(overlay, IM_ARRAYSIZE(overlay), "%d", (int)value);
+    ImGridFrameStatsPlotData data = {&ctx, &plot};
+    ImGui::PlotLines(plot.Label, FrameStatsPlotValue, &data,
+                     ctx.FrameStatsHistory.Size, 0, overlay, 0.f, FLT_MAX,
+                     ImVec2(0.f, 40.f));
   }
 }
 
+} // namespace
+#endif
+
+const ImGridFrameStats &GetFrameStats() {
+  static const ImGridFrameStats no_stats;
+  const ImGridContext &ctx = Context();
+  if (ctx.FrameStatsHistory.empty())
+    return no_stats;
+  const int last = (ctx.FrameStatsHistoryIdx + FrameStatsHistorySize - 1) %
+                   FrameStatsHistorySize;
+  return ctx.FrameStatsHistory[last];
+}
+
 void RenderDebug() {
   ImGui::Text("Panning: %f %f", GImGrid->Panning.x, GImGrid->Panning.y);
 
@@ -1512,6 +2277,14 @@ void RenderDebug() {
   ImGui::Text("Mouse Pos: %f %f", GImGrid->MousePos.x, GImGrid->MousePos.y);
   ImGui::Text("Panning: %f %f", GImGrid->Panning.x, GImGrid->Panning.y);
 
+  if (ImGui::CollapsingHeader("Frame stats")) {
+#ifdef IMGRID_ENABLE_STATS
+    RenderFrameStats(*GImGrid);
+#else
+    ImGui::TextDisabled("Build with IMGRID_ENABLE_STATS to collect stats");
+#endif
+  }
+
   for (int entry_idx = 0; entry_idx < GImGrid->Entries.Pool.size();
        ++entry_idx) {
     const auto &entry = GImGrid->Entries.Pool[entry_idx];
@@ -1523,4 +2296,770 @@ void RenderDebug() {
   }
 }
 
+// SECTION[Serialization]
+
+namespace {
+
+// Binary snapshot layout, in host byte order (a foreign byte order fails the
+// Magic check). Every field is 4 bytes wide so the record arrays can be read
+// in place from a mapped file without any parsing:
+//   ImGridSnapshotHeader
+//   ImGridSnapshotEntry[EntryCount]
+//   LayoutCount times: ImGridSnapshotLayout, ImGridSnapshotEntry[Count]
+//
+// Checksum covers everything after it and is checked before anything is
+// loaded.
+const ImU32 SnapshotMagic = 0x52474d49; // "IMGR"
+const ImU32 SnapshotVersion = 2;
+
+enum ImGridSnapshotFlags_ {
+  ImGridSnapshotFlags_None = 0,
+  ImGridSnapshotFlags_AutoPosition = 1 << 0,
+};
+
+struct ImGridSnapshotHeader {
+  ImU32 Magic;
+  ImU32 Version;
+  ImU32 Size; // whole snapshot, in bytes
+  ImU32 Checksum;
+  ImS32 Column;
+  ImU32 EntryCount;
+  ImU32 LayoutCount;
+};
+
+struct ImGridSnapshotEntry {
+  ImS32 Id;
+  float X, Y, W, H;
+  float MinW, MinH, MaxW, MaxH;
+  ImU32 Flags;
+};
+
+struct ImGridSnapshotLayout {
+  ImS32 Column;
+  ImU32 Count;
+};
+
+const size_t SnapshotChecksumOffset =
+    offsetof(ImGridSnapshotHeader, Checksum) + sizeof(ImU32);
+
+// Fletcher style running sums over the 4 byte fields in [begin, size), cheap
+// enough to run on every load while still catching flipped bits and shuffled
+// records.
+ImU32 SnapshotChecksum(const char *data, size_t size,
+                       size_t begin = SnapshotChecksumOffset) {
+  ImU64 sum = 1, sum_of_sums = 0;
+  for (size_t i = begin; i + sizeof(ImU32) <= size; i += sizeof(ImU32)) {
+    ImU32 field;
+    memcpy(&field, data + i, sizeof(field));
+    sum += field;
+    sum_of_sums += sum;
+  }
+  return static_cast<ImU32>(sum ^ (sum >> 32)) ^
+         static_cast<ImU32>((sum_of_sums ^ (sum_of_sums >> 32)) * 0x9e3779b1u);
+}
+
+// Read-only view of a whole file. Mapped where mmap() is available, read
+// into memory otherwise.
+struct ImGridMappedFile {
+  const char *Data;
+  size_t Size;
+  bool Mapped;
+
+  ImGridMappedFile() : Data(NULL), Size(0), Mapped(false) {}
+};
+
+bool MappedFileOpen(ImGridMappedFile &file, const char *file_name) {
+#ifdef IMGRID_HAS_MMAP
+  const int fd = open(file_name, O_RDONLY);
+  if (fd >= 0) {
+    struct stat info;
+    void *data = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && info.st_size > 0)
+      data = mmap(NULL, static_cast<size_t>(info.st_size), PROT_READ,
+                  MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data != MAP_FAILED) {
+      file.Data = static_cast<const char *>(data);
+      file.Size = static_cast<size_t>(info.st_size);
+      file.Mapped = true;
+      return true;
+    }
+  }
+#endif
+  file.Data = (const char *)ImFileLoadToMemory(file_name, "rb", &file.Size);
+  file.Mapped = false;
+  return file.Data != NULL;
+}
+
+void MappedFileClose(ImGridMappedFile &file) {
+#ifdef IMGRID_HAS_MMAP
+  if (file.Mapped)
+    munmap(const_cast<char *>(file.Data), file.Size);
+  else
+#endif
+    ImGui::MemFree(const_cast<char *>(file.Data));
+  file = ImGridMappedFile();
+}
+
+bool EntryIsLive(const ImGridContext &ctx, const int entry_idx) {
+  const ImGridEntry &entry = ctx.Entries.Pool[entry_idx];
+  return ObjectPoolFind(ctx.Entries, entry.Id) == entry_idx;
+}
+
+const std::map<int, ImGridVector<ImGridEntry>> &
+GetCacheLayouts(const ImGridContext &ctx) {
+  return ctx.Engine != NULL ? ctx.Engine->CacheLayouts
+                            : ctx.PendingCacheLayouts;
+}
+
+ImGridEntry &LoadEntry(ImGridContext &ctx, const int id) {
+  // the pool records new entries in the current context's depth order
+  IM_ASSERT(GImGrid == &ctx);
+  const int entry_idx = ObjectPoolFindOrCreateIndex(ctx.Entries, id);
+  return ctx.Entries.Pool[entry_idx];
+}
+
+void LoadEntryPosition(ImGridEntry &entry, const ImGridPosition &position) {
+  entry.Position = position;
+  entry.AutoPosition = !entry.Position.Valid();
+  entry.Dirty = true;
+}
+
+void LoadEntryRecord(ImGridContext &ctx, const ImGridSnapshotEntry &record) {
+  ImGridEntry &entry = LoadEntry(ctx, record.Id);
+  LoadEntryPosition(entry,
+                    ImGridPosition(record.X, record.Y, record.W, record.H));
+  entry.MinW = record.MinW;
+  entry.MinH = record.MinH;
+  entry.MaxW = record.MaxW;
+  entry.MaxH = record.MaxH;
+}
+
+// Live entries are all auto positioned once added, so their records flag the
+// entries without a position instead, which LoadEntryPosition() reads back.
+void WriteEntryRecord(char *out, const ImGridEntry &entry,
+                      const bool auto_position) {
+  ImGridSnapshotEntry record;
+  record.Id = entry.Id;
+  record.X = entry.Position.x;
+  record.Y = entry.Position.y;
+  record.W = entry.Position.w;
+  record.H = entry.Position.h;
+  record.MinW = entry.MinW;
+  record.MinH = entry.MinH;
+  record.MaxW = entry.MaxW;
+  record.MaxH = entry.MaxH;
+  record.Flags = auto_position ? ImGridSnapshotFlags_AutoPosition
+                               : ImGridSnapshotFlags_None;
+  memcpy(out, &record, sizeof(record));
+}
+
+void LoadColumn(ImGridContext &ctx, const int column) {
+  if (column < 1)
+    return;
+  if (ctx.Engine == NULL) {
+    ctx.PendingColumn = column;
+    return;
+  }
+  // the loaded positions are already laid out for this column count
+  ctx.Engine->Options.Column.Columns = column;
+  ctx.Engine->Column = column;
+  Engine::GridOccupancyInvalidate(*ctx.Engine);
+}
+
+// Loaded positions bypass the engine, which restamps them on its next query.
+void LoadFinish(ImGridContext &ctx) {
+  ctx.EntryBuckets.Valid = false;
+  if (ctx.Engine == NULL)
+    return;
+  GridCacheRects(*ctx.Engine, ctx.Style.GridSpacing, ctx.Style.GridSpacing, 0,
+                 0, 0, 0);
+  UpdateContainerHeight(&ctx);
+}
+
+struct ImGridIniLoadState {
+  ImGridContext *Ctx;
+  ImGridEntry *Entry;
+  ImGridVector<ImGridEntry> *Layout;
+};
+
+void GridLineHandler(ImGridIniLoadState &state, const char *line) {
+  int column;
+  if (sscanf(line, "column=%i", &column) == 1)
+    LoadColumn(*state.Ctx, column);
+}
+
+void EntryLineHandler(ImGridIniLoadState &state, const char *line) {
+  int id;
+  ImGridPosition p;
+  float a, b;
+  if (sscanf(line, "[entry.%i", &id) == 1) {
+    state.Entry = &LoadEntry(*state.Ctx, id);
+  } else if (state.Entry == NULL) {
+    return;
+  } else if (sscanf(line, "position=%f,%f,%f,%f", &p.x, &p.y, &p.w, &p.h) ==
+             4) {
+    LoadEntryPosition(*state.Entry, p);
+  } else if (sscanf(line, "min=%f,%f", &a, &b) == 2) {
+    state.Entry->MinW = a;
+    state.Entry->MinH = b;
+  } else if (sscanf(line, "max=%f,%f", &a, &b) == 2) {
+    state.Entry->MaxW = a;
+    state.Entry->MaxH = b;
+  }
+}
+
+void LayoutLineHandler(ImGridIniLoadState &state, const char *line) {
+  int column, id, auto_position;
+  ImGridPosition p;
+  if (sscanf(line, "[layout.%i", &column) == 1) {
+    ImGridContext &ctx = *state.Ctx;
+    state.Layout = ctx.Engine != NULL ? &ctx.Engine->CacheLayouts[column]
+                                      : &ctx.PendingCacheLayouts[column];
+    state.Layout->resize(0);
+  } else if (state.Layout != NULL &&
+             sscanf(line, "entry=%i,%f,%f,%f,%f,%i", &id, &p.x, &p.y, &p.w,
+                    &p.h, &auto_position) == 6) {
+    ImGridEntry cached(id, p);
+    cached.AutoPosition = auto_position != 0;
+    state.Layout->push_back(cached);
+  }
+}
+
+// Journal file layout, next to a snapshot written by the same context:
+//   ImGridJournalHeader
+//   any number of blocks: ImGridJournalBlock, ImGridSnapshotEntry[Count]
+//
+// A journal whose SnapshotChecksum doesn't match the snapshot is stale (the
+// snapshot was compacted but the journal wasn't restarted) and is ignored.
+// Replay stops at the first block that is truncated or fails its checksum,
+// which is what a crash in the middle of an append leaves behind.
+const ImU32 JournalMagic = 0x4a474d49; // "IMGJ"
+const ImU32 JournalVersion = 1;
+const ImU32 JournalBlockMagic = 0x4b4c4249; // "IBLK"
+
+struct ImGridJournalHeader {
+  ImU32 Magic;
+  ImU32 Version;
+  ImU32 SnapshotChecksum;
+};
+
+struct ImGridJournalBlock {
+  ImU32 Magic;
+  ImU32 Count;
+  ImU32 Checksum; // of the records
+};
+
+bool WriteWholeFile(const char *file_name, const void *data,
+                    const size_t data_size) {
+  FILE *file = ImFileOpen(file_name, "wb");
+  if (!file)
+    return false;
+  const bool written = fwrite(data, 1, data_size, file) == data_size;
+  return fclose(file) == 0 && written;
+}
+
+// Starts an empty journal on top of the snapshot with the given checksum.
+bool JournalRestart(ImGridStateJournal &journal, const ImU32 checksum) {
+  if (journal.File != NULL)
+    fclose(journal.File);
+  journal.RecordCount = 0;
+  journal.SnapshotChecksum = checksum;
+  journal.File = ImFileOpen(journal.FileName, "wb");
+  if (!journal.File)
+    return false;
+  const ImGridJournalHeader header = {JournalMagic, JournalVersion, checksum};
+  return fwrite(&header, sizeof(header), 1, journal.File) == 1 &&
+         fflush(journal.File) == 0;
+}
+
+bool JournalCompact(ImGridContext &ctx) {
+  ImGridStateJournal &journal = ctx.StateJournal;
+  IM_ASSERT(journal.FileName != NULL);
+
+  size_t data_size = 0u;
+  const char *data =
+      static_cast<const char *>(SaveGridStateToMemory(&ctx, &data_size));
+  ImU32 checksum;
+  memcpy(&checksum, data + offsetof(ImGridSnapshotHeader, Checksum),
+         sizeof(checksum));
+
+  // write aside and rename so a crash leaves either snapshot intact, with the
+  // old journal still matching the old one
+  ImGuiTextBuffer tmp_file_name;
+  tmp_file_name.appendf("%s.tmp", journal.SnapshotFileName);
+  if (!WriteWholeFile(tmp_file_name.c_str(), data, data_size))
+    return false;
+  if (rename(tmp_file_name.c_str(), journal.SnapshotFileName) != 0) {
+    // rename() doesn't replace an existing file everywhere
+    remove(journal.SnapshotFileName);
+    if (rename(tmp_file_name.c_str(), journal.SnapshotFileName) != 0)
+      return false;
+  }
+  return JournalRestart(journal, checksum);
+}
+
+bool JournalAppend(ImGridStateJournal &journal,
+                   const ImGridVector<ImGridEntry *> &entries) {
+  const size_t size = sizeof(ImGridJournalBlock) +
+                      entries.size() * sizeof(ImGridSnapshotEntry);
+  journal.Block.resize(static_cast<int>(size));
+  char *out = journal.Block.Data + sizeof(ImGridJournalBlock);
+  for (const ImGridEntry *entry : entries) {
+    WriteEntryRecord(out, *entry, !entry->Position.Valid());
+    out += sizeof(ImGridSnapshotEntry);
+  }
+
+  ImGridJournalBlock block = {JournalBlockMagic,
+                              static_cast<ImU32>(entries.size()), 0};
+  block.Checksum =
+      SnapshotChecksum(journal.Block.Data, size, sizeof(ImGridJournalBlock));
+  memcpy(journal.Block.Data, &block, sizeof(block));
+
+  journal.RecordCount += entries.size();
+  return fwrite(journal.Block.Data, 1, size, journal.File) == size &&
+         fflush(journal.File) == 0;
+}
+
+void JournalChangeCallback(ImGridEngine &engine,
+                           const ImGridVector<ImGridEntry *> &entries) {
+  ImGridContext &ctx = *engine.ParentContext;
+  ImGridStateJournal &journal = ctx.StateJournal;
+  if (journal.File == NULL)
+    return;
+
+  const int live_entries =
+      ctx.Entries.Pool.size() - ctx.Entries.FreeList.size();
+  const int threshold =
+      journal.CompactThreshold > 0 ? journal.CompactThreshold : live_entries;
+  // a failed append is repaired by writing everything out again
+  if (!JournalAppend(journal, entries) || journal.RecordCount > threshold)
+    JournalCompact(ctx);
+}
+
+// Applies the blocks in a journal on top of the snapshot with the given
+// checksum, returns the number of records replayed.
+int JournalReplay(ImGridContext &ctx, const char *data, const size_t data_size,
+                  const ImU32 snapshot_checksum) {
+  ImGridJournalHeader header;
+  if (data_size < sizeof(header))
+    return 0;
+  memcpy(&header, data, sizeof(header));
+  if (header.Magic != JournalMagic || header.Version != JournalVersion ||
+      header.SnapshotChecksum != snapshot_checksum)
+    return 0;
+
+  int replayed = 0;
+  const char *in = data + sizeof(header);
+  const char *in_end = data + data_size;
+  while (static_cast<size_t>(in_end - in) >= sizeof(ImGridJournalBlock)) {
+    ImGridJournalBlock block;
+    memcpy(&block, in, sizeof(block));
+    if (block.Magic != JournalBlockMagic ||
+        block.Count > static_cast<size_t>(in_end - in - sizeof(block)) /
+                          sizeof(ImGridSnapshotEntry))
+      break;
+    const size_t size =
+        sizeof(block) + block.Count * sizeof(ImGridSnapshotEntry);
+    if (block.Checksum != SnapshotChecksum(in, size, sizeof(block)))
+      break;
+
+    ImGridSnapshotEntry record;
+    for (ImU32 i = 0; i < block.Count; ++i) {
+      memcpy(&record, in + sizeof(block) + i * sizeof(record), sizeof(record));
+      LoadEntryRecord(ctx, record);
+    }
+    replayed += block.Count;
+    in += size;
+  }
+  return replayed;
+}
+
+} // namespace
+
+const char *SaveCurrentGridStateToIniString(size_t *const data_size) {
+  return SaveGridStateToIniString(GImGrid, data_size);
+}
+
+const char *SaveGridStateToIniString(const ImGridContext *const ctx_ptr,
+                                     size_t *const data_size) {
+  IM_ASSERT(ctx_ptr != NULL);
+  const ImGridContext &ctx = *ctx_ptr;
+
+  ImGuiTextBuffer &buf = ctx.TextBuffer;
+  buf.clear();
+  // 64 bytes per entry is a reasonable initial estimate
+  buf.reserve(ctx.Entries.Pool.size() * 64);
+
+  const int column =
+      ctx.Engine != NULL ? ctx.Engine->Column : ctx.PendingColumn;
+  if (column > 0)
+    buf.appendf("[grid]\ncolumn=%i\n", column);
+
+  for (int i = 0; i < ctx.Entries.Pool.size(); ++i) {
+    if (!EntryIsLive(ctx, i))
+      continue;
+    const ImGridEntry &entry = ctx.Entries.Pool[i];
+    const ImGridPosition &p = entry.Position;
+    buf.appendf("\n[entry.%i]\n", entry.Id);
+    buf.appendf("position=%g,%g,%g,%g\n", p.x, p.y, p.w, p.h);
+    buf.appendf("min=%g,%g\n", entry.MinW, entry.MinH);
+    buf.appendf("max=%g,%g\n", entry.MaxW, entry.MaxH);
+  }
+
+  for (const auto &[layout_column, layout] : GetCacheLayouts(ctx)) {
+    buf.appendf("\n[layout.%i]\n", layout_column);
+    for (const ImGridEntry &cached : layout) {
+      const ImGridPosition &p = cached.Position;
+      buf.appendf("entry=%i,%g,%g,%g,%g,%i\n", cached.Id, p.x, p.y, p.w, p.h,
+                  cached.AutoPosition ? 1 : 0);
+    }
+  }
+
+  if (data_size != NULL)
+    *data_size = buf.size();
+  return buf.c_str();
+}
+
+void LoadCurrentGridStateFromIniString(const char *const data,
+                                       const size_t data_size) {
+  LoadGridStateFromIniString(GImGrid, data, data_size);
+}
+
+void LoadGridStateFromIniString(ImGridContext *const ctx,
+                                const char *const data,
+                                const size_t data_size) {
+  IM_ASSERT(ctx != NULL);
+  if (data_size == 0u)
+    return;
+
+  ImGridContext *prev_ctx = GImGrid;
+  SetCurrentContext(ctx);
+
+  char *buf = (char *)ImGui::MemAlloc(data_size + 1);
+  const char *buf_end = buf + data_size;
+  memcpy(buf, data, data_size);
+  buf[data_size] = 0;
+
+  ImGridIniLoadState state = {ctx, NULL, NULL};
+  void (*line_handler)(ImGridIniLoadState &, const char *) = NULL;
+  char *line_end = NULL;
+  for (char *line = buf; line < buf_end; line = line_end + 1) {
+    while (*line == '\n' || *line == '\r')
+      line++;
+    line_end = line;
+    while (line_end < buf_end && *line_end != '\n' && *line_end != '\r')
+      line_end++;
+    line_end[0] = 0;
+    if (*line == ';' || *line == '\0')
+      continue;
+
+    if (line[0] == '[' && line_end[-1] == ']') {
+      line_end[-1] = 0;
+      if (strncmp(line + 1, "entry.", 6) == 0)
+        line_handler = EntryLineHandler;
+      else if (strncmp(line + 1, "layout.", 7) == 0)
+        line_handler = LayoutLineHandler;
+      else if (strcmp(line + 1, "grid") == 0)
+        line_handler = GridLineHandler;
+      else
+        line_handler = NULL;
+      line_end[-1] = ']';
+    }
+
+    if (line_handler != NULL)
+      line_handler(state, line);
+  }
+  ImGui::MemFree(buf);
+
+  LoadFinish(*ctx);
+  SetCurrentContext(prev_ctx);
+}
+
+void SaveCurrentGridStateToIniFile(const char *const file_name) {
+  SaveGridStateToIniFile(GImGrid, file_name);
+}
+
+void SaveGridStateToIniFile(const ImGridContext *const ctx,
+                            const char *const file_name) {
+  size_t data_size = 0u;
+  const char *data = SaveGridStateToIniString(ctx, &data_size);
+  FILE *file = ImFileOpen(file_name, "wt");
+  if (!file)
+    return;
+
+  fwrite(data, sizeof(char), data_size, file);
+  fclose(file);
+}
+
+void LoadCurrentGridStateFromIniFile(const char *const file_name) {
+  LoadGridStateFromIniFile(GImGrid, file_name);
+}
+
+void LoadGridStateFromIniFile(ImGridContext *const ctx,
+                              const char *const file_name) {
+  size_t data_size = 0u;
+  char *file_data = (char *)ImFileLoadToMemory(file_name, "rb", &data_size);
+  if (!file_data)
+    return;
+
+  LoadGridStateFromIniString(ctx, file_data, data_size);
+  ImGui::MemFree(file_data);
+}
+
+const void *SaveCurrentGridStateToMemory(size_t *const data_size) {
+  return SaveGridStateToMemory(GImGrid, data_size);
+}
+
+const void *SaveGridStateToMemory(const ImGridContext *const ctx_ptr,
+                                  size_t *const data_size) {
+  IM_ASSERT(ctx_ptr != NULL);
+  const ImGridContext &ctx = *ctx_ptr;
+  const std::map<int, ImGridVector<ImGridEntry>> &layouts =
+      GetCacheLayouts(ctx);
+
+  ImGridSnapshotHeader header = {};
+  header.Magic = SnapshotMagic;
+  header.Version = SnapshotVersion;
+  header.Column = ctx.Engine != NULL ? ctx.Engine->Column : ctx.PendingColumn;
+  for (int i = 0; i < ctx.Entries.Pool.size(); ++i)
+    header.EntryCount += EntryIsLive(ctx, i) ? 1 : 0;
+  size_t size =
+      sizeof(header) + header.EntryCount * sizeof(ImGridSnapshotEntry);
+  for (const auto &[layout_column, layout] : layouts) {
+    (void)layout_column;
+    header.LayoutCount++;
+    size += sizeof(ImGridSnapshotLayout) +
+            layout.size() * sizeof(ImGridSnapshotEntry);
+  }
+  header.Size = static_cast<ImU32>(size);
+
+  ImVector<char> &buf = ctx.SnapshotBuffer;
+  buf.resize(static_cast<int>(size));
+  char *out = buf.Data;
+  memcpy(out, &header, sizeof(header));
+  out += sizeof(header);
+
+  auto write_entry = [&out](const ImGridEntry &entry, bool auto_position) {
+    WriteEntryRecord(out, entry, auto_position);
+    out += sizeof(ImGridSnapshotEntry);
+  };
+
+  for (int i = 0; i < ctx.Entries.Pool.size(); ++i) {
+    if (EntryIsLive(ctx, i)) {
+      const ImGridEntry &entry = ctx.Entries.Pool[i];
+      write_entry(entry, !entry.Position.Valid());
+    }
+  }
+  for (const auto &[layout_column, layout] : layouts) {
+    ImGridSnapshotLayout record = {layout_column,
+                                   static_cast<ImU32>(layout.size())};
+    memcpy(out, &record, sizeof(record));
+    out += sizeof(record);
+    for (const ImGridEntry &cached : layout)
+      write_entry(cached, cached.AutoPosition);
+  }
+  IM_ASSERT(out == buf.Data + buf.Size);
+
+  header.Checksum = SnapshotChecksum(buf.Data, size);
+  memcpy(buf.Data + offsetof(ImGridSnapshotHeader, Checksum),
+         &header.Checksum, sizeof(header.Checksum));
+
+  if (data_size != NULL)
+    *data_size = size;
+  return buf.Data;
+}
+
+bool LoadCurrentGridStateFromMemory(const void *const data,
+                                    const size_t data_size) {
+  return LoadGridStateFromMemory(GImGrid, data, data_size);
+}
+
+bool LoadGridStateFromMemory(ImGridContext *const ctx, const void *const data,
+                             const size_t data_size) {
+  IM_ASSERT(ctx != NULL);
+  const char *in = static_cast<const char *>(data);
+  const char *in_end = in + data_size;
+
+  ImGridSnapshotHeader header;
+  if (data == NULL || data_size < sizeof(header))
+    return false;
+  memcpy(&header, in, sizeof(header));
+  if (header.Magic != SnapshotMagic || header.Version != SnapshotVersion ||
+      header.Size != data_size ||
+      header.EntryCount > (data_size - sizeof(header)) /
+                              sizeof(ImGridSnapshotEntry))
+    return false;
+  in += sizeof(header);
+
+  // walk the layout headers first so a truncated snapshot changes nothing
+  const char *layouts_begin =
+      in + header.EntryCount * sizeof(ImGridSnapshotEntry);
+  const char *cursor = layouts_begin;
+  for (ImU32 i = 0; i < header.LayoutCount; ++i) {
+    ImGridSnapshotLayout layout;
+    if (static_cast<size_t>(in_end - cursor) < sizeof(layout))
+      return false;
+    memcpy(&layout, cursor, sizeof(layout));
+    cursor += sizeof(layout);
+    if (layout.Count > static_cast<size_t>(in_end - cursor) /
+                           sizeof(ImGridSnapshotEntry))
+      return false;
+    cursor += layout.Count * sizeof(ImGridSnapshotEntry);
+  }
+  if (cursor != in_end ||
+      header.Checksum != SnapshotChecksum(static_cast<const char *>(data),
+                                          data_size))
+    return false;
+
+  // reserve the pool once instead of growing it for every new id
+  ImObjectPool<ImGridEntry> &pool = ctx->Entries;
+  ImGridSnapshotEntry record;
+  int new_entries = -pool.FreeList.Size;
+  for (ImU32 i = 0; i < header.EntryCount; ++i) {
+    memcpy(&record, in + i * sizeof(record), sizeof(record));
+    new_entries += ObjectPoolFind(pool, record.Id) == -1 ? 1 : 0;
+  }
+
+  ImGridContext *prev_ctx = GImGrid;
+  SetCurrentContext(ctx);
+
+  if (new_entries > 0)
+    ObjectPoolReserve(pool, pool.Pool.Size + new_entries);
+
+  LoadColumn(*ctx, header.Column);
+  for (ImU32 i = 0; i < header.EntryCount; ++i) {
+    memcpy(&record, in, sizeof(record));
+    in += sizeof(record);
+    LoadEntryRecord(*ctx, record);
+  }
+
+  std::map<int, ImGridVector<ImGridEntry>> &layouts =
+      ctx->Engine != NULL ? ctx->Engine->CacheLayouts
+                          : ctx->PendingCacheLayouts;
+  layouts.clear();
+  for (ImU32 i = 0; i < header.LayoutCount; ++i) {
+    ImGridSnapshotLayout layout_record;
+    memcpy(&layout_record, in, sizeof(layout_record));
+    in += sizeof(layout_record);
+    ImGridVector<ImGridEntry> &layout = layouts[layout_record.Column];
+    layout.reserve(static_cast<int>(layout_record.Count));
+    for (ImU32 j = 0; j < layout_record.Count; ++j) {
+      memcpy(&record, in, sizeof(record));
+      in += sizeof(record);
+      ImGridEntry cached(record.Id, ImGridPosition(record.X, record.Y,
+                                                   record.W, record.H));
+      cached.AutoPosition = (record.Flags & ImGridSnapshotFlags_AutoPosition);
+      layout.push_back(cached);
+    }
+  }
+  IM_ASSERT(in == in_end);
+
+  LoadFinish(*ctx);
+  SetCurrentContext(prev_ctx);
+  return true;
+}
+
+bool SaveCurrentGridStateToSnapshotFile(const char *const file_name) {
+  return SaveGridStateToSnapshotFile(GImGrid, file_name);
+}
+
+bool SaveGridStateToSnapshotFile(const ImGridContext *const ctx,
+                                 const char *const file_name) {
+  size_t data_size = 0u;
+  const void *data = SaveGridStateToMemory(ctx, &data_size);
+  FILE *file = ImFileOpen(file_name, "wb");
+  if (!file)
+    return false;
+
+  const bool written = fwrite(data, 1, data_size, file) == data_size;
+  return fclose(file) == 0 && written;
+}
+
+bool LoadCurrentGridStateFromSnapshotFile(const char *const file_name) {
+  return LoadGridStateFromSnapshotFile(GImGrid, file_name);
+}
+
+bool LoadGridStateFromSnapshotFile(ImGridContext *const ctx,
+                                   const char *const file_name) {
+  ImGridMappedFile file;
+  if (!MappedFileOpen(file, file_name))
+    return false;
+
+  const bool loaded = LoadGridStateFromMemory(ctx, file.Data, file.Size);
+  MappedFileClose(file);
+  return loaded;
+}
+
+bool OpenGridStateJournal(const char *const snapshot_file_name,
+                          const char *const journal_file_name,
+                          const int compact_threshold,
+                          ImGridContext *const ctx_ptr) {
+  ImGridContext &ctx = ctx_ptr != NULL ? *ctx_ptr : Context();
+  CloseGridStateJournal(&ctx);
+
+  ImGridStateJournal &journal = ctx.StateJournal;
+  journal.SnapshotFileName = ImStrdup(snapshot_file_name);
+  journal.FileName = ImStrdup(journal_file_name);
+  journal.CompactThreshold = compact_threshold;
+  if (!JournalCompact(ctx)) {
+    CloseGridStateJournal(&ctx);
+    return false;
+  }
+  return true;
+}
+
+void CloseGridStateJournal(ImGridContext *const ctx_ptr) {
+  ImGridContext &ctx = ctx_ptr != NULL ? *ctx_ptr : Context();
+  ImGridStateJournal &journal = ctx.StateJournal;
+  if (journal.File != NULL)
+    fclose(journal.File);
+  IM_FREE(journal.FileName);
+  IM_FREE(journal.SnapshotFileName);
+  journal.File = NULL;
+  journal.FileName = NULL;
+  journal.SnapshotFileName = NULL;
+  journal.RecordCount = 0;
+}
+
+bool CompactGridStateJournal(ImGridContext *const ctx_ptr) {
+  ImGridContext &ctx = ctx_ptr != NULL ? *ctx_ptr : Context();
+  if (ctx.StateJournal.FileName == NULL)
+    return false;
+  return JournalCompact(ctx);
+}
+
+bool LoadGridStateFromJournal(const char *const snapshot_file_name,
+                              const char *const journal_file_name,
+                              ImGridContext *const ctx_ptr) {
+  ImGridContext &ctx = ctx_ptr != NULL ? *ctx_ptr : Context();
+  ImGridMappedFile snapshot;
+  if (!MappedFileOpen(snapshot, snapshot_file_name))
+    return false;
+  const bool loaded = LoadGridStateFromMemory(&ctx, snapshot.Data,
+                                              snapshot.Size);
+  ImU32 checksum = 0;
+  if (loaded)
+    memcpy(&checksum,
+           snapshot.Data + offsetof(ImGridSnapshotHeader, Checksum),
+           sizeof(checksum));
+  MappedFileClose(snapshot);
+  if (!loaded)
+    return false;
+
+  // a missing journal just means nothing changed since the snapshot
+  ImGridMappedFile journal;
+  if (!MappedFileOpen(journal, journal_file_name))
+    return true;
+
+  ImGridContext *prev_ctx = GImGrid;
+  SetCurrentContext(&ctx);
+  if (JournalReplay(ctx, journal.Data, journal.Size, checksum) > 0)
+    LoadFinish(ctx);
+  SetCurrentContext(prev_ctx);
+
+  MappedFileClose(journal);
+  return true;
+}
+
 } // namespace ImGrid
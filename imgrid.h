@@ -1,14 +1,15 @@
 #pragma once
 
 #include <cstddef>
-#include <functional>
 #include <imgui.h>
 #include <stddef.h>
 
+#include "imgrid_types.h"
+
 typedef int ImGridCol;         // -> enum ImGridCol_
 typedef int ImGridStyleVar;    // -> enum ImGridStyleVar_
 typedef int ImGridStyleFlags;  // -> enum ImGridStyleFlags_
-typedef int ImGridColumnFlags; // -> emum ImGridColumnFlags_
+typedef int ImGridEntryFlags;  // -> enum ImGridEntryFlags_
 
 enum ImGridCol_ {
   ImGridCol_EntryBackground = 0,
@@ -44,13 +45,12 @@ enum ImGridStyleFlags_ {
   ImGridStyleFlags_GridSnapping = 1 << 4
 };
 
-enum ImGridColumnFlags_ {
-  ImGridColumnFlags_None = 0,
-  ImGridColumnFlags_MoveScale = 1 << 0,
-  ImGridColumnFlags_Compact = 1 << 1,
-  ImGridColumnFlags_List = 1 << 2,
-  ImGridColumnFlags_Scale = 1 << 3,
-  ImGridColumnFlags_Move = 1 << 4,
+enum ImGridEntryFlags_ {
+  ImGridEntryFlags_None = 0,
+  // While the entry sits idle, replay the draw commands of the last frame its
+  // content ran instead of running it again, see BeginEntry(). For static
+  // tiles such as labels or gauges.
+  ImGridEntryFlags_Retained = 1 << 0,
 };
 
 struct ImGuiContext;
@@ -59,43 +59,6 @@ struct ImRect;
 struct ImGridEntry;
 struct ImGridEntry;
 
-struct ImGridPosition {
-  float x, y, w, h;
-
-  void Reset() { x = y = w = h = -1; };
-  bool Valid() { return x != -1 && y != -1; }
-  void SetDefault(const ImGridPosition &defaults) {
-    if (x == -1)
-      x = defaults.x;
-    if (y == -1)
-      y = defaults.y;
-    if (w == -1)
-      w = defaults.w;
-    if (h == -1)
-      h = defaults.h;
-  }
-
-  ImGridPosition() : x(-1), y(-1), w(-1), h(-1) {}
-  ImGridPosition(float _x, float _y, float _w, float _h)
-      : x(_x), y(_y), w(_w), h(_h) {}
-
-  operator bool() const { return (x != -1 && y != -1 && w != -1 && h != -1); }
-};
-
-inline bool operator==(const ImGridPosition &lhs, const ImGridPosition &rhs) {
-  return (lhs.x == rhs.x) && (lhs.y == rhs.y) &&
-         ((lhs.w != -1 ? lhs.w : 1) == (rhs.w != -1 ? rhs.w : 1)) &&
-         ((lhs.h != -1 ? lhs.h : 1) == (rhs.h != -1 ? rhs.h : 1));
-}
-
-struct ImGridColumnOptions {
-  ImGridColumnFlags Flags;
-  std::function<void(int, int, ImVector<ImGridEntry *>,
-                     ImVector<ImGridEntry *>)>
-      Func;
-  ImGridColumnOptions(ImGridColumnFlags flags) : Flags(flags), Func() {}
-};
-
 struct ImGridStyle {
   float GridSpacing;
 
@@ -129,34 +92,40 @@ struct ImGridIO {
   ImGridIO();
 };
 
-struct ImGridMoveOptions {
-  ImGridPosition Position;
-  float MinW, MinH;
-  float MaxW, MaxH;
-
-  ImGridEntry *Skip;
-  bool Pack;
-  bool Nested;
-
-  int CellWidth;
-  int CellHeight;
-
-  int MarginTop;
-  int MarginBottom;
-  int MarginLeft;
-  int MarginRight;
-
-  ImGridPosition Rect;
-
-  bool Resizing;
-
-  ImGridEntry *Collide;
-
-  bool ForceCollide;
-
-  ImGridMoveOptions() {}
+// Work done by one BeginGrid()/EndGrid() frame, see GetFrameStats(). Engine
+// calls made between frames count towards the next one. Only collected when
+// IMGRID_ENABLE_STATS is defined, everything stays zero otherwise.
+struct ImGridFrameStats {
+  // engine
+  int CollideCalls;
+  int EntriesScanned; // occupancy cells, packed slots or entries tested
+  int MoveNodeDepth;  // deepest recursion while pushing entries aside
+  int PackIterations;
+
+  int DrawChannels; // created on the canvas draw list
+  int NewEntries;
+  int RemovedEntries;
+  int ReplayedEntries; // ImGridEntryFlags_Retained ones drawn from the cache
+
+  // milliseconds, EndGridTime includes the two phases after it
+  float BeginGridTime;
+  float EntryTime; // all BeginEntry()/EndEntry() pairs
+  float EndGridTime;
+  float ClickInteractionTime;
+  float SortChannelsTime;
+
+  ImGridFrameStats()
+      : CollideCalls(0), EntriesScanned(0), MoveNodeDepth(0),
+        PackIterations(0), DrawChannels(0), NewEntries(0), RemovedEntries(0),
+        ReplayedEntries(0), BeginGridTime(0.f), EntryTime(0.f),
+        EndGridTime(0.f), ClickInteractionTime(0.f), SortChannelsTime(0.f) {}
 };
 
+// Called from EndGrid() with the ids of the entries that stopped being
+// submitted, once they are out of the layout. One call per frame at most.
+typedef void (*ImGridEntriesRemovedFunc)(const int *ids, int count,
+                                         void *user_data);
+
 namespace ImGrid {
 
 void SetImGuiContext(ImGuiContext *ctx);
@@ -193,12 +162,28 @@ void PopStyleVar(int count = 1);
 void BeginGrid();
 void EndGrid();
 
-void BeginEntry(const int id);
+// Returns false when the entry is scrolled or panned outside of the canvas.
+// The engine still lays it out, but no child window or draw channels are
+// created for it, so skip submitting its content. Always call EndEntry().
+//
+// ImGridEntryFlags_Retained entries also return false while their drawing
+// can be replayed: same content_hash, size, zoom and selection as the last
+// frame their content ran, and not hovered or focused. Their content then
+// isn't submitted, so nothing in it reacts to input; change content_hash
+// whenever it would draw differently.
+[[nodiscard]] bool
+BeginEntry(const int id, ImGridEntryFlags flags = ImGridEntryFlags_None,
+           ImGuiID content_hash = 0);
 void EndEntry();
 
 void BeginEntryTitleBar();
 void EndEntryTitleBar();
 
+// Makes room for count entries in total, e.g. before the first frame of a
+// large grid, so BeginEntry() doesn't grow the entry storage one id at a time.
+// Entries never move in memory either way.
+void ReserveEntries(int count);
+
 // Helper functions
 
 ImRect GetEntryRect();
@@ -207,11 +192,30 @@ bool IsGridHovered();
 
 bool IsEntryHovered(int *entry_id);
 
+// Whether the entry intersects the visible canvas. Only meaningful between
+// BeginGrid() and EndGrid(), unknown ids are never visible.
+bool IsEntryVisible(int id);
+
+// Includes a frame stats panel plotting GetFrameStats() over recent frames.
 void RenderDebug();
 
+// Stats of the last complete frame, all zero without IMGRID_ENABLE_STATS.
+const ImGridFrameStats &GetFrameStats();
+
 // Public Grid API
 ImGridPosition GetEntryPosition(int id);
 void SetEntryPosition(int id, ImGridPosition pos);
+// NULL func stops the notifications, see ImGridEntriesRemovedFunc.
+void SetEntriesRemovedCallback(ImGridEntriesRemovedFunc func,
+                               void *user_data = NULL);
+
+// Solves the layout for every ColumnOpts breakpoint on worker threads, so
+// crossing a breakpoint copies positions instead of solving. These are kept
+// apart from the layouts saved per column count and never overwrite them.
+// While enabled, EndGrid() solves them again after committed changes: a drag
+// or resize dropped, entries added or removed, a column change or a load.
+// Needs a grid that ran EndGrid() once; false stops the refreshes.
+void PrecomputeColumnLayouts(bool enabled = true);
 
 bool IsNodeSelected(int id);
 void MoveNode(ImGridContext &ctx, ImGridEntry *entry, ImGridMoveOptions opts);
@@ -221,13 +225,25 @@ void DoResizeToContentCheck(ImGridContext *ctx, bool delay = false,
 void PrepareElement(ImGridContext *ctx, ImGridEntry *entry,
                     bool trigger_add_event = false);
 [[maybe_unused]] void MakeWidget(ImGridContext *ctx, ImGridEntry *entry);
+// Takes the entry out of the engine and lets the entries below it rise into
+// the freed cells. Called for entries that stop being submitted. Inside a
+// BatchUpdate() the entry keeps its handle, for the remove event the batch
+// sends when it ends, and the caller releases it afterwards.
+void RemoveWidget(ImGridContext *ctx, ImGridEntry *entry,
+                  bool trigger_event = true);
 [[maybe_unused]] void UpdateStyles(ImGridContext *ctx,
                                    bool force_update = false, int max_row = -1);
 void BatchUpdate(ImGridContext *ctx, bool flag = true);
 bool GridContainsEntry(ImGridContext *ctx, ImGridEntry *entry);
 void InsertNewEntry(ImGridContext *ctx, ImGridEntry *node,
                     bool add_remove = true);
+// Adds several entries with a single batch update and pack.
+void InsertNewEntries(ImGridContext *ctx, const ImVector<ImGridEntry *> &nodes,
+                      bool add_remove = true);
 
+// Entry ids, positions and size constraints, plus the column count. Loading
+// before the first frame restores the layout; ids that aren't submitted
+// afterwards are dropped like any other unused entry.
 const char *SaveCurrentGridStateToIniString(size_t *data_size = NULL);
 const char *SaveGridStateToIniString(const ImGridContext *ctx,
                                      size_t *data_size = NULL);
@@ -242,4 +258,47 @@ void SaveGridStateToIniFile(const ImGridContext *ctx, const char *file_name);
 void LoadCurrentGridStateFromIniFile(const char *file_name);
 void LoadGridStateFromIniFile(ImGridContext *ctx, const char *file_name);
 
+// Compact versioned binary snapshot of the same state plus the engine's
+// cached per-column layouts. Loading is a single pass over fixed size
+// records; it returns false and changes nothing if the data is truncated,
+// fails its checksum or was written by an incompatible version.
+const void *SaveCurrentGridStateToMemory(size_t *data_size = NULL);
+const void *SaveGridStateToMemory(const ImGridContext *ctx,
+                                  size_t *data_size = NULL);
+
+bool LoadCurrentGridStateFromMemory(const void *data, size_t data_size);
+bool LoadGridStateFromMemory(ImGridContext *ctx, const void *data,
+                             size_t data_size);
+
+// Snapshot files. Loading maps the file and reads the records in place where
+// mmap() is available, so switching between large saved layouts doesn't copy
+// them through an intermediate buffer first.
+bool SaveCurrentGridStateToSnapshotFile(const char *file_name);
+bool SaveGridStateToSnapshotFile(const ImGridContext *ctx,
+                                 const char *file_name);
+
+bool LoadCurrentGridStateFromSnapshotFile(const char *file_name);
+bool LoadGridStateFromSnapshotFile(ImGridContext *ctx, const char *file_name);
+
+// Incremental persistence. Opening a journal writes a full snapshot, then every
+// engine change event appends just the entries it touched to the journal file,
+// so saving after a drag costs the dirty entries rather than the whole layout.
+// Once the journal holds more than compact_threshold records (0 = more than
+// there are entries) it is compacted into a new snapshot and restarted.
+// Cached per-column layouts are only written on compaction.
+//
+// LoadGridStateFromJournal() loads the snapshot and replays the journal on
+// top, ignoring a journal left over from an older snapshot and anything after
+// a torn final append. Open the journal again afterwards to keep recording.
+bool OpenGridStateJournal(const char *snapshot_file_name,
+                          const char *journal_file_name,
+                          int compact_threshold = 0,
+                          ImGridContext *ctx = NULL); // NULL = current context
+void CloseGridStateJournal(ImGridContext *ctx = NULL);
+bool CompactGridStateJournal(ImGridContext *ctx = NULL);
+
+bool LoadGridStateFromJournal(const char *snapshot_file_name,
+                              const char *journal_file_name,
+                              ImGridContext *ctx = NULL);
+
 } // namespace ImGrid
@@ -1,14 +1,74 @@
 
 #include "imgrid_grid_engine.h"
-#include "imgrid_internal.h"
 
+#include <algorithm>
 #include <cmath>
+#include <condition_variable>
+#include <mutex>
+#include <stdio.h>
+#include <thread>
+
+#ifdef IMGRID_ENABLE_PROFILER
+#include <chrono>
+#endif
+
+#if defined(IMGRID_ENABLE_AVX2)
+#include <immintrin.h>
+#elif defined(IMGRID_ENABLE_SSE2)
+#include <emmintrin.h>
+#endif
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h> // _BitScanForward
+#endif
+
+ImGridEntry::ImGridEntry(const int id, ImGridPosition pos)
+    : Id(id), Position(pos), ParentContext(NULL), AutoPosition(true), MinW(-1),
+      MinH(-1), MaxW(-1), MaxH(-1), NoResize(false), NoMove(false),
+      Locked(false), Resizable(true), AutoSize(true), Dirty(false),
+      Updating(false), SkipDown(false), PrevPosition(), Rect(),
+      LastUIPosition(), LastTried(), WillFitPos(), MovingPosition(),
+      Moving(false), PreviewPosition(), HasPreview(false), BorderHovered(false),
+      BorderHeld(false), OccupancyEpoch(0), OccupiedCells(), PackedIdx(-1),
+      EngineIdx(-1), JournalEpoch(0), Handle(0), ColorStyle(), LayoutStyle() {}
+
+ImGridEntry::ImGridEntry(const int id)
+    : Id(id), Position({}), ParentContext(NULL), AutoPosition(true), MinW(-1),
+      MinH(-1), MaxW(-1), MaxH(-1), NoResize(false), NoMove(false),
+      Locked(false), Resizable(true), AutoSize(true), Dirty(false),
+      Updating(false), SkipDown(false), PrevPosition(), Rect(),
+      LastUIPosition(), LastTried(), WillFitPos(), MovingPosition(),
+      Moving(false), PreviewPosition(), HasPreview(false), BorderHovered(false),
+      BorderHeld(false), OccupancyEpoch(0), OccupiedCells(), PackedIdx(-1),
+      EngineIdx(-1), JournalEpoch(0), Handle(0), ColorStyle(), LayoutStyle() {}
+
+ImGridEntry::ImGridEntry(ImGridPosition pos)
+    : Id(-1), Position(pos), ParentContext(NULL), AutoPosition(true), MinW(-1),
+      MinH(-1), MaxW(-1), MaxH(-1), NoResize(false), NoMove(false),
+      Locked(false), Resizable(true), AutoSize(true), Dirty(false),
+      Updating(false), SkipDown(false), PrevPosition(), Rect(),
+      LastUIPosition(), LastTried(), WillFitPos(), MovingPosition(),
+      Moving(false), PreviewPosition(), HasPreview(false), BorderHovered(false),
+      BorderHeld(false), OccupancyEpoch(0), OccupiedCells(), PackedIdx(-1),
+      EngineIdx(-1), JournalEpoch(0), Handle(0), ColorStyle(), LayoutStyle() {}
 
 inline bool GridPositionsAreIntercepted(ImGridPosition a, ImGridPosition b) {
   return !(a.y >= b.y + b.h || a.y + a.h <= b.y || a.x + a.w <= b.x ||
            a.x >= b.x + b.w);
 }
 
+// Converts a grid position to the (conservative) range of cells it covers.
+// Returns false for positions the occupancy index can't represent.
+inline bool GridPositionToCells(const ImGridPosition &p, GridSpaceRect &out) {
+  if (!(p.x >= 0 && p.y >= 0 && p.w > 0 && p.h > 0 &&
+        p.x + p.w <= SHRT_MAX && p.y + p.h <= SHRT_MAX))
+    return false;
+  out.Min = GridSpacePosition(static_cast<int>(std::floor(p.x)),
+                              static_cast<int>(std::floor(p.y)));
+  out.Max = GridSpacePosition(static_cast<int>(std::ceil(p.x + p.w)),
+                              static_cast<int>(std::ceil(p.y + p.h)));
+  return true;
+}
+
 inline bool RectsAreTouching(ImGridEntry &a, ImGridEntry &b) {
   return GridPositionsAreIntercepted(a.Position,
                                      {b.Position.x - 0.5f, b.Position.y - 0.5f,
@@ -62,10 +122,624 @@ inline bool SwapEntryPositions(ImGridEntry &a, ImGridEntry &b) {
   return false;
 }
 
+namespace {
+
+// shared by every engine, including those of background solves
+std::atomic<int> GOccupancyEpochCounter(0);
+std::atomic<int> GJournalEpochCounter(0);
+
+// Past this many overlapping covers the index stops listing them, the scans
+// to take one over would cost more than the fallbacks they save.
+const int OccupancyCoversMax = 64;
+
+// Keeps the occupancy index synced for the lifetime of the scope, so nested
+// collision queries can use it.
+struct GridOccupancyScope {
+  ImGridEngine &Ctx;
+  GridOccupancyScope(ImGridEngine &ctx) : Ctx(ctx) {
+    ImGrid::Engine::GridOccupancyBegin(Ctx);
+  }
+  ~GridOccupancyScope() { ImGrid::Engine::GridOccupancyEnd(Ctx); }
+};
+
+// Longest run of free cells in row y.
+int OccupancyMeasureRun(const ImGridOccupancy &occ, int y) {
+  const int *counts = occ.Counts.Data + y * occ.Columns;
+  int run = 0, longest = 0;
+  for (int x = 0; x < occ.Columns; ++x) {
+    run = counts[x] == 0 ? run + 1 : 0;
+    longest = IM_MAX(longest, run);
+  }
+  return longest;
+}
+
+// Longest run of free cells in row y, as stored in RunTree.
+inline int OccupancyRowRun(const ImGridOccupancy &occ, int y) {
+  return y < occ.RunLeaves ? occ.RunTree[occ.RunLeaves + y] : occ.Columns;
+}
+
+void OccupancyBuildRunTree(ImGridOccupancy &occ) {
+  int leaves = 1;
+  while (leaves < occ.Rows)
+    leaves <<= 1;
+  occ.RunLeaves = leaves;
+  occ.RunTree.resize(leaves * 2);
+  for (int y = 0; y < leaves; ++y)
+    occ.RunTree[leaves + y] =
+        y < occ.Rows ? OccupancyMeasureRun(occ, y) : occ.Columns;
+  for (int i = leaves - 1; i > 0; --i)
+    occ.RunTree[i] = IM_MAX(occ.RunTree[i * 2], occ.RunTree[i * 2 + 1]);
+}
+
+// Re-measures row y after some of its cells were filled or freed.
+void OccupancyUpdateRun(ImGridOccupancy &occ, int y) {
+  int i = occ.RunLeaves + y;
+  occ.RunTree[i] = OccupancyMeasureRun(occ, y);
+  for (i >>= 1; i > 0; i >>= 1)
+    occ.RunTree[i] = IM_MAX(occ.RunTree[i * 2], occ.RunTree[i * 2 + 1]);
+}
+
+// First row from y on with a free run of at least w cells.
+int OccupancyNextRunRow(const ImGridOccupancy &occ, int y, int w) {
+  const int leaves = occ.RunLeaves;
+  if (y >= leaves)
+    return y;
+  // climb until a subtree right of y holds one, then descend to its first
+  int i = leaves + y;
+  while (occ.RunTree[i] < w) {
+    for (; i & 1; i >>= 1)
+      if (i == 1)
+        return leaves;
+    ++i;
+  }
+  while (i < leaves) {
+    i *= 2;
+    if (occ.RunTree[i] < w)
+      ++i;
+  }
+  return i - leaves;
+}
+
+void OccupancyReset(ImGridOccupancy &occ, int columns, int rows) {
+  occ.Epoch = ++GOccupancyEpochCounter;
+  occ.Columns = IM_MAX(columns, 1);
+  occ.Rows = IM_MAX(rows, 0);
+  occ.Owners.resize(occ.Columns * occ.Rows);
+  occ.Counts.resize(occ.Columns * occ.Rows);
+  if (!occ.Owners.empty()) {
+    memset(occ.Owners.Data, 0, occ.Owners.size_in_bytes());
+    memset(occ.Counts.Data, 0, occ.Counts.size_in_bytes());
+  }
+  OccupancyBuildRunTree(occ);
+  occ.Covers.resize(0);
+  occ.Unindexed = 0;
+  occ.Ambiguous = 0;
+  occ.Overlapped = 0;
+  occ.Valid = true;
+}
+
+void OccupancyGrowRows(ImGridOccupancy &occ, int rows) {
+  // rows are stored contiguously, so growing only appends empty cells
+  rows = IM_MAX(rows, occ.Rows * 2);
+  occ.Owners.resize(occ.Columns * rows, NULL);
+  occ.Counts.resize(occ.Columns * rows, 0);
+  occ.Rows = rows;
+  // leaves past the old rows already hold a free row
+  if (rows > occ.RunLeaves)
+    OccupancyBuildRunTree(occ);
+}
+
+void OccupancyAdd(ImGridOccupancy &occ, ImGridEntry *entry) {
+  GridSpaceRect cells;
+  entry->OccupancyEpoch = occ.Epoch;
+  entry->OccupiedCells = GridSpaceRect();
+  if (!GridPositionToCells(entry->Position, cells)) {
+    occ.Unindexed++;
+    return;
+  }
+  if (cells.Max.x > occ.Columns) {
+    // wider than the bitmap, rebuild on the next sync
+    occ.Valid = false;
+    return;
+  }
+  if (cells.Max.y > occ.Rows)
+    OccupancyGrowRows(occ, cells.Max.y);
+
+  for (int y = cells.Min.y; y < cells.Max.y; ++y) {
+    bool filled = false;
+    for (int x = cells.Min.x; x < cells.Max.x; ++x) {
+      const int idx = y * occ.Columns + x;
+      if (occ.Counts[idx]++ == 0) {
+        occ.Owners[idx] = entry;
+        filled = true;
+      } else {
+        occ.Overlapped++;
+        if (occ.Covers.Size < OccupancyCoversMax)
+          occ.Covers.push_back({idx, entry});
+      }
+    }
+    if (filled)
+      OccupancyUpdateRun(occ, y);
+  }
+  entry->OccupiedCells = cells;
+}
+
+// Drops the listed cover of cell by entry, or any cover of it if entry is
+// NULL, and returns its entry.
+ImGridEntry *OccupancyTakeCover(ImGridOccupancy &occ, int cell,
+                                const ImGridEntry *entry) {
+  for (int i = 0; i < occ.Covers.Size; ++i) {
+    const ImGridOccupancyCover cover = occ.Covers[i];
+    if (cover.Cell == cell && (entry == NULL || cover.Entry == entry)) {
+      occ.Covers[i] = occ.Covers.back();
+      occ.Covers.pop_back();
+      return cover.Entry;
+    }
+  }
+  return NULL;
+}
+
+void OccupancyRemove(ImGridOccupancy &occ, ImGridEntry *entry) {
+  const GridSpaceRect cells = entry->OccupiedCells;
+  entry->OccupancyEpoch = 0;
+  entry->OccupiedCells = GridSpaceRect();
+  if (cells.Max.x <= cells.Min.x || cells.Max.y <= cells.Min.y) {
+    occ.Unindexed--;
+    return;
+  }
+
+  for (int y = cells.Min.y; y < cells.Max.y; ++y) {
+    bool freed = false;
+    for (int x = cells.Min.x; x < cells.Max.x; ++x) {
+      const int idx = y * occ.Columns + x;
+      const int count = --occ.Counts[idx];
+      if (count == 0)
+        freed = true;
+      else
+        occ.Overlapped--;
+      if (occ.Owners[idx] == entry) {
+        occ.Owners[idx] =
+            count > 0 ? OccupancyTakeCover(occ, idx, NULL) : NULL;
+        if (count > 0 && occ.Owners[idx] == NULL)
+          occ.Ambiguous++;
+      } else {
+        if (!occ.Covers.empty())
+          OccupancyTakeCover(occ, idx, entry);
+        if (occ.Owners[idx] == NULL && count == 0)
+          occ.Ambiguous--;
+      }
+    }
+    if (freed)
+      OccupancyUpdateRun(occ, y);
+  }
+}
+
+bool OccupancyNeedsRestamp(const ImGridEntry *entry) {
+  GridSpaceRect cells;
+  if (!GridPositionToCells(entry->Position, cells))
+    return entry->OccupiedCells.Max.x > entry->OccupiedCells.Min.x;
+  return cells.Min != entry->OccupiedCells.Min ||
+         cells.Max != entry->OccupiedCells.Max;
+}
+
+// Returns false if the occupancy index can't answer a query for area.
+bool OccupancyQueryCells(const ImGridEngine &ctx, const ImGridPosition &area,
+                         GridSpaceRect &cells) {
+  const ImGridOccupancy &occ = ctx.Occupancy;
+  if (occ.ScopeDepth == 0 || !occ.Valid || occ.Unindexed > 0)
+    return false;
+  if (!GridPositionToCells(area, cells))
+    return false;
+  cells.Max.x = IM_MIN(cells.Max.x, occ.Columns);
+  cells.Max.y = IM_MIN(cells.Max.y, occ.Rows);
+  return true;
+}
+
+// First-fit search for a free size.w x size.h slot, scanning cell indices
+// (y * column + x) from start like gridstack's findEmptyPosition(), but
+// testing occupancy cells instead of every entry. RunTree skips to the next
+// row with a long enough free run in O(log rows), and a candidate is dropped
+// as soon as one of the rows under it lacks one, so only rows that could hold
+// the slot are scanned cell by cell. Rows below the bitmap are free, the
+// search never runs past them.
+//
+// Returns the cell index of the slot, -1 if there's none before max_index,
+// or -2 if the index can't answer for ctx.Entries and the caller has to scan.
+int OccupancyFirstFit(const ImGridEngine &ctx, int column, int start,
+                      int max_index, const ImGridPosition &size) {
+  const ImGridOccupancy &occ = ctx.Occupancy;
+  if (occ.ScopeDepth == 0 || !occ.Valid || occ.Unindexed > 0 ||
+      column <= 0 || column > occ.Columns || start < 0)
+    return -2;
+  // cells are exact for whole-number boxes, see GridPositionToCells()
+  const int w = static_cast<int>(size.w);
+  const int h = static_cast<int>(size.h);
+  if (w != size.w || h != size.h || w <= 0 || h <= 0)
+    return -2;
+  if (w > column)
+    return -1;
+
+  int x = start % column;
+  for (int y = start / column;; ++y, x = 0) {
+    if (x == 0)
+      y = OccupancyNextRunRow(occ, y, w);
+    if (static_cast<long long>(y) * column + x >= max_index)
+      return -1;
+    // the run has to fit in every row under the slot, skip past the last
+    // row that can't hold one
+    int blocked = -1;
+    for (int dy = h - 1; dy >= 0 && blocked < 0; --dy) {
+      if (OccupancyRowRun(occ, y + dy) < w)
+        blocked = y + dy;
+    }
+    if (blocked >= 0) {
+      y = blocked;
+      continue;
+    }
+
+    int run = 0;
+    for (; x < column; ++x) {
+      bool free = true;
+      for (int dy = 0; dy < h && y + dy < occ.Rows && free; ++dy)
+        free = occ.Counts[(y + dy) * occ.Columns + x] == 0;
+      run = free ? run + 1 : 0;
+      if (run == w) {
+        const int index = y * column + x - (w - 1);
+        return index < max_index ? index : -1;
+      }
+    }
+  }
+}
+
+inline bool PackedFits(int v) { return v >= SHRT_MIN && v <= SHRT_MAX; }
+
+// Converts a grid position to packed int16 x, y, w, h. Returns false if any
+// component isn't a whole number that fits, or if x + w / y + h don't, so the
+// SIMD kernels can add them in 16 bits.
+inline bool GridPositionToPacked(const ImGridPosition &p, ImS16 out[4]) {
+  const float values[4] = {p.x, p.y, p.w, p.h};
+  for (int i = 0; i < 4; ++i) {
+    if (!(values[i] >= SHRT_MIN && values[i] <= SHRT_MAX) ||
+        values[i] != static_cast<float>(static_cast<int>(values[i])))
+      return false;
+    out[i] = static_cast<ImS16>(values[i]);
+  }
+  return PackedFits(out[0] + out[2]) && PackedFits(out[1] + out[3]);
+}
+
+inline int PackedLowestBit(ImU32 mask) {
+#if defined(_MSC_VER) && !defined(__clang__)
+  unsigned long index;
+  _BitScanForward(&index, mask);
+  return (int)index;
+#else
+  return __builtin_ctz(mask);
+#endif
+}
+
+#if defined(IMGRID_ENABLE_AVX2)
+// 16 slots per call
+inline ImU32 PackedInterceptMask16(const ImGridPackedPositions &packed, int i,
+                                   const ImS16 area[4], int skip_id,
+                                   int skip2_id) {
+  const __m256i ax = _mm256_set1_epi16(area[0]);
+  const __m256i ay = _mm256_set1_epi16(area[1]);
+  const __m256i ax2 = _mm256_set1_epi16((ImS16)(area[0] + area[2]));
+  const __m256i ay2 = _mm256_set1_epi16((ImS16)(area[1] + area[3]));
+  const __m256i x = _mm256_loadu_si256((const __m256i *)(packed.X.Data + i));
+  const __m256i y = _mm256_loadu_si256((const __m256i *)(packed.Y.Data + i));
+  const __m256i x2 = _mm256_add_epi16(
+      x, _mm256_loadu_si256((const __m256i *)(packed.W.Data + i)));
+  const __m256i y2 = _mm256_add_epi16(
+      y, _mm256_loadu_si256((const __m256i *)(packed.H.Data + i)));
+  __m256i hit =
+      _mm256_and_si256(_mm256_cmpgt_epi16(y2, ay), _mm256_cmpgt_epi16(ay2, y));
+  hit = _mm256_and_si256(hit, _mm256_and_si256(_mm256_cmpgt_epi16(ax2, x),
+                                               _mm256_cmpgt_epi16(x2, ax)));
+
+  const __m256i skip = _mm256_set1_epi32(skip_id);
+  const __m256i skip2 = _mm256_set1_epi32(skip2_id);
+  const __m256i ids_lo =
+      _mm256_loadu_si256((const __m256i *)(packed.Ids.Data + i));
+  const __m256i ids_hi =
+      _mm256_loadu_si256((const __m256i *)(packed.Ids.Data + i + 8));
+  const __m256i skip_lo = _mm256_or_si256(_mm256_cmpeq_epi32(ids_lo, skip),
+                                          _mm256_cmpeq_epi32(ids_lo, skip2));
+  const __m256i skip_hi = _mm256_or_si256(_mm256_cmpeq_epi32(ids_hi, skip),
+                                          _mm256_cmpeq_epi32(ids_hi, skip2));
+  // packs works per 128-bit lane, put the 64-bit quarters back in order
+  const __m256i skipped = _mm256_permute4x64_epi64(
+      _mm256_packs_epi32(skip_lo, skip_hi), 0xD8);
+  hit = _mm256_andnot_si256(skipped, hit);
+
+  const __m128i bytes = _mm_packs_epi16(_mm256_castsi256_si128(hit),
+                                        _mm256_extracti128_si256(hit, 1));
+  return (ImU32)_mm_movemask_epi8(bytes);
+}
+#elif defined(IMGRID_ENABLE_SSE2)
+// 8 slots per call
+inline ImU32 PackedInterceptMask8(const ImGridPackedPositions &packed, int i,
+                                  const ImS16 area[4], int skip_id,
+                                  int skip2_id) {
+  const __m128i ax = _mm_set1_epi16(area[0]);
+  const __m128i ay = _mm_set1_epi16(area[1]);
+  const __m128i ax2 = _mm_set1_epi16((ImS16)(area[0] + area[2]));
+  const __m128i ay2 = _mm_set1_epi16((ImS16)(area[1] + area[3]));
+  const __m128i x = _mm_loadu_si128((const __m128i *)(packed.X.Data + i));
+  const __m128i y = _mm_loadu_si128((const __m128i *)(packed.Y.Data + i));
+  const __m128i x2 =
+      _mm_add_epi16(x, _mm_loadu_si128((const __m128i *)(packed.W.Data + i)));
+  const __m128i y2 =
+      _mm_add_epi16(y, _mm_loadu_si128((const __m128i *)(packed.H.Data + i)));
+  __m128i hit = _mm_and_si128(_mm_cmplt_epi16(ay, y2), _mm_cmpgt_epi16(ay2, y));
+  hit = _mm_and_si128(
+      hit, _mm_and_si128(_mm_cmpgt_epi16(ax2, x), _mm_cmplt_epi16(ax, x2)));
+
+  const __m128i skip = _mm_set1_epi32(skip_id);
+  const __m128i skip2 = _mm_set1_epi32(skip2_id);
+  const __m128i ids_lo =
+      _mm_loadu_si128((const __m128i *)(packed.Ids.Data + i));
+  const __m128i ids_hi =
+      _mm_loadu_si128((const __m128i *)(packed.Ids.Data + i + 4));
+  const __m128i skipped =
+      _mm_packs_epi32(_mm_or_si128(_mm_cmpeq_epi32(ids_lo, skip),
+                                   _mm_cmpeq_epi32(ids_lo, skip2)),
+                      _mm_or_si128(_mm_cmpeq_epi32(ids_hi, skip),
+                                   _mm_cmpeq_epi32(ids_hi, skip2)));
+  hit = _mm_andnot_si128(skipped, hit);
+
+  return (ImU32)_mm_movemask_epi8(_mm_packs_epi16(hit, _mm_setzero_si128()));
+}
+#endif
+
+void PackedResize(ImGridPackedPositions &packed, int size) {
+  packed.X.resize(size);
+  packed.Y.resize(size);
+  packed.W.resize(size);
+  packed.H.resize(size);
+  packed.Ids.resize(size);
+  packed.Handles.resize(size);
+  packed.Inexact.resize(size);
+}
+
+void PackedAssign(ImGridPackedPositions &packed, int slot,
+                  const ImGridEntry *entry, bool force_inexact = false) {
+  ImS16 values[4] = {0, 0, 0, 0};
+  const bool inexact =
+      force_inexact || !GridPositionToPacked(entry->Position, values);
+  packed.X[slot] = values[0];
+  packed.Y[slot] = values[1];
+  packed.W[slot] = values[2];
+  packed.H[slot] = values[3];
+  packed.Ids[slot] = entry->Id;
+  packed.Handles[slot] = entry->Handle;
+  packed.InexactCount += (int)inexact - (int)packed.Inexact[slot];
+  packed.Inexact[slot] = inexact;
+}
+
+// Packs an arbitrary entry list without touching the entries' PackedIdx.
+void PackedBuildFrom(ImGridPackedPositions &packed,
+                     const ImGridVector<ImGridEntry *> &entries) {
+  PackedResize(packed, entries.Size);
+  if (!packed.Inexact.empty())
+    memset(packed.Inexact.Data, 0, packed.Inexact.size_in_bytes());
+  packed.InexactCount = 0;
+  for (int i = 0; i < entries.Size; ++i)
+    PackedAssign(packed, i, entries[i]);
+  packed.Valid = true;
+}
+
+// Whether slot mirrors entry, see ImGridEntry::PackedIdx.
+inline bool PackedHolds(const ImGridPackedPositions &packed, int slot,
+                        const ImGridEntry *entry) {
+  return slot >= 0 && slot < packed.Size() && entry->Handle != 0 &&
+         packed.Handles[slot] == entry->Handle;
+}
+
+// Moves the last slot into slot, mirroring a swap-remove from ctx.Entries.
+// The caller updates the moved entry's PackedIdx.
+void PackedSwapRemove(ImGridPackedPositions &packed, int slot) {
+  const int last = packed.Size() - 1;
+  packed.InexactCount -= packed.Inexact[slot];
+  if (slot != last) {
+    packed.X[slot] = packed.X[last];
+    packed.Y[slot] = packed.Y[last];
+    packed.W[slot] = packed.W[last];
+    packed.H[slot] = packed.H[last];
+    packed.Ids[slot] = packed.Ids[last];
+    packed.Handles[slot] = packed.Handles[last];
+    packed.Inexact[slot] = packed.Inexact[last];
+  }
+  PackedResize(packed, last);
+}
+
+// Widens the pack region by the cells of p, see ImGridPackRegion.
+void PackRegionAdd(ImGridPackRegion &region, const ImGridPosition &p) {
+  GridSpaceRect cells;
+  if (GridPositionToCells(p, cells))
+    region.Add(cells);
+  else
+    region.Full = true;
+}
+
+// Widens the pack region by the cells entry is stamped into and the ones its
+// position covers now, before it gets restamped.
+void PackRegionRestamp(ImGridPackRegion &region, const ImGridEntry *entry) {
+  const GridSpaceRect &cells = entry->OccupiedCells;
+  if (cells.Max.x > cells.Min.x)
+    region.Add(cells);
+  else
+    region.Full = true;
+  PackRegionAdd(region, entry->Position);
+}
+
+// Below this many keys std::sort beats the radix passes.
+const int RadixSortThreshold = 2048;
+
+// (y, x) key of GridSortNodesInplace() for whole coordinates that fit in 16
+// bits. Unset (-1) coordinates sort last and upwards reverses the order.
+inline ImU32 GridSortKey(int y, int x, bool upwards) {
+  const int und = 10000;
+  const ImU32 key = ((ImU32)((y == -1 ? und : y) + 0x8000) << 16) |
+                    (ImU32)((x == -1 ? und : x) + 0x8000);
+  return upwards ? ~key : key;
+}
+
+inline bool GridSortKeyFits(float value) {
+  return value >= SHRT_MIN && value <= SHRT_MAX &&
+         value == static_cast<float>(static_cast<int>(value));
+}
+
+bool SortKeysInOrder(const ImGridVector<ImU64> &keys) {
+  for (int i = 1; i < keys.Size; ++i) {
+    if ((keys[i] >> 32) < (keys[i - 1] >> 32))
+      return false;
+  }
+  return true;
+}
+
+// Stable sort of (key << 32 | index) pairs by their key half. Small inputs go
+// through std::sort on the whole pair, where the index breaks ties, larger
+// ones through an LSD radix sort with one pass per key byte.
+void SortKeysStable(ImGridVector<ImU64> &keys, ImGridVector<ImU64> &scratch) {
+  const int count = keys.Size;
+  if (count < RadixSortThreshold) {
+    std::sort(keys.begin(), keys.end());
+    return;
+  }
+
+  scratch.resize(count);
+  ImU64 *src = keys.Data;
+  ImU64 *dst = scratch.Data;
+  for (int shift = 32; shift < 64; shift += 8) {
+    int offsets[256] = {};
+    for (int i = 0; i < count; ++i)
+      offsets[(src[i] >> shift) & 0xFF]++;
+    // every key shares this byte, the pass wouldn't move anything
+    if (offsets[(src[0] >> shift) & 0xFF] == count)
+      continue;
+    int sum = 0;
+    for (int b = 0; b < 256; ++b) {
+      const int n = offsets[b];
+      offsets[b] = sum;
+      sum += n;
+    }
+    for (int i = 0; i < count; ++i)
+      dst[offsets[(src[i] >> shift) & 0xFF]++] = src[i];
+    std::swap(src, dst);
+  }
+  if (src != keys.Data)
+    memcpy(keys.Data, src, (size_t)count * sizeof(ImU64));
+}
+
+// Refreshes the entries' EngineIdx after ctx.Entries was reordered.
+void ReindexEntries(ImGridEngine &ctx) {
+  for (int i = 0; i < ctx.Entries.Size; ++i)
+    ctx.Entries.Data[i]->EngineIdx = i;
+}
+
+inline bool SamePosition(const ImGridPosition &a, const ImGridPosition &b) {
+  return a.x == b.x && a.y == b.y && a.w == b.w && a.h == b.h;
+}
+
+// First key with this id among the sorted (id << 32 | snapshot index) keys
+// of a snapshot, keys.end() if none.
+const ImU64 *SnapshotFind(const ImGridVector<ImU64> &keys, int id) {
+  const ImU64 key = (ImU64)(ImU32)id << 32;
+  const ImU64 *it = std::lower_bound(keys.begin(), keys.end(), key);
+  return it != keys.end() && (*it >> 32) == (key >> 32) ? it : keys.end();
+}
+
+// Matches the entries of ctx to a snapshot of their ids and positions, into
+// matched (indexed like the snapshot). Fails if any entry was added, removed
+// or moved since. Leaves the snapshot's lookup keys in keys.
+bool SnapshotMatch(const ImGridEngine &ctx, const ImGridVector<int> &ids,
+                   const ImGridVector<ImGridPosition> &positions,
+                   ImGridVector<ImU64> &keys,
+                   ImGridVector<ImGridEntry *> &matched) {
+  if (ctx.Entries.Size != ids.Size)
+    return false;
+
+  keys.resize(0);
+  keys.reserve(ids.Size);
+  for (int i = 0; i < ids.Size; ++i)
+    keys.push_back((ImU64)(ImU32)ids[i] << 32 | (ImU32)i);
+  std::sort(keys.begin(), keys.end());
+
+  matched.resize(ids.Size);
+  for (ImGridEntry *&entry : matched)
+    entry = NULL;
+  for (ImGridEntry *entry : ctx.Entries) {
+    const ImU64 *it = SnapshotFind(keys, entry->Id);
+    // entries sharing an id are matched in order
+    while (it != keys.end() && (*it >> 32) == (ImU32)entry->Id &&
+           matched[(int)(*it & 0xFFFFFFFF)] != NULL)
+      ++it;
+    if (it == keys.end() || (*it >> 32) != (ImU32)entry->Id)
+      return false;
+    const int i = (int)(*it & 0xFFFFFFFF);
+    if (!SamePosition(entry->Position, positions[i]))
+      return false;
+    matched[i] = entry;
+  }
+  return true;
+}
+
+// Returns the packed mirror of ctx.Entries if collision queries can use it.
+// Outside of an occupancy scope positions may have been written without
+// telling the engine, so it's only trusted inside one.
+const ImGridPackedPositions *PackedForQuery(ImGridEngine &ctx) {
+  if (ctx.Occupancy.ScopeDepth == 0)
+    return NULL;
+  if (!ctx.Packed.Valid || ctx.Packed.Size() != ctx.Entries.Size)
+    ImGrid::Engine::GridPackedRebuild(ctx);
+  return ctx.Packed.InexactCount == 0 ? &ctx.Packed : NULL;
+}
+
+} // namespace
+
 namespace ImGrid::Engine {
 
+ImGridEntryHandle GridAcquireHandle(ImGridEngine &ctx, ImGridEntry *entry) {
+  if (entry->Handle != 0 && GridResolveEntry(ctx, entry->Handle) == entry)
+    return entry->Handle;
+
+  ImGridEntryTable &table = ctx.Handles;
+  int index;
+  if (table.FreeList.empty()) {
+    index = table.Entries.Size;
+    IM_ASSERT(static_cast<ImU32>(index) <= ImGridEntryTable::IndexMask);
+    table.Entries.push_back(NULL);
+    table.Generations.push_back(1);
+  } else {
+    index = table.FreeList.back();
+    table.FreeList.pop_back();
+  }
+  table.Entries[index] = entry;
+  entry->Handle = static_cast<ImU32>(index) |
+                  static_cast<ImU32>(table.Generations[index])
+                      << ImGridEntryTable::IndexBits;
+  return entry->Handle;
+}
+
+void GridReleaseHandle(ImGridEngine &ctx, ImGridEntry *entry) {
+  if (entry->Handle == 0 || GridResolveEntry(ctx, entry->Handle) != entry)
+    return;
+
+  ImGridEntryTable &table = ctx.Handles;
+  const int index =
+      static_cast<int>(entry->Handle & ImGridEntryTable::IndexMask);
+  const ImU32 generation =
+      (table.Generations[index] + 1u) & ImGridEntryTable::GenerationMask;
+  table.Generations[index] = static_cast<ImU16>(generation != 0 ? generation
+                                                                 : 1);
+  table.Entries[index] = NULL;
+  table.FreeList.push_back(index);
+  entry->Handle = 0;
+}
+
 bool GridFindEmptyPosition(ImGridEngine &ctx, ImGridEntry &entry, int column,
-                           ImVector<ImGridEntry *> &entries,
+                           ImGridVector<ImGridEntry *> &entries,
                            ImGridEntry *after) {
 
   int start = 0;
@@ -73,8 +747,44 @@ bool GridFindEmptyPosition(ImGridEngine &ctx, ImGridEntry &entry, int column,
     start =
         after->Position.y * column + (after->Position.x + after->Position.w);
 
+  // an unbounded grid always has room in the rows below the used ones
+  int max_row = ctx.MaxRow;
+  if (max_row <= 0) {
+    float used_row = 0;
+    for (ImGridEntry *other : entries)
+      used_row = IM_MAX(used_row, other->Position.y + other->Position.h);
+    max_row = static_cast<int>(std::ceil(used_row + entry.Position.h));
+  }
+
   bool found = false;
-  const int maxIterations = ctx.Column * ctx.MaxRow;
+  const int maxIterations = ctx.Column * max_row;
+  if (start >= maxIterations || entry.Position.w > column)
+    return false;
+
+  if (&entries == &ctx.Entries) {
+    GridOccupancyScope occupancy(ctx);
+    const int index =
+        OccupancyFirstFit(ctx, column, start, maxIterations, entry.Position);
+    if (index != -2) {
+      if (index == -1)
+        return false;
+      const int x = index % column;
+      const int y = index / column;
+      if (entry.Position.x != x || entry.Position.y != y)
+        entry.Dirty = true;
+      entry.Position.x = x;
+      entry.Position.y = y;
+      return true;
+    }
+  }
+
+  ImGridPackedPositions &packed = ctx.PackedScratch;
+  PackedBuildFrom(packed, entries);
+  ImS16 box_packed[4] = {0, 0, 0, 0};
+  const bool use_packed =
+      packed.InexactCount == 0 &&
+      GridPositionToPacked({0, 0, entry.Position.w, entry.Position.h},
+                           box_packed);
 
   for (int i = start; !found && i < maxIterations; ++i) {
     int x = i % column;
@@ -84,10 +794,17 @@ bool GridFindEmptyPosition(ImGridEngine &ctx, ImGridEntry &entry, int column,
     ImGridPosition box = {static_cast<float>(x), static_cast<float>(y),
                           entry.Position.w, entry.Position.h};
     bool intercepted = false;
-    for (int j = 0; j < entries.size(); ++j) {
-      if (GridPositionsAreIntercepted(box, entries[j]->Position)) {
-        intercepted = true;
-        break;
+    if (use_packed && PackedFits(x) && PackedFits(y) &&
+        PackedFits(x + box_packed[2]) && PackedFits(y + box_packed[3])) {
+      box_packed[0] = static_cast<ImS16>(x);
+      box_packed[1] = static_cast<ImS16>(y);
+      intercepted = GridPackedFindIntercept(packed, 0, box_packed) != -1;
+    } else {
+      for (int j = 0; j < entries.size(); ++j) {
+        if (GridPositionsAreIntercepted(box, entries[j]->Position)) {
+          intercepted = true;
+          break;
+        }
       }
     }
     if (!intercepted) {
@@ -114,9 +831,6 @@ int GridFindCacheLayout(ImGridEngine &ctx, ImGridEntry *node, int column) {
 
 void GridCacheOneLayout(ImGridEngine &ctx, ImGridEntry *entry, int column) {
 
-  if (!(entry->Position.x < 119 && entry->Position.y < 119)) {
-    IM_ASSERT(false);
-  }
   ImGridEntry wrapped = {
       ImGridPosition{entry->Position.x, entry->Position.y, entry->Position.w,
                      -1},
@@ -136,9 +850,6 @@ void GridCacheOneLayout(ImGridEngine &ctx, ImGridEntry *entry, int column) {
 }
 
 void GridNodeBoundFix(ImGridEngine &ctx, ImGridEntry *entry, bool resizing) {
-  if (!(entry->Position.x < 119 && entry->Position.y < 119)) {
-    IM_ASSERT(false);
-  }
   ImGridPosition pre = entry->PrevPosition;
   if (!pre.Valid()) {
     pre.x = entry->Position.x;
@@ -213,10 +924,6 @@ void GridResizeToContentCheck(ImGridEngine &ctx, bool delay,
 
 ImGridEntry *GridPrepareEntry(ImGridEngine &ctx, ImGridEntry *entry,
                               bool resizing) {
-  if (!(entry->Position.x < 119 && entry->Position.y < 119)) {
-    IM_ASSERT(false);
-  }
-
   if (entry->Position.h == -1 || entry->Position.w == -1)
     IM_ASSERT(false);
 
@@ -230,8 +937,8 @@ ImGridEntry *GridPrepareEntry(ImGridEngine &ctx, ImGridEntry *entry,
   return entry;
 }
 
-ImVector<ImGridEntry *> GridGetDirtyNodes(ImGridEngine &ctx) {
-  ImVector<ImGridEntry *> dirty_nodes;
+ImGridVector<ImGridEntry *> GridGetDirtyNodes(ImGridEngine &ctx) {
+  ImGridVector<ImGridEntry *> dirty_nodes;
   for (auto &entry : ctx.Entries) {
     if (entry->Dirty)
       dirty_nodes.push_back(entry);
@@ -240,49 +947,284 @@ ImVector<ImGridEntry *> GridGetDirtyNodes(ImGridEngine &ctx) {
 }
 
 void GridLayoutsNodesChanged(ImGridEngine &ctx,
-                             ImVector<ImGridEntry *> &nodes) {
+                             ImGridVector<ImGridEntry *> &nodes) {
   if (ctx.CacheLayouts.size() == 0 || ctx.InColumnResize)
     return;
 
-  for (auto &[column, layout] : ctx.CacheLayouts) {
-    if (layout.size() == 0 || column == ctx.Column)
+  for (auto it = ctx.CacheLayouts.begin(); it != ctx.CacheLayouts.end();) {
+    const int column = it->first;
+    ImGridVector<ImGridEntry> &layout = it->second;
+    if (layout.size() == 0 || column == ctx.Column) {
+      ++it;
       continue;
+    }
     if (column < ctx.Column) {
-      ctx.CacheLayouts.erase(column);
-    } else {
-      float ratio = column / static_cast<float>(ctx.Column);
-      for (auto &entry : layout) {
-        if (!entry.PrevPosition.Valid())
-          continue;
-        ImGridEntry *node = NULL;
-        for (auto &n : nodes) {
-          if (n->Id == entry.Id) {
-            node = n;
-            break;
-          }
-        }
-        if (node == NULL)
-          continue;
-        if (node->Position.y >= 0 && node->Position.y != node->PrevPosition.y) {
-          node->Position.y += (node->Position.y - node->PrevPosition.y);
-        }
-        if (node->Position.x != node->PrevPosition.x) {
-          node->Position.x = std::round(node->Position.x * ratio);
+      it = ctx.CacheLayouts.erase(it);
+      continue;
+    }
+    float ratio = column / static_cast<float>(ctx.Column);
+    for (auto &entry : layout) {
+      if (!entry.PrevPosition.Valid())
+        continue;
+      ImGridEntry *node = NULL;
+      for (auto &n : nodes) {
+        if (n->Id == entry.Id) {
+          node = n;
+          break;
         }
+      }
+      if (node == NULL)
+        continue;
+      if (node->Position.y >= 0 && node->Position.y != node->PrevPosition.y) {
+        node->Position.y += (node->Position.y - node->PrevPosition.y);
+      }
+      if (node->Position.x != node->PrevPosition.x) {
+        node->Position.x = std::round(node->Position.x * ratio);
+      }
 
-        if (node->Position.w != node->PrevPosition.w) {
-          node->Position.w = std::round(node->Position.w * ratio);
-        }
+      if (node->Position.w != node->PrevPosition.w) {
+        node->Position.w = std::round(node->Position.w * ratio);
       }
     }
+    ++it;
   }
 }
 
+void GridOccupancyClear(ImGridEngine &ctx) {
+  OccupancyReset(ctx.Occupancy, ctx.Column, 0);
+  GridPackedInvalidate(ctx);
+  ctx.PackRegion.Full = true;
+  ctx.SortedDirection = 0;
+}
+
+void GridOccupancyRebuild(ImGridEngine &ctx) {
+  int columns = ctx.Column;
+  int rows = 0;
+  for (auto &entry : ctx.Entries) {
+    GridSpaceRect cells;
+    if (GridPositionToCells(entry->Position, cells)) {
+      columns = IM_MAX(columns, cells.Max.x);
+      rows = IM_MAX(rows, cells.Max.y);
+    }
+  }
+
+  ImGridOccupancy &occ = ctx.Occupancy;
+  OccupancyReset(occ, columns, rows);
+  // whatever changed before the rebuild is lost
+  ctx.PackRegion.Full = true;
+  for (auto &entry : ctx.Entries) {
+    // the same entry may be listed more than once, only stamp it once
+    if (entry->OccupancyEpoch != occ.Epoch)
+      OccupancyAdd(occ, entry);
+  }
+}
+
+void GridOccupancyInvalidate(ImGridEngine &ctx) {
+  ctx.Occupancy.Valid = false;
+  GridPackedInvalidate(ctx);
+  ctx.PackRegion.Full = true;
+  ctx.SortedDirection = 0;
+}
+
+void GridOccupancySync(ImGridEngine &ctx) {
+  // repacked on demand by the first query that needs a linear scan
+  GridPackedInvalidate(ctx);
+  // and resorted, entries may have been added or moved since
+  ctx.SortedDirection = 0;
+
+  ImGridOccupancy &occ = ctx.Occupancy;
+  if (!occ.Valid || occ.Ambiguous > 0) {
+    GridOccupancyRebuild(ctx);
+    return;
+  }
+
+  // positions may have been written outside of the engine (e.g. sizes coming
+  // from the UI), so restamp anything that no longer matches
+  for (auto &entry : ctx.Entries) {
+    if (entry->OccupancyEpoch != occ.Epoch) {
+      PackRegionAdd(ctx.PackRegion, entry->Position);
+      OccupancyAdd(occ, entry);
+    } else if (OccupancyNeedsRestamp(entry)) {
+      PackRegionRestamp(ctx.PackRegion, entry);
+      OccupancyRemove(occ, entry);
+      OccupancyAdd(occ, entry);
+    }
+  }
+  if (!occ.Valid)
+    GridOccupancyRebuild(ctx);
+}
+
+void GridOccupancyInsert(ImGridEngine &ctx, ImGridEntry *entry) {
+  ctx.SortedDirection = 0;
+  ImGridPackedPositions &packed = ctx.Packed;
+  if (packed.Valid && packed.Size() + 1 == ctx.Entries.Size &&
+      ctx.Entries.back() == entry) {
+    const int slot = packed.Size();
+    PackedResize(packed, slot + 1);
+    packed.Inexact[slot] = 0;
+    PackedAssign(packed, slot, entry);
+    entry->PackedIdx = slot;
+  } else {
+    packed.Valid = false;
+  }
+
+  PackRegionAdd(ctx.PackRegion, entry->Position);
+  ImGridOccupancy &occ = ctx.Occupancy;
+  if (occ.Valid && entry->OccupancyEpoch != occ.Epoch)
+    OccupancyAdd(occ, entry);
+}
+
+void GridOccupancyUpdate(ImGridEngine &ctx, ImGridEntry *entry) {
+  ctx.SortedDirection = 0;
+  ImGridPackedPositions &packed = ctx.Packed;
+  const int slot = entry->PackedIdx;
+  if (packed.Valid && PackedHolds(packed, slot, entry))
+    PackedAssign(packed, slot, entry);
+
+  ImGridOccupancy &occ = ctx.Occupancy;
+  // entries that aren't stamped yet (or temporaries) are picked up by the
+  // next sync
+  if (!occ.Valid || entry->OccupancyEpoch != occ.Epoch ||
+      !OccupancyNeedsRestamp(entry))
+    return;
+  PackRegionRestamp(ctx.PackRegion, entry);
+  OccupancyRemove(occ, entry);
+  OccupancyAdd(occ, entry);
+}
+
+void GridOccupancyBegin(ImGridEngine &ctx) {
+  if (ctx.Occupancy.ScopeDepth++ == 0)
+    GridOccupancySync(ctx);
+}
+
+void GridOccupancyEnd(ImGridEngine &ctx) {
+  IM_ASSERT(ctx.Occupancy.ScopeDepth > 0);
+  ctx.Occupancy.ScopeDepth--;
+}
+
+void GridPackedRebuild(ImGridEngine &ctx) {
+  // entries listed behind the engine's back (the UI, solver snapshots) get
+  // their handle here
+  for (ImGridEntry *entry : ctx.Entries)
+    GridAcquireHandle(ctx, entry);
+  ImGridPackedPositions &packed = ctx.Packed;
+  PackedBuildFrom(packed, ctx.Entries);
+  for (int i = 0; i < ctx.Entries.Size; ++i) {
+    // an entry listed twice can only track one slot, keep the float path
+    ImGridEntry *entry = ctx.Entries[i];
+    const int prev = entry->PackedIdx;
+    if (prev < i && PackedHolds(packed, prev, entry))
+      PackedAssign(packed, i, entry, true);
+    else
+      entry->PackedIdx = i;
+  }
+}
+
+void GridPackedInvalidate(ImGridEngine &ctx) { ctx.Packed.Valid = false; }
+
+ImU32 GridPackedInterceptMaskScalar(const ImGridPackedPositions &packed,
+                                    int start, const ImS16 area[4],
+                                    int skip_id, int skip2_id) {
+  const int ax = area[0], ay = area[1];
+  const int ax2 = ax + area[2], ay2 = ay + area[3];
+  const ImS16 *xs = packed.X.Data;
+  const ImS16 *ys = packed.Y.Data;
+  const ImS16 *ws = packed.W.Data;
+  const ImS16 *hs = packed.H.Data;
+  const int *ids = packed.Ids.Data;
+  const int count = IM_MIN(packed.Size() - start, IMGRID_PACKED_BATCH);
+  ImU32 mask = 0;
+  for (int lane = 0; lane < count; ++lane) {
+    const int i = start + lane;
+    // same test as GridPositionsAreIntercepted, without short-circuiting so
+    // the compiler can keep it branch free
+    const bool hit = (ay < ys[i] + hs[i]) & (ay2 > ys[i]) &
+                     (ax2 > xs[i]) & (ax < xs[i] + ws[i]) &
+                     (ids[i] != skip_id) & (ids[i] != skip2_id);
+    mask |= (ImU32)hit << lane;
+  }
+  return mask;
+}
+
+ImU32 GridPackedInterceptMask(const ImGridPackedPositions &packed, int start,
+                              const ImS16 area[4], int skip_id, int skip2_id) {
+  // the vector loads need a full batch, the tail goes through the scalar path
+  if (packed.Size() - start < IMGRID_PACKED_BATCH)
+    return GridPackedInterceptMaskScalar(packed, start, area, skip_id,
+                                         skip2_id);
+#if defined(IMGRID_ENABLE_AVX2)
+  return PackedInterceptMask16(packed, start, area, skip_id, skip2_id);
+#elif defined(IMGRID_ENABLE_SSE2)
+  return PackedInterceptMask8(packed, start, area, skip_id, skip2_id) |
+         PackedInterceptMask8(packed, start + 8, area, skip_id, skip2_id)
+             << 8;
+#else
+  return GridPackedInterceptMaskScalar(packed, start, area, skip_id, skip2_id);
+#endif
+}
+
+const char *GridPackedKernelName() {
+#if defined(IMGRID_ENABLE_AVX2)
+  return "avx2";
+#elif defined(IMGRID_ENABLE_SSE2)
+  return "sse2";
+#else
+  return "scalar";
+#endif
+}
+
+int GridPackedFindIntercept(const ImGridPackedPositions &packed, int start,
+                            const ImS16 area[4], int skip_id, int skip2_id) {
+  for (int i = start; i < packed.Size(); i += IMGRID_PACKED_BATCH) {
+    const ImU32 mask =
+        GridPackedInterceptMask(packed, i, area, skip_id, skip2_id);
+    if (mask != 0)
+      return i + PackedLowestBit(mask);
+  }
+  return -1;
+}
+
 ImGridEntry *GridCollide(ImGridEngine &ctx, ImGridEntry *skip,
                          ImGridPosition area, ImGridEntry *skip2) {
   const auto skip_id = skip->Id;
   const auto skip2_id = skip2 == NULL ? -1 : skip2->Id;
+  IMGRID_STATS_ADD(ctx.Stats, CollideCalls, 1);
+
+  GridSpaceRect cells;
+  if (OccupancyQueryCells(ctx, area, cells)) {
+    const ImGridOccupancy &occ = ctx.Occupancy;
+    bool ambiguous = false;
+    for (int y = cells.Min.y; y < cells.Max.y; ++y) {
+      for (int x = cells.Min.x; x < cells.Max.x; ++x) {
+        IMGRID_STATS_ADD(ctx.Stats, EntriesScanned, 1);
+        const int idx = y * occ.Columns + x;
+        if (occ.Counts[idx] == 0)
+          continue;
+        ImGridEntry *owner = occ.Owners[idx];
+        if (owner != NULL && owner->Id != skip_id && owner->Id != skip2_id &&
+            GridPositionsAreIntercepted(owner->Position, area))
+          return owner;
+        // another (unknown) entry shares this cell
+        if (owner == NULL || occ.Counts[idx] > 1)
+          ambiguous = true;
+      }
+    }
+    if (!ambiguous)
+      return NULL;
+  }
+
+  ImS16 area_packed[4];
+  const ImGridPackedPositions *packed = PackedForQuery(ctx);
+  if (packed != NULL && GridPositionToPacked(area, area_packed)) {
+    const int slot =
+        GridPackedFindIntercept(*packed, 0, area_packed, skip_id, skip2_id);
+    IMGRID_STATS_ADD(ctx.Stats, EntriesScanned,
+                     slot == -1 ? packed->Size() : slot + 1);
+    return slot == -1 ? NULL : GridResolveEntry(ctx, packed->Handles[slot]);
+  }
+
   for (const auto &entry : ctx.Entries) {
+    IMGRID_STATS_ADD(ctx.Stats, EntriesScanned, 1);
     if (entry->Id != skip_id && entry->Id != skip2_id &&
         GridPositionsAreIntercepted(entry->Position, area))
       return entry;
@@ -290,14 +1232,57 @@ ImGridEntry *GridCollide(ImGridEngine &ctx, ImGridEntry *skip,
   return NULL;
 }
 
-ImVector<ImGridEntry *> GridCollideAll(ImGridEngine &ctx, ImGridEntry *skip,
-                                       ImGridPosition area,
-                                       ImGridEntry *skip2) {
-  ImVector<ImGridEntry *> collided;
+ImGridVector<ImGridEntry *> GridCollideAll(ImGridEngine &ctx, ImGridEntry *skip,
+                                           ImGridPosition area,
+                                           ImGridEntry *skip2) {
+  ImGridVector<ImGridEntry *> collided;
   IM_ASSERT(skip != NULL);
   const auto skip_id = skip->Id;
   const auto skip2_id = skip2 == NULL ? -1 : skip2->Id;
+  IMGRID_STATS_ADD(ctx.Stats, CollideCalls, 1);
+
+  GridSpaceRect cells;
+  if (OccupancyQueryCells(ctx, area, cells)) {
+    const ImGridOccupancy &occ = ctx.Occupancy;
+    bool ambiguous = false;
+    for (int y = cells.Min.y; y < cells.Max.y && !ambiguous; ++y) {
+      for (int x = cells.Min.x; x < cells.Max.x; ++x) {
+        IMGRID_STATS_ADD(ctx.Stats, EntriesScanned, 1);
+        const int idx = y * occ.Columns + x;
+        if (occ.Counts[idx] == 0)
+          continue;
+        ImGridEntry *owner = occ.Owners[idx];
+        if (owner == NULL || occ.Counts[idx] > 1) {
+          ambiguous = true;
+          break;
+        }
+        if (owner->Id != skip_id && owner->Id != skip2_id &&
+            !collided.contains(owner) &&
+            GridPositionsAreIntercepted(owner->Position, area))
+          collided.push_back(owner);
+      }
+    }
+    if (!ambiguous)
+      return collided;
+    collided.clear();
+  }
+
+  ImS16 area_packed[4];
+  const ImGridPackedPositions *packed = PackedForQuery(ctx);
+  if (packed != NULL && GridPositionToPacked(area, area_packed)) {
+    IMGRID_STATS_ADD(ctx.Stats, EntriesScanned, packed->Size());
+    for (int i = 0; i < packed->Size(); i += IMGRID_PACKED_BATCH) {
+      ImU32 mask =
+          GridPackedInterceptMask(*packed, i, area_packed, skip_id, skip2_id);
+      for (; mask != 0; mask &= mask - 1)
+        collided.push_back(GridResolveEntry(
+            ctx, packed->Handles[i + PackedLowestBit(mask)]));
+    }
+    return collided;
+  }
+
   for (const auto &entry : ctx.Entries) {
+    IMGRID_STATS_ADD(ctx.Stats, EntriesScanned, 1);
     if (entry->Id != skip_id && entry->Id != skip2_id &&
         GridPositionsAreIntercepted(entry->Position, area))
       collided.push_back(entry);
@@ -305,23 +1290,107 @@ ImVector<ImGridEntry *> GridCollideAll(ImGridEngine &ctx, ImGridEntry *skip,
   return collided;
 }
 
-void GridSortNodesInplace(ImVector<ImGridEntry *> &nodes, bool upwards) {
-  int direction = upwards ? -1 : 1;
-  int und = 10000;
+void GridSortEntriesInplace(ImGridEngine &ctx, bool upwards) {
+  const int direction = upwards ? -1 : 1;
+  // outside of a scope positions may have been written behind our back
+  if (ctx.Occupancy.ScopeDepth > 0 && ctx.SortedDirection == direction)
+    return;
+
+  const ImGridPackedPositions *packed = PackedForQuery(ctx);
+  if (packed == NULL) {
+    GridSortNodesInplace(ctx.Entries, upwards);
+    ReindexEntries(ctx);
+    GridPackedInvalidate(ctx);
+    ctx.SortedDirection = direction;
+    return;
+  }
 
-  std::sort(nodes.begin(), nodes.end(), [&](ImGridEntry *a, ImGridEntry *b) {
-    auto diffY = direction * ((a->Position.y == -1 ? und : a->Position.y) -
-                              (b->Position.y == -1 ? und : b->Position.y));
-    if (diffY == 0)
-      return direction * ((a->Position.x == -1 ? und : a->Position.x) -
-                          (b->Position.x == -1 ? und : b->Position.x));
-    return diffY;
-  });
+  // same keys as GridSortNodesInplace, read from the packed arrays instead of
+  // dereferencing every entry
+  const int count = packed->Size();
+  const ImS16 *xs = packed->X.Data;
+  const ImS16 *ys = packed->Y.Data;
+  ImGridVector<ImU64> &keys = ctx.SortScratch;
+  keys.resize(count);
+  for (int i = 0; i < count; ++i)
+    keys[i] = ((ImU64)GridSortKey(ys[i], xs[i], upwards) << 32) | (ImU32)i;
+  ctx.SortedDirection = direction;
+  if (SortKeysInOrder(keys))
+    return;
+  SortKeysStable(keys, ctx.RadixScratch);
+
+  ImGridPackedPositions &src = ctx.Packed;
+  ImGridPackedPositions &dst = ctx.PackedScratch;
+  PackedResize(dst, count);
+  for (int i = 0; i < count; ++i) {
+    const int slot = (int)(ImU32)keys[i];
+    dst.X[i] = src.X[slot];
+    dst.Y[i] = src.Y[slot];
+    dst.W[i] = src.W[slot];
+    dst.H[i] = src.H[slot];
+    dst.Ids[i] = src.Ids[slot];
+    dst.Handles[i] = src.Handles[slot];
+    dst.Inexact[i] = src.Inexact[slot];
+    ImGridEntry *entry = GridResolveEntry(ctx, dst.Handles[i]);
+    entry->PackedIdx = i;
+    entry->EngineIdx = i;
+    ctx.Entries[i] = entry;
+  }
+  dst.InexactCount = src.InexactCount;
+  dst.Valid = true;
+  src.X.swap(dst.X);
+  src.Y.swap(dst.Y);
+  src.W.swap(dst.W);
+  src.H.swap(dst.H);
+  src.Ids.swap(dst.Ids);
+  src.Handles.swap(dst.Handles);
+  src.Inexact.swap(dst.Inexact);
 }
 
-inline ImVector<ImGridEntry *> GridSortNodes(ImVector<ImGridEntry *> nodes,
-                                             bool upwards) {
-  ImVector<ImGridEntry *> sorted_nodes = nodes;
+void GridSortNodesInplace(ImGridVector<ImGridEntry *> &nodes, bool upwards) {
+  ImGridVector<ImU64> keys;
+  keys.resize(nodes.Size);
+  for (int i = 0; i < nodes.Size; ++i) {
+    const ImGridPosition &p = nodes[i]->Position;
+    if (!GridSortKeyFits(p.x) || !GridSortKeyFits(p.y)) {
+      keys.clear();
+      break;
+    }
+    keys[i] = ((ImU64)GridSortKey((int)p.y, (int)p.x, upwards) << 32) |
+              (ImU32)i;
+  }
+
+  if (keys.Size != nodes.Size) {
+    // fractional positions, compare the floats
+    const float direction = upwards ? -1.0f : 1.0f;
+    const float und = 10000;
+    auto less = [&](ImGridEntry *a, ImGridEntry *b) {
+      const float ay = a->Position.y == -1 ? und : a->Position.y;
+      const float by = b->Position.y == -1 ? und : b->Position.y;
+      if (ay != by)
+        return direction * (ay - by) < 0;
+      const float ax = a->Position.x == -1 ? und : a->Position.x;
+      const float bx = b->Position.x == -1 ? und : b->Position.x;
+      return direction * (ax - bx) < 0;
+    };
+    std::stable_sort(nodes.begin(), nodes.end(), less);
+    return;
+  }
+
+  if (SortKeysInOrder(keys))
+    return;
+  ImGridVector<ImU64> scratch;
+  SortKeysStable(keys, scratch);
+  ImGridVector<ImGridEntry *> sorted;
+  sorted.resize(nodes.Size);
+  for (int i = 0; i < nodes.Size; ++i)
+    sorted[i] = nodes[(int)(ImU32)keys[i]];
+  nodes.swap(sorted);
+}
+
+inline ImGridVector<ImGridEntry *>
+GridSortNodes(ImGridVector<ImGridEntry *> nodes, bool upwards) {
+  ImGridVector<ImGridEntry *> sorted_nodes = nodes;
   GridSortNodesInplace(sorted_nodes, upwards);
   return sorted_nodes;
 }
@@ -332,9 +1401,12 @@ void GridTriggerChangeEvent(ImGridEngine &ctx) {
 
   auto dirty_nodes = GridGetDirtyNodes(ctx);
   if (dirty_nodes.size() > 0) {
+    ctx.Precomputed.Stale = true;
     if (!ctx.IgnoreLayoutsNodeChange) {
       GridLayoutsNodesChanged(ctx, dirty_nodes);
     }
+    if (ctx.ChangeCallback != NULL)
+      ctx.ChangeCallback(ctx, dirty_nodes);
   }
   GridSaveInitial(ctx);
 }
@@ -343,68 +1415,267 @@ void GridTriggerAddEvent(ImGridEngine &ctx) {
   if (ctx.BatchMode)
     return;
 
-  if (ctx.AddedEntries.size() > 0) {
+  // entries released since they were added are skipped
+  ImGridVector<ImGridEntry *> &added = ctx.EventEntries;
+  added.resize(0);
+  for (ImGridEntryHandle handle : ctx.AddedEntries) {
+    if (ImGridEntry *entry = GridResolveEntry(ctx, handle))
+      added.push_back(entry);
+  }
+
+  if (added.size() > 0) {
     if (!ctx.IgnoreLayoutsNodeChange) {
-      GridLayoutsNodesChanged(ctx, ctx.AddedEntries);
+      GridLayoutsNodesChanged(ctx, added);
+    }
+    if (ctx.ChangeCallback != NULL)
+      ctx.ChangeCallback(ctx, added);
+  }
+
+  for (auto &entry : added) {
+    entry->Dirty = false;
+  }
+  ctx.AddedEntries.resize(0);
+}
+
+void GridTriggerRemoveEvent(ImGridEngine &ctx) {
+  if (ctx.BatchMode)
+    return;
+
+  ImGridVector<ImGridEntry *> &removed = ctx.EventEntries;
+  removed.resize(0);
+  for (ImGridEntryHandle handle : ctx.RemovedEntries) {
+    if (ImGridEntry *entry = GridResolveEntry(ctx, handle))
+      removed.push_back(entry);
+  }
+  ctx.RemovedEntries.resize(0);
+
+  if (removed.size() > 0 && ctx.RemoveCallback != NULL)
+    ctx.RemoveCallback(ctx, removed);
+}
+
+void GridPackEntries(ImGridEngine &ctx) {
+  if (ctx.BatchMode)
+    return;
+  IMGRID_PROFILE_ZONE("GridPackEntries");
+
+  GridOccupancyScope occupancy(ctx);
+  if (ctx.Float) {
+    // the region is left for the next top gravity pack
+    GridSortEntriesInplace(ctx, true);
+    for (auto &entry : ctx.Entries) {
+      if (entry->Updating || !entry->PrevPosition.Valid() ||
+          entry->Position.y == entry->PrevPosition.y)
+        continue;
+
+      auto newY = entry->Position.y;
+      while (newY > entry->PrevPosition.y) {
+        IMGRID_STATS_ADD(ctx.Stats, PackIterations, 1);
+        --newY;
+        auto *collided = GridCollide(
+            ctx, entry,
+            {entry->Position.x, newY, entry->Position.w, entry->Position.h},
+            NULL);
+        if (collided == NULL) {
+          GridJournalRecord(ctx, entry);
+          entry->Dirty = true;
+          entry->Position.y = newY;
+          GridOccupancyUpdate(ctx, entry);
+        }
+      }
+    }
+    return;
+  }
+
+  // top grav pack
+  const ImGridPackRegion region = ctx.PackRegion;
+  if (region.Full)
+    GridPackColumns(ctx, INT_MIN, INT_MAX, INT_MIN, INT_MAX);
+  else if (!region.Empty())
+    GridPackColumns(ctx, region.MinX, region.MaxX, region.MinY, region.MaxY);
+  // the entries that rose only widened the region, the grid is packed now
+  ctx.PackRegion.Reset(false);
+}
+
+namespace {
+
+// GridPackColumns() on the packed mirror: the entries from row min_y down are
+// walked in (y, x) order and each one in the column span rises straight to
+// the first free row of the per-column height profile. Returns false without
+// moving anything if a position is negative.
+bool PackColumnsSkyline(ImGridEngine &ctx, const ImGridPackedPositions &packed,
+                        int min_x, int max_x, int min_y) {
+  const int count = packed.Size();
+  const ImS16 *xs = packed.X.Data;
+  const ImS16 *ys = packed.Y.Data;
+  const ImS16 *ws = packed.W.Data;
+  const ImS16 *hs = packed.H.Data;
+  int columns = ctx.Column;
+  ImGridVector<ImU64> &keys = ctx.SortScratch;
+  keys.resize(0);
+  for (int i = 0; i < count; ++i) {
+    if (xs[i] < 0 || ys[i] < 0)
+      return false;
+    columns = IM_MAX(columns, xs[i] + ws[i]);
+    if (ys[i] >= min_y) {
+      const ImU32 key = ((ImU32)ys[i] << 16) | (ImU32)xs[i];
+      keys.push_back(((ImU64)key << 32) | (ImU32)i);
+    }
+  }
+  SortKeysStable(keys, ctx.RadixScratch);
+
+  // first free row of each column, under the entries seen so far
+  ImGridVector<int> &profile = ctx.PackProfile;
+  profile.resize(columns);
+  memset(profile.Data, 0, profile.size_in_bytes());
+  for (int i = 0; i < count; ++i) {
+    if (ys[i] >= min_y)
+      continue;
+    const int bottom = ys[i] + hs[i];
+    for (int x = xs[i]; x < xs[i] + ws[i]; ++x)
+      profile[x] = IM_MAX(profile[x], bottom);
+  }
+
+  for (const ImU64 key : keys) {
+    const int i = (int)(ImU32)key;
+    ImGridEntry *entry =
+        ImGrid::Engine::GridResolveEntry(ctx, packed.Handles[i]);
+    IMGRID_STATS_ADD(ctx.Stats, PackIterations, 1);
+    const int x0 = xs[i];
+    const int x1 = xs[i] + ws[i];
+    if (!entry->Locked && x0 < max_x && x1 > min_x) {
+      int top = 0;
+      for (int x = x0; x < x1; ++x)
+        top = IM_MAX(top, profile[x]);
+      if (top < ys[i]) {
+        ImGrid::Engine::GridJournalRecord(ctx, entry);
+        entry->Dirty = true;
+        entry->Position.y = (float)top;
+        // also refreshes ys[i]
+        ImGrid::Engine::GridOccupancyUpdate(ctx, entry);
+        min_x = IM_MIN(min_x, x0);
+        max_x = IM_MAX(max_x, x1);
+      }
+    }
+    const int bottom = ys[i] + hs[i];
+    for (int x = x0; x < x1; ++x)
+      profile[x] = IM_MAX(profile[x], bottom);
+  }
+  return true;
+}
+
+// GridPackColumns() for a region, on the occupancy index. Rather than walking
+// every entry below min_y, it follows the columns whose height profile may
+// differ from the packed grid's: an entry under such a column rises to the
+// lowest row all of its columns are free up to, which marks its columns, or
+// stays and, past the changed rows, unmarks them since nothing under it can
+// rise either. The walk ends once no column is marked. Returns false without
+// moving anything if the index can't answer, i.e. some entry isn't stamped or
+// a cell's owner isn't known.
+bool PackColumnsOccupancy(ImGridEngine &ctx, int min_x, int max_x, int min_y,
+                          int max_y) {
+  const ImGridOccupancy &occ = ctx.Occupancy;
+  if (!occ.Valid || occ.Unindexed > 0 || occ.Ambiguous > 0 ||
+      occ.Overlapped > 0)
+    return false;
+  const int columns = occ.Columns;
+  ImGridVector<int> &marked = ctx.PackProfile;
+  marked.resize(columns);
+  memset(marked.Data, 0, marked.size_in_bytes());
+  int marked_count = 0;
+  for (int x = IM_MAX(min_x, 0); x < IM_MIN(max_x, columns); ++x) {
+    marked[x] = 1;
+    marked_count++;
+  }
+
+  ImGridVector<ImGridEntry *> &row_entries = ctx.PackScratch;
+  for (int y = IM_MAX(min_y, 0); y < occ.Rows && marked_count > 0; ++y) {
+    // the entries starting on this row under a marked column, in x order
+    row_entries.resize(0);
+    for (int x = 0; x < columns; ++x) {
+      ImGridEntry *owner = occ.Owners[y * columns + x];
+      if (marked[x] && owner != NULL && owner->OccupiedCells.Min.y == y &&
+          (row_entries.empty() || row_entries.back() != owner))
+        row_entries.push_back(owner);
+    }
+
+    for (ImGridEntry *entry : row_entries) {
+      IMGRID_STATS_ADD(ctx.Stats, PackIterations, 1);
+      const GridSpaceRect cells = entry->OccupiedCells;
+      int top = y;
+      if (!entry->Locked) {
+        top = 0;
+        for (int x = cells.Min.x; x < cells.Max.x && top < y; ++x) {
+          int row = y;
+          while (row > top && occ.Counts[(row - 1) * columns + x] == 0)
+            --row;
+          top = IM_MAX(top, row);
+        }
+      }
+      if (top < y) {
+        ImGrid::Engine::GridJournalRecord(ctx, entry);
+        entry->Dirty = true;
+        entry->Position.y = (float)top;
+        ImGrid::Engine::GridOccupancyUpdate(ctx, entry);
+      }
+      const int mark = top < y || y < max_y ? 1 : 0;
+      for (int x = cells.Min.x; x < cells.Max.x; ++x) {
+        marked_count += mark - marked[x];
+        marked[x] = mark;
+      }
     }
   }
+  return true;
+}
+
+// GridPackColumns() for positions the packed mirror can't hold, stepping each
+// entry up one row at a time while nothing collides.
+void PackColumnsStepwise(ImGridEngine &ctx, int min_x, int max_x, int min_y) {
+  ImGridVector<ImGridEntry *> &below = ctx.PackScratch;
+  below.resize(0);
+  for (ImGridEntry *entry : ctx.Entries) {
+    if (entry->Position.y >= min_y)
+      below.push_back(entry);
+  }
+  ImGrid::Engine::GridSortNodesInplace(below, false);
 
-  for (auto &entry : ctx.AddedEntries) {
-    entry->Dirty = false;
+  for (ImGridEntry *entry : below) {
+    ImGridPosition &p = entry->Position;
+    if (entry->Locked || p.x >= max_x || p.x + p.w <= min_x)
+      continue;
+    const float start_y = p.y;
+    IMGRID_STATS_ADD(ctx.Stats, PackIterations, 1);
+    while (p.y > 0 && ImGrid::Engine::GridCollide(
+                          ctx, entry, {p.x, p.y - 1, p.w, p.h}, NULL) == NULL) {
+      IMGRID_STATS_ADD(ctx.Stats, PackIterations, 1);
+      ImGrid::Engine::GridJournalRecord(ctx, entry);
+      entry->Dirty = true;
+      p.y -= 1;
+      ImGrid::Engine::GridOccupancyUpdate(ctx, entry);
+    }
+    if (p.y != start_y) {
+      min_x = IM_MIN(min_x, (int)std::floor(p.x));
+      max_x = IM_MAX(max_x, (int)std::ceil(p.x + p.w));
+    }
   }
 }
 
-void GridTriggerRemoveEvent(ImGridEngine &ctx) {
-  if (ctx.BatchMode)
-    return;
-}
+} // namespace
 
-void GridPackEntries(ImGridEngine &ctx) {
-  if (ctx.BatchMode)
+void GridPackColumns(ImGridEngine &ctx, int min_x, int max_x, int min_y,
+                     int max_y) {
+  if (ctx.BatchMode || ctx.Float)
     return;
 
-  GridSortNodesInplace(ctx.Entries, true);
-
-  if (ctx.Float) {
-    for (auto &entry : ctx.Entries) {
-      if (entry->Updating || !entry->PrevPosition.Valid() ||
-          entry->Position.y == entry->PrevPosition.y)
-        continue;
-
-      auto newY = entry->Position.y;
-      while (newY > entry->PrevPosition.y) {
-        --newY;
-        auto *collided = GridCollide(
-            ctx, entry,
-            {entry->Position.x, newY, entry->Position.w, entry->Position.h},
-            NULL);
-        if (collided == NULL) {
-          entry->Dirty = true;
-          entry->Position.y = newY;
-        }
-      }
-    }
-  } else {
-    // top grav pack
-    int index = 0;
-    for (auto &entry : ctx.Entries) {
-      if (entry->Locked)
-        continue;
-      while (entry->Position.y > 0) {
-        auto newY = (index == 0) ? 0 : entry->Position.y - 1;
-        const bool can_be_moved =
-            (index == 0) || GridCollide(ctx, entry,
-                                        {entry->Position.x, newY,
-                                         entry->Position.w, entry->Position.h},
-                                        NULL) == NULL;
-        if (!can_be_moved)
-          break;
-        entry->Dirty = (entry->Position.y != newY);
-        entry->Position.y = newY;
-      }
-      index++;
-    }
-  }
+  // Walking down row by row, an entry can only rise if it's under columns
+  // that were freed, either by the region or by an entry above it that rose.
+  GridOccupancyScope occupancy(ctx);
+  const ImGridPackedPositions *packed = PackedForQuery(ctx);
+  if (packed != NULL && min_y != INT_MIN &&
+      PackColumnsOccupancy(ctx, min_x, max_x, min_y, max_y))
+    return;
+  if (packed == NULL ||
+      !PackColumnsSkyline(ctx, *packed, min_x, max_x, min_y))
+    PackColumnsStepwise(ctx, min_x, max_x, min_y);
 }
 
 ImGridEntry *GridCopyPosition(ImGridEntry *a, ImGridEntry *b,
@@ -487,13 +1758,9 @@ ImGridEntry *GridCopyPositionToOpts(ImGridEntry *b, ImGridMoveOptions *a,
   return b;
 }
 
-ImGridEntry *GridDirectionCollideCoverage(ImGridEntry *entry,
-                                          ImGridMoveOptions &opts,
-                                          ImVector<ImGridEntry *> &collides) {
-
-  if (!(entry->Position.x < 119 && entry->Position.y < 119)) {
-    IM_ASSERT(false);
-  }
+ImGridEntry *
+GridDirectionCollideCoverage(ImGridEntry *entry, ImGridMoveOptions &opts,
+                             ImGridVector<ImGridEntry *> &collides) {
 
   if (!entry->Rect || !opts.Rect)
     return NULL;
@@ -542,16 +1809,13 @@ ImGridEntry *GridDirectionCollideCoverage(ImGridEntry *entry,
     }
   }
 
-  opts.Collide = collide;
+  opts.Collide = collide != NULL ? collide->Handle : 0;
   return collide;
 }
 
 bool GridUseEntireRowArea(ImGridEngine &ctx, ImGridEntry *entry,
                           ImGridPosition new_position) {
 
-  if (!(entry->Position.x < 119 && entry->Position.y < 119)) {
-    IM_ASSERT(false);
-  }
   return (!ctx.Float || (ctx.BatchMode && !ctx.PrevFloat)) && !ctx.HasLocked &&
          (!entry->Moving || !entry->SkipDown ||
           new_position.y <= entry->Position.y);
@@ -562,10 +1826,6 @@ bool GridMoveNode(ImGridEngine &ctx, ImGridEntry *entry,
   if (entry == NULL)
     return false;
 
-  if (!(entry->Position.x < 119 && entry->Position.y < 119)) {
-    IM_ASSERT(false);
-  }
-
   // might be wrong...
   // bool was_undefined_pack;
 
@@ -583,11 +1843,16 @@ bool GridMoveNode(ImGridEngine &ctx, ImGridEntry *entry,
   if (!opts.ForceCollide && entry->Position == opts.Position)
     return false;
 
+  GridOccupancyScope occupancy(ctx);
   ImGridPosition prev_pos = entry->Position;
-  opts.Skip = NULL;
-
-  ImVector<ImGridEntry *> collided =
-      GridCollideAll(ctx, entry, new_node.Position, opts.Skip);
+  opts.Skip = 0;
+  // GridFixCollisions() recurses back in here for the entries pushed aside
+  IMGRID_STATS_ADD(ctx.Stats, MoveNodeDepth, 1);
+  IMGRID_STATS_MAX(ctx.Stats, MaxMoveNodeDepth, ctx.Stats.MoveNodeDepth);
+
+  ImGridVector<ImGridEntry *> collided =
+      GridCollideAll(ctx, entry, new_node.Position,
+                     GridResolveEntry(ctx, opts.Skip));
   bool need_to_move = true;
   if (collided.size() > 0) {
     bool active_drag = entry->Moving && !opts.Nested;
@@ -614,40 +1879,60 @@ bool GridMoveNode(ImGridEngine &ctx, ImGridEntry *entry,
   }
 
   if (need_to_move) {
+    GridJournalRecord(ctx, entry);
     entry->Dirty = true;
     GridCopyPosition(entry, &new_node);
+    GridOccupancyUpdate(ctx, entry);
   }
 
   if (opts.Pack) {
     GridPackEntries(ctx);
   }
 
-  return entry->Position == prev_pos;
+  IMGRID_STATS_ADD(ctx.Stats, MoveNodeDepth, -1);
+  return !(entry->Position == prev_pos);
 }
 
 bool GridFixCollisions(ImGridEngine &ctx, ImGridEntry *entry,
                        ImGridPosition new_position, // = entry->Position,
                        ImGridEntry *collide, ImGridMoveOptions opts) {
+  IMGRID_PROFILE_ZONE("GridFixCollisions");
+
+  GridOccupancyScope occupancy(ctx);
+  ImGridEntry *skip = GridResolveEntry(ctx, opts.Skip);
+  // While loading nothing depends on the order of ctx.Entries until the next
+  // pack sorts it, so the occupancy index can answer the common no collision
+  // case without sorting first.
+  if (ctx.Loading && collide == NULL &&
+      GridCollide(ctx, entry, new_position, NULL) == NULL)
+    return false;
+  GridSortEntriesInplace(ctx, true);
 
-  if (!(entry->Position.x < 119 && entry->Position.y < 119)) {
-    IM_ASSERT(false);
-  }
-  GridSortNodesInplace(ctx.Entries, true);
-
+  // the first collision in sorted order is the one to resolve
   collide =
       collide == NULL ? GridCollide(ctx, entry, new_position, NULL) : collide;
   if (collide == NULL)
     return false;
 
   if (entry->Moving && !opts.Nested && !ctx.Float) {
-    if (SwapEntryPositions(*entry, *collide))
+    GridJournalRecord(ctx, entry);
+    GridJournalRecord(ctx, collide);
+    if (SwapEntryPositions(*entry, *collide)) {
+      GridOccupancyUpdate(ctx, entry);
+      GridOccupancyUpdate(ctx, collide);
       return true;
+    }
   }
 
-  ImGridPosition area = new_position;
+  // follows new_position as the entry is moved below its collisions, unless
+  // the whole row is searched
+  const ImGridPosition *area = &new_position;
+  ImGridPosition row_area;
   if (!ctx.Loading && GridUseEntireRowArea(ctx, entry, new_position)) {
-    area = {0, new_position.y, static_cast<float>(ctx.Column), new_position.h};
-    collide = GridCollide(ctx, entry, area, opts.Skip);
+    row_area = {0, new_position.y, static_cast<float>(ctx.Column),
+                new_position.h};
+    area = &row_area;
+    collide = GridCollide(ctx, entry, *area, skip);
   }
 
   bool did_move = false;
@@ -656,7 +1941,7 @@ bool GridFixCollisions(ImGridEngine &ctx, ImGridEntry *entry,
   new_opts.Pack = false;
 
   while (collide != NULL ||
-         (collide = GridCollide(ctx, entry, area, opts.Skip))) {
+         (collide = GridCollide(ctx, entry, *area, skip))) {
     bool moved = false;
 
     if (collide->Locked || ctx.Loading ||
@@ -671,6 +1956,7 @@ bool GridFixCollisions(ImGridEngine &ctx, ImGridEntry *entry,
                         new_position.y - collide->Position.h,
                         collide->Position.w, collide->Position.h},
                        entry) == NULL)))) {
+      GridJournalRecord(ctx, entry);
       entry->SkipDown = entry->SkipDown || new_position.y > entry->Position.y;
       ImGridMoveOptions opt = new_opts;
       opt.Position = {new_position.x, collide->Position.y + collide->Position.h,
@@ -681,14 +1967,16 @@ bool GridFixCollisions(ImGridEngine &ctx, ImGridEntry *entry,
       } else if (!collide->Locked && moved && opts.Pack) {
         GridPackEntries(ctx);
         new_position.y = collide->Position.y + collide->Position.h;
+        GridJournalRecord(ctx, entry);
         entry->Position = new_position;
+        GridOccupancyUpdate(ctx, entry);
       }
       did_move = did_move || moved;
     } else {
       ImGridMoveOptions opt = new_opts;
       opt.Position = {collide->Position.x, new_position.y + new_position.h,
                       collide->Position.w, collide->Position.h};
-      opt.Skip = entry;
+      opt.Skip = entry->Handle;
       moved = GridMoveNode(ctx, collide, opt);
     }
 
@@ -703,24 +1991,29 @@ bool GridFixCollisions(ImGridEngine &ctx, ImGridEntry *entry,
 ImGridEntry *GridAddNode(ImGridEngine &ctx, ImGridEntry *entry,
                          bool trigger_add_event, ImGridEntry *after) {
 
-  if (!(entry->Position.x < 119 && entry->Position.y < 119)) {
-    IM_ASSERT(false);
-  }
-  // determine if we have already added this node?
-
   ctx.InColumnResize ? (void)GridNodeBoundFix(ctx, entry)
                      : (void)GridPrepareEntry(ctx, entry);
 
+  // the UI may have listed it already after placing it with GridFindSpace();
+  // searching again would find it in its own way
+  const bool listed = GridEntryIndex(ctx, entry) >= 0;
   bool skip_collision = false;
-  if (entry->AutoPosition &&
+  if (entry->AutoPosition && !listed &&
       GridFindEmptyPosition(ctx, *entry, ctx.Column, ctx.Entries, after)) {
     entry->AutoPosition = false;
     skip_collision = true;
   }
 
-  ctx.Entries.push_back(entry);
+  if (!listed) {
+    entry->EngineIdx = ctx.Entries.Size;
+    ctx.Entries.push_back(entry);
+    ctx.Precomputed.Stale = true;
+  }
+  // before the packed mirror copies it
+  GridAcquireHandle(ctx, entry);
+  GridOccupancyInsert(ctx, entry);
   if (trigger_add_event)
-    ctx.AddedEntries.push_back(entry);
+    ctx.AddedEntries.push_back(entry->Handle);
 
   if (!skip_collision)
     GridFixCollisions(ctx, entry, entry->Position);
@@ -731,28 +2024,37 @@ ImGridEntry *GridAddNode(ImGridEngine &ctx, ImGridEntry *entry,
 
 void GridRemoveEntry(ImGridEngine &ctx, ImGridEntry *entry,
                      bool trigger_event) {
-
-  if (!(entry->Position.x < 119 && entry->Position.y < 119)) {
-    IM_ASSERT(false);
-  }
-  bool found = false;
-  for (int i = 0; i < ctx.Entries.size(); i++) {
-    if (ctx.Entries[i]->Id == entry->Id)
-      found = true;
-  }
-
-  if (!found)
+  const int idx = GridEntryIndex(ctx, entry);
+  if (idx < 0)
     return;
 
   if (trigger_event)
-    ctx.RemovedEntries.push_back(entry);
-
-  // TODO:
-  //  don't use 'faster' .splice(findIndex(),1) in case node isn't in our
-  //  list, or in multiple times.
-  // this.nodes = this.nodes.filter(n => n._id !== node._id);
-  // if (!node._isAboutToRemove) this._packNodes(); // if dragged out, no
-  // need to relayout as already done... this._notify([node]);
+    ctx.RemovedEntries.push_back(entry->Handle);
+  ctx.Precomputed.Stale = true;
+
+  ImGridOccupancy &occ = ctx.Occupancy;
+  if (occ.Valid && entry->OccupancyEpoch == occ.Epoch)
+    OccupancyRemove(occ, entry);
+
+  // swap-remove, the order of ctx.Entries only matters after a sort
+  ctx.SortedDirection = 0;
+  ImGridPackedPositions &packed = ctx.Packed;
+  ImGridEntry *last = ctx.Entries.back();
+  if (packed.Valid && packed.Size() == ctx.Entries.Size &&
+      PackedHolds(packed, idx, entry)) {
+    PackedSwapRemove(packed, idx);
+    last->PackedIdx = idx;
+  } else {
+    packed.Valid = false;
+  }
+  ctx.Entries[idx] = last;
+  last->EngineIdx = idx;
+  ctx.Entries.pop_back();
+  entry->EngineIdx = -1;
+  entry->PackedIdx = -1;
+
+  PackRegionAdd(ctx.PackRegion, entry->Position);
+  GridPackEntries(ctx);
 }
 
 /*
@@ -808,43 +2110,77 @@ bool GridEntryMoveCheck(ImGridEngine &ctx, ImGridEntry *entry,
   if (ctx.MaxRow <= 0)
     return GridMoveNode(ctx, entry, opts);
 
-  ImGridEntry *cloned_node = NULL;
-  ImVector<ImGridEntry *> cloned_nodes;
-  for (auto &node : ctx.Entries) {
-    if (node->Id == entry->Id)
-      cloned_node = node;
-
-    cloned_nodes.push_back(node);
+  // try the move in place on an unbounded grid and undo it if it would grow
+  // past MaxRow
+  GridOccupancyScope occupancy(ctx);
+  const int prev_row = GridGetRow(ctx);
+  const ImGridPosition prev_pos = entry->Position;
+  GridBeginSpeculativeMove(ctx);
+  GridMoveNode(ctx, entry, opts);
+  const bool can_move =
+      !(entry->Position == prev_pos) &&
+      GridGetRow(ctx) <= IM_MAX(prev_row, ctx.Journal.SavedMaxRow);
+  if (can_move) {
+    GridCommitMove(ctx);
+    return true;
   }
-  ImGridEngine dev_grid = ImGridEngine();
-  dev_grid.Column = ctx.Column;
-  dev_grid.MaxRow = 0;
-  dev_grid.Entries = cloned_nodes;
-  dev_grid.Float = ctx.Float;
-  if (cloned_node == NULL)
-    return false;
+  GridRollbackMove(ctx);
 
-  bool can_move = GridMoveNode(dev_grid, cloned_node, opts) &&
-                  GridGetRow(dev_grid) <= IM_MAX(GridGetRow(ctx), ctx.MaxRow);
-  if (!can_move && !opts.Resizing && opts.Collide != NULL) {
+  ImGridEntry *collide = GridResolveEntry(ctx, opts.Collide);
+  if (!opts.Resizing && collide != NULL) {
     // TODO: check
-    if (SwapEntryPositions(*entry, *opts.Collide))
+    if (SwapEntryPositions(*entry, *collide)) {
+      GridOccupancyUpdate(ctx, entry);
+      GridOccupancyUpdate(ctx, collide);
       return true;
+    }
   }
-  if (!can_move)
-    return false;
+  return false;
+}
 
-  for (auto &node : dev_grid.Entries) {
-    if (node->Dirty) {
-      for (auto &n : ctx.Entries) {
-        if (n->Id == node->Id) {
-          GridCopyPosition(n, node);
-          n->Dirty = true;
-        }
-      }
-    }
+void GridBeginSpeculativeMove(ImGridEngine &ctx) {
+  ImGridMoveJournal &journal = ctx.Journal;
+  IM_ASSERT(!journal.Active && "speculative moves don't nest");
+  journal.Records.resize(0);
+  journal.Epoch = ++GJournalEpochCounter;
+  journal.SavedMaxRow = ctx.MaxRow;
+  journal.SavedPackRegion = ctx.PackRegion;
+  journal.Active = true;
+  ctx.MaxRow = 0;
+}
+
+void GridCommitMove(ImGridEngine &ctx) {
+  ImGridMoveJournal &journal = ctx.Journal;
+  IM_ASSERT(journal.Active);
+  ctx.MaxRow = journal.SavedMaxRow;
+  journal.Records.resize(0);
+  journal.Active = false;
+}
+
+void GridRollbackMove(ImGridEngine &ctx) {
+  ImGridMoveJournal &journal = ctx.Journal;
+  IM_ASSERT(journal.Active);
+  ctx.MaxRow = journal.SavedMaxRow;
+  journal.Active = false;
+  for (int i = journal.Records.Size - 1; i >= 0; --i) {
+    const ImGridMoveRecord &record = journal.Records[i];
+    record.Entry->Position = record.Position;
+    record.Entry->LastTried = record.LastTried;
+    record.Entry->Dirty = record.Dirty;
+    record.Entry->SkipDown = record.SkipDown;
+    GridOccupancyUpdate(ctx, record.Entry);
   }
-  return true;
+  journal.Records.resize(0);
+  ctx.PackRegion.Add(journal.SavedPackRegion);
+}
+
+void GridJournalRecord(ImGridEngine &ctx, ImGridEntry *entry) {
+  ImGridMoveJournal &journal = ctx.Journal;
+  if (!journal.Active || entry->JournalEpoch == journal.Epoch)
+    return;
+  entry->JournalEpoch = journal.Epoch;
+  journal.Records.push_back({entry, entry->Position, entry->LastTried,
+                            entry->Dirty, entry->SkipDown});
 }
 
 void GridCleanNodes(ImGridEngine &ctx) {
@@ -883,9 +2219,9 @@ void GridBatchUpdate(ImGridEngine &ctx, bool flag, bool do_pack) {
   }
 }
 
-void GridCacheLayout(ImGridEngine &ctx, ImVector<ImGridEntry *> nodes,
+void GridCacheLayout(ImGridEngine &ctx, ImGridVector<ImGridEntry *> nodes,
                      int column, bool clear) {
-  ImVector<ImGridEntry> entries;
+  ImGridVector<ImGridEntry> entries;
   for (int i = 0; i < nodes.size(); ++i) {
     auto &node = nodes[i];
     // TODO: this is gross as we are only overwriting the h
@@ -898,32 +2234,67 @@ void GridCacheLayout(ImGridEngine &ctx, ImVector<ImGridEntry *> nodes,
         },
     });
   }
-  if (clear)
+  if (clear) {
     ctx.Entries.clear();
+    GridOccupancyClear(ctx);
+  }
   ctx.CacheLayouts[column] = entries;
 }
 
 void GridFindSpace(ImGridEngine &ctx, ImGridEntry *entry,
-                   ImVector<ImGridEntry *> &node_list, int column,
+                   ImGridVector<ImGridEntry *> &node_list, int column,
                    ImGridEntry *after) {
-  (void)ctx;
   float start = after != NULL ? after->Position.y * column +
                                     (after->Position.x + after->Position.w)
                               : 0;
+  if (entry->Position.w > column)
+    return;
+
+  if (&node_list == &ctx.Entries) {
+    GridOccupancyScope occupancy(ctx);
+    const int index = OccupancyFirstFit(ctx, column, static_cast<int>(start),
+                                        INT_MAX, entry->Position);
+    if (index >= 0) {
+      const int x = index % column;
+      const int y = index / column;
+      if (entry->Position.x != x || entry->Position.y != y)
+        entry->Dirty = true;
+      entry->Position.x = x;
+      entry->Position.y = y;
+      entry->AutoPosition = false;
+      return;
+    }
+  }
+
+  ImGridPackedPositions &packed = ctx.PackedScratch;
+  PackedBuildFrom(packed, node_list);
+  ImS16 area_packed[4] = {0, 0, 0, 0};
+  const bool use_packed =
+      packed.InexactCount == 0 &&
+      GridPositionToPacked({0, 0, entry->Position.w, entry->Position.h},
+                           area_packed);
+
   bool found = false;
   for (int i = start; !found; ++i) {
     int x = i % column;
-    int y = IM_FLOOR(i / column);
+    int y = i / column;
     if (x + entry->Position.w > column)
       continue;
 
     ImGridPosition area = {static_cast<float>(x), static_cast<float>(y),
                            entry->Position.w, entry->Position.h};
     bool any_collision = false;
-    for (auto &node : node_list) {
-      if (GridPositionsAreIntercepted(node->Position, area)) {
-        any_collision = true;
-        break;
+    if (use_packed && PackedFits(x) && PackedFits(y) &&
+        PackedFits(x + area_packed[2]) && PackedFits(y + area_packed[3])) {
+      area_packed[0] = static_cast<ImS16>(x);
+      area_packed[1] = static_cast<ImS16>(y);
+      any_collision = GridPackedFindIntercept(packed, 0, area_packed) != -1;
+    } else {
+      for (auto &node : node_list) {
+        if (GridPositionsAreIntercepted(node->Position, area)) {
+          any_collision = true;
+          break;
+        }
       }
     }
     if (!any_collision) {
@@ -941,8 +2312,10 @@ void GridCompact(ImGridEngine &ctx, ImGridColumnFlags opts, bool do_sort) {
   if (ctx.Entries.size() == 0)
     return;
 
-  if (do_sort)
+  if (do_sort) {
     GridSortNodesInplace(ctx.Entries, true);
+    ReindexEntries(ctx);
+  }
 
   const auto was_batch = ctx.BatchMode;
   if (!was_batch)
@@ -952,10 +2325,11 @@ void GridCompact(ImGridEngine &ctx, ImGridColumnFlags opts, bool do_sort) {
   if (was_column_resize)
     ctx.InColumnResize = true;
 
-  ImVector<ImGridEntry *> new_entries = ctx.Entries; // copy
+  ImGridVector<ImGridEntry *> new_entries = ctx.Entries; // copy
   ctx.Entries.clear();
+  GridOccupancyClear(ctx);
 
-  for (int i = 0; i < new_entries.size(); ++i) {
+  for (int i = 0; i < new_entries.size() && !GridSolveCancelled(ctx); ++i) {
     auto *n = new_entries[i];
     ImGridEntry *after = NULL;
 
@@ -976,6 +2350,59 @@ void GridCompact(ImGridEngine &ctx, ImGridColumnFlags opts, bool do_sort) {
     GridBatchUpdate(ctx, false, false);
 }
 
+namespace {
+
+// Lays the entries out as GridPrecomputeLayouts() solved column, if it did
+// with the same flags, from where the entries are now.
+bool GridApplyPrecomputedLayout(ImGridEngine &ctx, int previous_column,
+                                int column, ImGridColumnFlags flags) {
+  const ImGridPrecomputedLayouts &pre = ctx.Precomputed;
+  const int idx = pre.Columns.find_index(column);
+  if (pre.FromColumn != previous_column || idx < 0 || pre.Flags[idx] != flags ||
+      pre.Ids.Size != ctx.Entries.Size)
+    return false;
+
+  ImGridVector<ImU64> keys;
+  ImGridVector<ImGridEntry *> &matched = ctx.PackScratch;
+  if (!SnapshotMatch(ctx, pre.Ids, pre.Positions, keys, matched))
+    return false;
+  const int count = pre.Ids.Size;
+  const ImGridEntry *layout = pre.Layouts.Data + idx * count;
+  ImGridVector<ImGridEntry *> ordered;
+  ordered.reserve(count);
+  for (int i = 0; i < count; ++i) {
+    const ImGridEntry &cache_node = layout[i];
+    const ImU64 *it = SnapshotFind(keys, cache_node.Id);
+    const ImGridPosition &pos = cache_node.Position;
+    if (it == keys.end() || pos.x < 0 || pos.y < 0 || pos.w < 1 || pos.h < 1)
+      return false;
+    ImGridEntry *&entry = matched[(int)(*it & 0xFFFFFFFF)];
+    if (entry == NULL)
+      return false;
+    ordered.push_back(entry);
+    entry = NULL;
+  }
+
+  if (column < previous_column)
+    GridCacheLayout(ctx, ctx.Entries, previous_column);
+  ctx.HasLocked = false;
+  for (int i = 0; i < count; ++i) {
+    ImGridEntry *entry = ordered[i];
+    entry->Dirty = !SamePosition(entry->Position, layout[i].Position);
+    entry->Position = layout[i].Position;
+    entry->AutoPosition = layout[i].AutoPosition;
+    entry->PrevPosition.Reset();
+    entry->LastTried.Reset();
+    ctx.HasLocked |= entry->Locked;
+    ctx.Entries[i] = entry;
+  }
+  ReindexEntries(ctx);
+  GridOccupancyInvalidate(ctx);
+  return true;
+}
+
+} // namespace
+
 void GridColumnChanged(ImGridEngine &ctx, int previous_column, int column,
                        ImGridColumnOptions opts) {
   if (ctx.Entries.size() == 0 || previous_column == column)
@@ -983,26 +2410,39 @@ void GridColumnChanged(ImGridEngine &ctx, int previous_column, int column,
 
   if (opts.Flags == ImGridColumnFlags_None)
     return;
+  IMGRID_PROFILE_ZONE("GridColumnChanged");
+
+  if (!opts.Func &&
+      GridApplyPrecomputedLayout(ctx, previous_column, column, opts.Flags))
+    return;
 
   bool compact = opts.Flags & ImGridColumnFlags_Compact ||
                  opts.Flags & ImGridColumnFlags_List;
-  if (compact)
+  if (compact) {
     GridSortNodesInplace(ctx.Entries, true);
+    ReindexEntries(ctx);
+  }
 
   if (column < previous_column)
     GridCacheLayout(ctx, ctx.Entries, previous_column);
   GridBatchUpdate(ctx);
 
-  ImVector<ImGridEntry *> new_entries;
-  ImVector<ImGridEntry *> ordered_entries =
+  ImGridVector<ImGridEntry *> new_entries;
+  ImGridVector<ImGridEntry *> ordered_entries =
       compact ? ctx.Entries : GridSortNodes(ctx.Entries, false);
-  if (column > previous_column) {
-    int last_index = ctx.CacheLayouts.size() - 1;
-    ImVector<ImGridEntry> &cache_nodes = ctx.CacheLayouts[last_index];
+  if (column > previous_column && ctx.CacheLayouts.size() > 0) {
+    // the layout cached for this column count, else start from the widest
+    const auto cached = ctx.CacheLayouts.find(column);
+    ImGridVector<ImGridEntry> no_cache_nodes;
+    ImGridVector<ImGridEntry> &cache_nodes =
+        cached != ctx.CacheLayouts.end() ? cached->second : no_cache_nodes;
+    const int last_index = ctx.CacheLayouts.rbegin()->first;
+    ImGridVector<ImGridEntry> &last_nodes = ctx.CacheLayouts.rbegin()->second;
     if (!(cache_nodes.size() > 0) && previous_column != last_index &&
-        ctx.CacheLayouts[last_index].size() > 0) {
-      previous_column = last_index;
-      for (auto &entry_wrapper : cache_nodes) {
+        last_nodes.size() > 0) {
+      // scale from the widest layout, if it restored any of the entries
+      bool restored = false;
+      for (auto &entry_wrapper : last_nodes) {
         // find the matching entry in ordered_entries
         ImGridEntry *inner_entry = NULL;
         for (int node_ind = 0;
@@ -1017,8 +2457,11 @@ void GridColumnChanged(ImGridEngine &ctx, int previous_column, int column,
             inner_entry->Position.y = entry_wrapper.Position.y;
           }
           inner_entry->Position.w = entry_wrapper.Position.w;
+          restored = true;
         }
       }
+      if (restored)
+        previous_column = last_index;
     }
 
     // new
@@ -1028,8 +2471,10 @@ void GridColumnChanged(ImGridEngine &ctx, int previous_column, int column,
       for (int node_ind = 0;
            node_ind < ordered_entries.size() && inner_entry == NULL;
            ++node_ind) {
-        if (ordered_entries[node_ind]->Id == cache_node.Id)
+        if (ordered_entries[node_ind]->Id == cache_node.Id) {
           inner_entry = ordered_entries[node_ind];
+          found_index = node_ind;
+        }
       }
       if (inner_entry != NULL) {
         if (compact) {
@@ -1059,6 +2504,10 @@ void GridColumnChanged(ImGridEngine &ctx, int previous_column, int column,
     if (ordered_entries.size() > 0) {
       if (opts.Func != NULL) {
         opts.Func(column, previous_column, new_entries, ordered_entries);
+        // it gets copies of the lists, the entries stay where it put them
+        for (ImGridEntry *entry : ordered_entries)
+          new_entries.push_back(entry);
+        ordered_entries.clear();
       } else {
         float ratio = compact ? 1 : column / previous_column;
         bool move = (opts.Flags & ImGridColumnFlags_Move) ||
@@ -1083,7 +2532,8 @@ void GridColumnChanged(ImGridEngine &ctx, int previous_column, int column,
     GridSortNodesInplace(new_entries, false);
     ctx.InColumnResize = true;
     ctx.Entries.clear();
-    for (int i = 0; i < new_entries.size(); ++i) {
+    GridOccupancyClear(ctx);
+    for (int i = 0; i < new_entries.size() && !GridSolveCancelled(ctx); ++i) {
       GridAddNode(ctx, new_entries[i], false);
       new_entries[i]->PrevPosition.Reset();
     }
@@ -1115,3 +2565,617 @@ void GridEndUpdate(ImGridEngine &ctx) {
 }
 
 } // namespace ImGrid::Engine
+
+// Section [Async]
+
+// One background solve: the request, the snapshot the worker lays out in
+// place and the order it left the entries in. There are two, so a finished
+// solve can wait to be committed while the worker fills the other.
+struct ImGridSolveBuffer {
+  int Generation;
+  int PreviousColumn;
+  int Column;
+  ImGridColumnOptions ColumnOptions;
+  ImGridOptions EngineOptions;
+  bool Float;
+  bool HasLocked;
+  int MaxRow;
+
+  ImGridVector<ImGridEntry> Entries;
+  ImGridVector<int> Ids;
+  ImGridVector<ImGridPosition> Input; // positions when the snapshot was taken
+  ImGridVector<int> Order; // solved Entries order, as snapshot indices
+  std::map<int, ImGridVector<ImGridEntry>> CacheLayouts;
+  ImGridPrecomputedLayouts Precomputed;
+
+  ImGridSolveBuffer()
+      : Generation(0), PreviousColumn(0), Column(0),
+        ColumnOptions(ImGridColumnFlags_MoveScale), Float(false),
+        HasLocked(false), MaxRow(0) {}
+};
+
+struct ImGridAsyncSolve {
+  std::thread Worker;
+  std::mutex Mutex;
+  std::condition_variable Wake; // a buffer was queued, or Quit
+  std::condition_variable Idle; // the worker finished a buffer
+  // Cancellation token. Every request and cancel bumps it, a solve started
+  // under an older generation is dropped.
+  std::atomic<int> Generation;
+  ImGridSolveBuffer Buffers[2];
+  int Queued;    // buffer waiting for the worker, -1 if none
+  int Solving;   // buffer the worker is on, -1 if none
+  int Published; // finished buffer waiting to be committed, -1 if none
+  bool Quit;
+
+  // the request, kept to solve it again from a fresh snapshot
+  bool Requested;
+  bool Cancelled;
+  int PreviousColumn;
+  int Column;
+  ImGridColumnOptions ColumnOptions;
+
+  ImGridAsyncSolve()
+      : Generation(0), Queued(-1), Solving(-1), Published(-1), Quit(false),
+        Requested(false), Cancelled(false), PreviousColumn(0), Column(0),
+        ColumnOptions(ImGridColumnFlags_MoveScale) {}
+};
+
+// GridPrecomputeLayouts() solves on this many threads at most, its own
+// included
+static const int PrecomputeMaxThreads = 8;
+
+// Threads started by the first GridPrecomputeLayouts() and parked between
+// calls. A job is a list of buffers; the calling thread posts it, takes
+// buffers alongside the workers until none is left, closes it and waits for
+// the workers that joined. Closed jobs take no new workers, so none of them
+// can pick up a buffer after the call returned.
+struct ImGridSolvePool {
+  std::thread Workers[PrecomputeMaxThreads - 1];
+  int WorkerCount;
+  std::mutex Mutex;
+  std::condition_variable Wake; // a job was posted, or Quit
+  std::condition_variable Done; // a worker left the job
+  bool Quit;
+
+  ImGridSolveBuffer *const *Buffers;
+  int BufferCount;
+  std::atomic<int> Next; // next buffer to take
+  int Job;               // bumped for every posted job
+  bool Open;             // workers may still join the job
+  int Busy;              // workers in the job
+
+  ImGridSolvePool()
+      : WorkerCount(0), Quit(false), Buffers(NULL), BufferCount(0), Next(0),
+        Job(0), Open(false), Busy(0) {}
+};
+
+ImGridEngine::~ImGridEngine() {
+  if (SolvePool != NULL) {
+    {
+      std::lock_guard<std::mutex> lock(SolvePool->Mutex);
+      SolvePool->Quit = true;
+    }
+    SolvePool->Wake.notify_all();
+    for (int i = 0; i < SolvePool->WorkerCount; ++i)
+      SolvePool->Workers[i].join();
+    delete SolvePool;
+  }
+  if (Async == NULL)
+    return;
+  Async->Generation++; // the solve in flight gives up early
+  {
+    std::lock_guard<std::mutex> lock(Async->Mutex);
+    Async->Quit = true;
+  }
+  Async->Wake.notify_all();
+  if (Async->Worker.joinable())
+    Async->Worker.join();
+  delete Async;
+}
+
+namespace ImGrid::Engine {
+
+namespace {
+
+// Lays the snapshot out on an engine of its own. Returns false if the solve
+// was cancelled.
+bool AsyncSolveBuffer(ImGridSolveBuffer &buffer,
+                      const std::atomic<int> &generation) {
+  if (generation.load() != buffer.Generation)
+    return false;
+
+  ImGridEngine solver;
+  solver.Options = buffer.EngineOptions;
+  solver.Column = buffer.Column;
+  solver.Float = solver.PrevFloat = buffer.Float;
+  solver.HasLocked = buffer.HasLocked;
+  solver.MaxRow = buffer.MaxRow;
+  solver.CacheLayouts.swap(buffer.CacheLayouts);
+  solver.Precomputed = buffer.Precomputed;
+  solver.CancelGeneration = &generation;
+  solver.SolveGeneration = buffer.Generation;
+  solver.Entries.reserve(buffer.Entries.Size);
+  for (ImGridEntry &entry : buffer.Entries) {
+    entry.ParentContext = &solver;
+    entry.EngineIdx = solver.Entries.Size;
+    solver.Entries.push_back(&entry);
+  }
+
+  GridColumnChanged(solver, buffer.PreviousColumn, buffer.Column,
+                    buffer.ColumnOptions);
+  buffer.CacheLayouts.swap(solver.CacheLayouts);
+  if (GridSolveCancelled(solver))
+    return false;
+
+  buffer.Order.resize(solver.Entries.Size);
+  for (int i = 0; i < solver.Entries.Size; ++i)
+    buffer.Order[i] = static_cast<int>(solver.Entries[i] - buffer.Entries.Data);
+  return true;
+}
+
+// Copies the engine state a solve reads into buffer.
+void SolveSnapshot(const ImGridEngine &ctx, ImGridSolveBuffer &buffer) {
+  buffer.EngineOptions = ctx.Options;
+  buffer.EngineOptions.InitialEntries.clear();
+  buffer.Float = ctx.Float;
+  buffer.HasLocked = ctx.HasLocked;
+  buffer.MaxRow = ctx.MaxRow;
+  buffer.CacheLayouts = ctx.CacheLayouts;
+  buffer.Precomputed = ctx.Precomputed;
+  buffer.Entries.resize(0);
+  buffer.Ids.resize(0);
+  buffer.Input.resize(0);
+  buffer.Entries.reserve(ctx.Entries.Size);
+  buffer.Ids.reserve(ctx.Entries.Size);
+  buffer.Input.reserve(ctx.Entries.Size);
+  for (const ImGridEntry *entry : ctx.Entries) {
+    buffer.Entries.push_back(*entry);
+    buffer.Ids.push_back(entry->Id);
+    buffer.Input.push_back(entry->Position);
+    // drop the bookkeeping that belongs to ctx
+    ImGridEntry &copy = buffer.Entries.back();
+    copy.OccupancyEpoch = 0;
+    copy.OccupiedCells = GridSpaceRect();
+    copy.PackedIdx = -1;
+    copy.JournalEpoch = 0;
+    copy.Handle = 0;
+  }
+}
+
+void AsyncSolveRun(ImGridAsyncSolve &async) {
+  std::unique_lock<std::mutex> lock(async.Mutex);
+  for (;;) {
+    async.Wake.wait(lock, [&] { return async.Quit || async.Queued != -1; });
+    if (async.Quit)
+      return;
+    const int idx = async.Solving = async.Queued;
+    async.Queued = -1;
+    lock.unlock();
+
+    ImGridSolveBuffer &buffer = async.Buffers[idx];
+    const bool solved = AsyncSolveBuffer(buffer, async.Generation);
+
+    lock.lock();
+    async.Solving = -1;
+    if (solved && buffer.Generation == async.Generation.load())
+      async.Published = idx;
+    async.Idle.notify_all();
+  }
+}
+
+// Snapshots the entries and queues the stored request for the worker, into
+// the buffer it isn't working on. Anything queued or published before is
+// stale from here on.
+void AsyncSolveSubmit(ImGridEngine &ctx) {
+  ImGridAsyncSolve &async = *ctx.Async;
+  const int generation = ++async.Generation;
+  async.Cancelled = false;
+
+  int idx;
+  {
+    std::lock_guard<std::mutex> lock(async.Mutex);
+    idx = async.Solving == 0 ? 1 : 0;
+    async.Queued = -1;
+    async.Published = -1;
+  }
+
+  // the worker only touches the buffer it was handed
+  ImGridSolveBuffer &buffer = async.Buffers[idx];
+  SolveSnapshot(ctx, buffer);
+  buffer.Generation = generation;
+  buffer.PreviousColumn = async.PreviousColumn;
+  buffer.Column = async.Column;
+  buffer.ColumnOptions = async.ColumnOptions;
+
+  {
+    std::lock_guard<std::mutex> lock(async.Mutex);
+    if (!async.Worker.joinable())
+      async.Worker = std::thread(AsyncSolveRun, std::ref(async));
+    async.Queued = idx;
+  }
+  async.Wake.notify_one();
+}
+
+} // namespace
+
+void GridColumnChangedAsync(ImGridEngine &ctx, int previous_column, int column,
+                            ImGridColumnOptions opts) {
+  if (ctx.Async == NULL)
+    ctx.Async = new ImGridAsyncSolve();
+  ImGridAsyncSolve &async = *ctx.Async;
+  if (column == previous_column) {
+    // back to the layout the entries are in, whatever is in flight is stale
+    if (async.Requested) {
+      async.Requested = false;
+      async.Generation++;
+      std::lock_guard<std::mutex> lock(async.Mutex);
+      async.Queued = -1;
+      async.Published = -1;
+    }
+    return;
+  }
+  if (async.Requested && !async.Cancelled &&
+      async.PreviousColumn == previous_column && async.Column == column &&
+      async.ColumnOptions.Flags == opts.Flags && !opts.Func &&
+      !async.ColumnOptions.Func)
+    return;
+
+  async.Requested = true;
+  async.PreviousColumn = previous_column;
+  async.Column = column;
+  async.ColumnOptions = opts;
+  AsyncSolveSubmit(ctx);
+}
+
+bool GridAsyncSolvePoll(ImGridEngine &ctx) {
+  if (!GridAsyncSolvePending(ctx) || ctx.Journal.Active)
+    return false;
+
+  ImGridAsyncSolve &async = *ctx.Async;
+  int idx;
+  {
+    std::lock_guard<std::mutex> lock(async.Mutex);
+    idx = async.Published;
+    async.Published = -1;
+  }
+  if (idx == -1) {
+    if (async.Cancelled)
+      AsyncSolveSubmit(ctx);
+    return false;
+  }
+
+  ImGridSolveBuffer &buffer = async.Buffers[idx];
+  ImGridVector<ImU64> keys;
+  ImGridVector<ImGridEntry *> &matched = ctx.PackScratch;
+  if (buffer.Generation != async.Generation.load() ||
+      buffer.Order.Size != buffer.Entries.Size ||
+      !SnapshotMatch(ctx, buffer.Ids, buffer.Input, keys, matched)) {
+    // solved from a layout that is gone
+    AsyncSolveSubmit(ctx);
+    return false;
+  }
+
+  for (int i = 0; i < buffer.Order.Size; ++i) {
+    const int snapshot_idx = buffer.Order[i];
+    const ImGridEntry &solved = buffer.Entries[snapshot_idx];
+    ImGridEntry *entry = matched[snapshot_idx];
+    if (!SamePosition(entry->Position, solved.Position)) {
+      entry->Position = solved.Position;
+      entry->Dirty = true;
+    }
+    entry->AutoPosition = solved.AutoPosition;
+    entry->PrevPosition.Reset();
+    ctx.Entries[i] = entry;
+  }
+  ReindexEntries(ctx);
+  GridOccupancyInvalidate(ctx);
+  ctx.Column = ctx.Options.Column.Columns = async.Column;
+  ctx.CacheLayouts.swap(buffer.CacheLayouts);
+  async.Requested = false;
+  return true;
+}
+
+void GridCancelAsyncSolve(ImGridEngine &ctx) {
+  if (!GridAsyncSolvePending(ctx) || ctx.Async->Cancelled)
+    return;
+  ctx.Async->Cancelled = true;
+  ctx.Async->Generation++;
+}
+
+bool GridAsyncSolvePending(const ImGridEngine &ctx) {
+  return ctx.Async != NULL && ctx.Async->Requested;
+}
+
+void GridAsyncSolveWait(ImGridEngine &ctx) {
+  if (ctx.Async == NULL)
+    return;
+  ImGridAsyncSolve &async = *ctx.Async;
+  std::unique_lock<std::mutex> lock(async.Mutex);
+  async.Idle.wait(lock,
+                  [&] { return async.Queued == -1 && async.Solving == -1; });
+}
+
+namespace {
+
+// Solves buffers of the pool's job until none is left.
+void SolvePoolDrain(ImGridSolvePool &pool, ImGridSolveBuffer *const *buffers,
+                    int count) {
+  // the buffers of a precompute are never cancelled
+  static const std::atomic<int> generation(0);
+  for (int i; (i = pool.Next++) < count;)
+    AsyncSolveBuffer(*buffers[i], generation);
+}
+
+void SolvePoolRun(ImGridSolvePool &pool) {
+  std::unique_lock<std::mutex> lock(pool.Mutex);
+  int joined = 0;
+  for (;;) {
+    pool.Wake.wait(
+        lock, [&] { return pool.Quit || (pool.Open && pool.Job != joined); });
+    if (pool.Quit)
+      return;
+    joined = pool.Job;
+    ImGridSolveBuffer *const *buffers = pool.Buffers;
+    const int count = pool.BufferCount;
+    pool.Busy++;
+    lock.unlock();
+
+    SolvePoolDrain(pool, buffers, count);
+
+    lock.lock();
+    if (--pool.Busy == 0)
+      pool.Done.notify_all();
+  }
+}
+
+// Solves every buffer on the calling thread and the pool's workers.
+void SolvePoolSolve(ImGridEngine &ctx,
+                    const ImGridVector<ImGridSolveBuffer *> &buffers) {
+  const int threads =
+      IM_MIN(PrecomputeMaxThreads,
+             IM_MAX(1, static_cast<int>(std::thread::hardware_concurrency())));
+  if (threads == 1 || buffers.Size == 1) {
+    const std::atomic<int> generation(0);
+    for (ImGridSolveBuffer *buffer : buffers)
+      AsyncSolveBuffer(*buffer, generation);
+    return;
+  }
+
+  if (ctx.SolvePool == NULL) {
+    ctx.SolvePool = new ImGridSolvePool();
+    ImGridSolvePool &pool = *ctx.SolvePool;
+    pool.WorkerCount = threads - 1;
+    for (int i = 0; i < pool.WorkerCount; ++i)
+      pool.Workers[i] = std::thread(SolvePoolRun, std::ref(pool));
+  }
+  ImGridSolvePool &pool = *ctx.SolvePool;
+  {
+    std::lock_guard<std::mutex> lock(pool.Mutex);
+    pool.Buffers = buffers.Data;
+    pool.BufferCount = buffers.Size;
+    pool.Next = 0;
+    pool.Job++;
+    pool.Open = true;
+  }
+  pool.Wake.notify_all();
+  SolvePoolDrain(pool, buffers.Data, buffers.Size);
+
+  std::unique_lock<std::mutex> lock(pool.Mutex);
+  pool.Open = false;
+  pool.Done.wait(lock, [&] { return pool.Busy == 0; });
+}
+
+} // namespace
+
+void GridPrecomputeLayouts(ImGridEngine &ctx, const ImGridColumnOpts &opts) {
+  ImGridPrecomputedLayouts &pre = ctx.Precomputed;
+  pre.Columns.resize(0);
+  pre.Flags.resize(0);
+  pre.Ids.resize(0);
+  pre.Layouts.resize(0);
+  pre.FromColumn = ctx.Column;
+  pre.Stale = false;
+  if (ctx.Entries.Size == 0)
+    return;
+  IMGRID_PROFILE_ZONE("GridPrecomputeLayouts");
+
+  // the columns CheckDynamicColumn() can switch to, with the same flags
+  for (int i = -1; i < opts.Breakpoints.Size; ++i) {
+    const int column = i < 0 ? opts.ColumnMax : opts.Breakpoints[i].Column;
+    if (column < 1 || column == ctx.Column || pre.Columns.contains(column))
+      continue;
+    ImGridColumnFlags flags = opts.Flags;
+    for (const ImGridBreakpoint &breakpoint : opts.Breakpoints) {
+      if (breakpoint.Column == column) {
+        flags |= breakpoint.Flags;
+        break;
+      }
+    }
+    if (flags == ImGridColumnFlags_None)
+      continue;
+    pre.Columns.push_back(column);
+    pre.Flags.push_back(flags);
+  }
+  if (pre.Columns.Size == 0)
+    return;
+
+  ImGridVector<ImGridSolveBuffer *> buffers;
+  for (int i = 0; i < pre.Columns.Size; ++i) {
+    ImGridSolveBuffer *buffer = new ImGridSolveBuffer();
+    SolveSnapshot(ctx, *buffer);
+    // solve each one in full
+    buffer->Precomputed = ImGridPrecomputedLayouts();
+    buffer->PreviousColumn = ctx.Column;
+    buffer->Column = pre.Columns[i];
+    buffer->ColumnOptions = ImGridColumnOptions{pre.Flags[i]};
+    buffers.push_back(buffer);
+  }
+
+  // every thread, this one too, takes the next unsolved buffer
+  SolvePoolSolve(ctx, buffers);
+
+  pre.Layouts.resize(0);
+  pre.Layouts.reserve(buffers.Size * ctx.Entries.Size);
+  for (ImGridSolveBuffer *buffer : buffers) {
+    for (const int idx : buffer->Order) {
+      const ImGridEntry &solved = buffer->Entries[idx];
+      ImGridEntry cached(solved.Id, solved.Position);
+      cached.AutoPosition = solved.AutoPosition;
+      pre.Layouts.push_back(cached);
+    }
+  }
+  pre.Ids.swap(buffers[0]->Ids);
+  pre.Positions.swap(buffers[0]->Input);
+
+  for (ImGridSolveBuffer *buffer : buffers)
+    delete buffer;
+}
+
+bool GridPrecomputedLayoutsStale(const ImGridEngine &ctx) {
+  const ImGridPrecomputedLayouts &pre = ctx.Precomputed;
+  return pre.Stale || pre.FromColumn != ctx.Column ||
+         pre.Ids.Size != ctx.Entries.Size;
+}
+
+} // namespace ImGrid::Engine
+
+// Section [Profiler]
+
+std::atomic<const ImGridProfiler *> GImGridProfiler(NULL);
+
+namespace ImGrid {
+
+namespace {
+
+#ifdef IMGRID_ENABLE_PROFILER
+// BeginProfileCapture() state. Events are written in the Chrome trace JSON
+// array format, a "B" and an "E" event per zone. Zones may run on any thread,
+// hence the lock.
+struct ImGridTraceCapture {
+  FILE *File;
+  bool FirstEvent;
+  std::chrono::steady_clock::time_point Start;
+  std::mutex Mutex;
+};
+
+ImGridTraceCapture GImGridTraceCapture;
+
+FILE *TraceFileOpen(const char *file_name) {
+#ifdef _MSC_VER
+  FILE *file = NULL;
+  return fopen_s(&file, file_name, "wb") == 0 ? file : NULL;
+#else
+  return fopen(file_name, "wb");
+#endif
+}
+
+// small ids in the order threads first open a zone, one track each in the
+// trace viewer
+int TraceThreadId() {
+  static std::atomic<int> next_id(1);
+  thread_local const int id = next_id++;
+  return id;
+}
+
+void TraceWriteEvent(const char *name, const char phase) {
+  const auto now = std::chrono::steady_clock::now();
+  const int tid = TraceThreadId();
+
+  ImGridTraceCapture &capture = GImGridTraceCapture;
+  std::lock_guard<std::mutex> lock(capture.Mutex);
+  // a zone that outlived EndProfileCapture()
+  if (capture.File == NULL)
+    return;
+  if (!capture.FirstEvent)
+    fputs(",\n", capture.File);
+  fputs("{\"name\":\"", capture.File);
+  for (const char *c = name; *c != 0; ++c) {
+    if (*c == '"' || *c == '\\')
+      fputc('\\', capture.File);
+    fputc(*c, capture.File);
+  }
+  const double ts =
+      std::chrono::duration<double, std::micro>(now - capture.Start).count();
+  fprintf(capture.File,
+          "\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%d}", phase,
+          ts, tid);
+  capture.FirstEvent = false;
+}
+
+void TraceZoneBegin(const char *name, void *) { TraceWriteEvent(name, 'B'); }
+void TraceZoneEnd(const char *name, void *) { TraceWriteEvent(name, 'E'); }
+#endif
+
+} // namespace
+
+void SetProfileZoneCallbacks(ImGridProfileZoneFunc begin,
+                             ImGridProfileZoneFunc end, void *user_data) {
+  // Every set published so far, reused when set again. Zones may still be
+  // reading any of them, so none is ever freed; there are only as many as
+  // distinct callback sets the program uses.
+  static ImGridVector<ImGridProfiler *> profilers;
+  static std::mutex mutex;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  if (begin == NULL && end == NULL) {
+    GImGridProfiler.store(NULL, std::memory_order_release);
+    return;
+  }
+  ImGridProfiler *published = NULL;
+  for (ImGridProfiler *profiler : profilers) {
+    if (profiler->Begin == begin && profiler->End == end &&
+        profiler->UserData == user_data) {
+      published = profiler;
+      break;
+    }
+  }
+  if (published == NULL) {
+    published = new ImGridProfiler();
+    published->Begin = begin;
+    published->End = end;
+    published->UserData = user_data;
+    profilers.push_back(published);
+  }
+  GImGridProfiler.store(published, std::memory_order_release);
+}
+
+bool BeginProfileCapture(const char *file_name) {
+#ifdef IMGRID_ENABLE_PROFILER
+  EndProfileCapture();
+  FILE *file = TraceFileOpen(file_name);
+  if (file == NULL)
+    return false;
+  fputs("[\n", file);
+  {
+    ImGridTraceCapture &capture = GImGridTraceCapture;
+    std::lock_guard<std::mutex> lock(capture.Mutex);
+    capture.File = file;
+    capture.FirstEvent = true;
+    capture.Start = std::chrono::steady_clock::now();
+  }
+  SetProfileZoneCallbacks(TraceZoneBegin, TraceZoneEnd);
+  return true;
+#else
+  (void)file_name;
+  return false;
+#endif
+}
+
+void EndProfileCapture() {
+#ifdef IMGRID_ENABLE_PROFILER
+  const ImGridProfiler *profiler = GImGridProfiler.load();
+  if (profiler != NULL && profiler->Begin == TraceZoneBegin)
+    SetProfileZoneCallbacks(NULL, NULL);
+
+  ImGridTraceCapture &capture = GImGridTraceCapture;
+  std::lock_guard<std::mutex> lock(capture.Mutex);
+  if (capture.File == NULL)
+    return;
+  fputs("\n]\n", capture.File);
+  fclose(capture.File);
+  capture.File = NULL;
+#endif
+}
+
+} // namespace ImGrid
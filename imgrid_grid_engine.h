@@ -1,18 +1,425 @@
 #pragma once
 
-#include "imgui.h"
-#include "imgui_internal.h"
-
-#include "imgrid.h"
+#include "imgrid_types.h"
 
+#include <atomic>
+#include <limits.h>
 #include <map>
 #include <optional>
+#include <type_traits>
+
+#define IM_MIN(x, y) ((x) > (y) ? (y) : (x))
+#define IM_MAX(x, y) ((x) > (y) ? (x) : (y))
+#define IM_CEIL(x) ((float)(int)((x) + 0.999999f))
+// same as imgui_internal.h
+#ifndef IM_TRUNC
+#define IM_TRUNC(_VAL) ((float)(int)(_VAL))
+#endif
+#ifndef IM_ROUND
+#define IM_ROUND(_VAL) ((float)(int)((_VAL) + 0.5f))
+#endif
+
+// Only converted from and to by the ImGui layer, which includes imgui.h.
+struct ImVec2;
+struct ImVec4;
+
+// Instruction set used by the packed rect kernels, picked at compile time.
+// AVX2 needs -mavx2 (/arch:AVX2), see the IMGRID_ENABLE_AVX2 CMake option.
+// Define IMGRID_DISABLE_SIMD to force the scalar kernels.
+#if defined(__AVX2__) && !defined(IMGRID_DISABLE_SIMD)
+#define IMGRID_ENABLE_AVX2
+#endif
+#if (defined __SSE2__ || defined __x86_64__ || defined _M_X64 ||               \
+     (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))) &&                            \
+    !defined(IMGRID_DISABLE_SIMD)
+#define IMGRID_ENABLE_SSE2
+#endif
+
+// Number of packed slots tested per GridPackedInterceptMask() call
+#define IMGRID_PACKED_BATCH 16
+
+// Define IMGRID_ENABLE_STATS (see the CMake option of the same name) to count
+// the engine's work and time the frame phases for ImGrid::GetFrameStats().
+// Otherwise these macros compile to nothing and the counters stay zero, the
+// structs holding them keep the same layout either way.
+#ifdef IMGRID_ENABLE_STATS
+#define IMGRID_STATS_ADD(stats, counter, n) ((stats).counter += (n))
+#define IMGRID_STATS_MAX(stats, counter, n)                                    \
+  ((stats).counter = IM_MAX((stats).counter, (n)))
+#else
+#define IMGRID_STATS_ADD(stats, counter, n) ((void)0)
+#define IMGRID_STATS_MAX(stats, counter, n) ((void)0)
+#endif
+
+// Profiler zone covering the rest of the enclosing scope, one per scope.
+// Empty unless IMGRID_ENABLE_PROFILER is defined (see the CMake option of the
+// same name), then zones go to the ImGrid::SetProfileZoneCallbacks() pair.
+// Define IMGRID_PROFILE_ZONE before including this header to hand them to
+// another profiler's scoped zone macro instead.
+#ifndef IMGRID_PROFILE_ZONE
+#ifdef IMGRID_ENABLE_PROFILER
+#define IMGRID_PROFILE_ZONE(name)                                              \
+  const ImGridProfileZone imgrid_profile_zone(name)
+#else
+#define IMGRID_PROFILE_ZONE(name) ((void)0)
+#endif
+#endif
+
+struct ImGridProfiler {
+  ImGridProfileZoneFunc Begin;
+  ImGridProfileZoneFunc End;
+  void *UserData;
+};
+
+// Zones open on whichever thread calls into the engine, so
+// SetProfileZoneCallbacks() never writes a published ImGridProfiler: it
+// publishes another one, and every callback set it has published stays valid
+// until the program exits. NULL while no callbacks are set.
+extern std::atomic<const ImGridProfiler *> GImGridProfiler;
+
+// Keeps the callbacks it was opened with, so swapping them mid-zone doesn't
+// hand the new pair an unmatched end.
+struct ImGridProfileZone {
+  const char *Name;
+  ImGridProfileZoneFunc End;
+  void *UserData;
+
+  explicit ImGridProfileZone(const char *name)
+      : Name(name), End(NULL), UserData(NULL) {
+    const ImGridProfiler *profiler =
+        GImGridProfiler.load(std::memory_order_acquire);
+    if (profiler == NULL)
+      return;
+    End = profiler->End;
+    UserData = profiler->UserData;
+    if (profiler->Begin != NULL)
+      profiler->Begin(name, UserData);
+  }
+  ~ImGridProfileZone() {
+    if (End != NULL)
+      End(Name, UserData);
+  }
+  ImGridProfileZone(const ImGridProfileZone &) = delete;
+  ImGridProfileZone &operator=(const ImGridProfileZone &) = delete;
+};
 
-struct ImGridEntry;
 struct ImGridContext;
 
 struct ImGridEngine;
 
+using ScreenSpace = float;
+using GridSpace = int;
+
+template <typename UnderlyingType> struct TypedImVec2 {
+  UnderlyingType x, y;
+  constexpr TypedImVec2() : x(), y() {}
+  template <typename V, typename = std::enable_if_t<std::is_same_v<V, ImVec2>>>
+  constexpr TypedImVec2(const V &vec) : x(vec.x), y(vec.y) {}
+  constexpr TypedImVec2(UnderlyingType _x, UnderlyingType _y) : x(_x), y(_y) {}
+  UnderlyingType &operator[](size_t idx) {
+    IM_ASSERT(idx == 0 || idx == 1);
+    return ((UnderlyingType *)(void *)(char *)this)[idx];
+  } // We very rarely use this [] operator, so the assert overhead is fine.
+  UnderlyingType operator[](size_t idx) const {
+    IM_ASSERT(idx == 0 || idx == 1);
+    return ((const UnderlyingType *)(const void *)(const char *)this)[idx];
+  }
+  // conversion to ImVec2
+  template <typename V, typename = std::enable_if_t<std::is_same_v<V, ImVec2>>>
+  operator V() const {
+    return V(x, y);
+  }
+};
+
+template <typename UnderlyingType>
+static inline TypedImVec2<UnderlyingType>
+operator*(const TypedImVec2<UnderlyingType> &lhs, const UnderlyingType rhs) {
+  return TypedImVec2<UnderlyingType>(lhs.x * rhs, lhs.y * rhs);
+}
+
+template <typename UnderlyingType>
+static inline TypedImVec2<UnderlyingType>
+operator/(const TypedImVec2<UnderlyingType> &lhs, const UnderlyingType rhs) {
+  return TypedImVec2<UnderlyingType>(lhs.x / rhs, lhs.y / rhs);
+}
+template <typename UnderlyingType>
+static inline TypedImVec2<UnderlyingType>
+operator+(const TypedImVec2<UnderlyingType> &lhs,
+          const TypedImVec2<UnderlyingType> &rhs) {
+  return TypedImVec2<UnderlyingType>(lhs.x + rhs.x, lhs.y + rhs.y);
+}
+template <typename UnderlyingType>
+static inline TypedImVec2<UnderlyingType>
+operator-(const TypedImVec2<UnderlyingType> &lhs,
+          const TypedImVec2<UnderlyingType> &rhs) {
+  return TypedImVec2<UnderlyingType>(lhs.x - rhs.x, lhs.y - rhs.y);
+}
+template <typename UnderlyingType>
+static inline TypedImVec2<UnderlyingType>
+operator*(const TypedImVec2<UnderlyingType> &lhs,
+          const TypedImVec2<UnderlyingType> &rhs) {
+  return TypedImVec2<UnderlyingType>(lhs.x * rhs.x, lhs.y * rhs.y);
+}
+template <typename UnderlyingType>
+static inline TypedImVec2<UnderlyingType>
+operator/(const TypedImVec2<UnderlyingType> &lhs,
+          const TypedImVec2<UnderlyingType> &rhs) {
+  return TypedImVec2<UnderlyingType>(lhs.x / rhs.x, lhs.y / rhs.y);
+}
+template <typename UnderlyingType>
+static inline TypedImVec2<UnderlyingType>
+operator-(const TypedImVec2<UnderlyingType> &lhs) {
+  return TypedImVec2<UnderlyingType>(-lhs.x, -lhs.y);
+}
+template <typename UnderlyingType>
+static inline TypedImVec2<UnderlyingType> &
+operator*=(TypedImVec2<UnderlyingType> &lhs, const UnderlyingType rhs) {
+  lhs.x *= rhs;
+  lhs.y *= rhs;
+  return lhs;
+}
+template <typename UnderlyingType>
+static inline TypedImVec2<UnderlyingType> &
+operator/=(TypedImVec2<UnderlyingType> &lhs, const UnderlyingType rhs) {
+  lhs.x /= rhs;
+  lhs.y /= rhs;
+  return lhs;
+}
+template <typename UnderlyingType>
+static inline TypedImVec2<UnderlyingType> &
+operator+=(TypedImVec2<UnderlyingType> &lhs,
+           const TypedImVec2<UnderlyingType> &rhs) {
+  lhs.x += rhs.x;
+  lhs.y += rhs.y;
+  return lhs;
+}
+template <typename UnderlyingType>
+static inline TypedImVec2<UnderlyingType> &
+operator-=(TypedImVec2<UnderlyingType> &lhs,
+           const TypedImVec2<UnderlyingType> &rhs) {
+  lhs.x -= rhs.x;
+  lhs.y -= rhs.y;
+  return lhs;
+}
+template <typename UnderlyingType>
+static inline TypedImVec2<UnderlyingType> &
+operator*=(TypedImVec2<UnderlyingType> &lhs,
+           const TypedImVec2<UnderlyingType> &rhs) {
+  lhs.x *= rhs.x;
+  lhs.y *= rhs.y;
+  return lhs;
+}
+template <typename UnderlyingType>
+static inline TypedImVec2<UnderlyingType> &
+operator/=(TypedImVec2<UnderlyingType> &lhs,
+           const TypedImVec2<UnderlyingType> &rhs) {
+  lhs.x /= rhs.x;
+  lhs.y /= rhs.y;
+  return lhs;
+}
+template <typename UnderlyingType>
+static inline bool operator==(const TypedImVec2<UnderlyingType> &lhs,
+                              const TypedImVec2<UnderlyingType> &rhs) {
+  return lhs.x == rhs.x && lhs.y == rhs.y;
+}
+template <typename UnderlyingType>
+static inline bool operator!=(const TypedImVec2<UnderlyingType> &lhs,
+                              const TypedImVec2<UnderlyingType> &rhs) {
+  return lhs.x != rhs.x || lhs.y != rhs.y;
+}
+
+template <typename Vec2DType> struct TypedImRect {
+  Vec2DType Min; // Upper-left
+  Vec2DType Max; // Lower-right
+
+  constexpr TypedImRect() : Min(0.0f, 0.0f), Max(0.0f, 0.0f) {}
+  constexpr TypedImRect(const Vec2DType &min, const Vec2DType &max)
+      : Min(min), Max(max) {}
+  template <typename V, typename = std::enable_if_t<std::is_same_v<V, ImVec4>>>
+  constexpr TypedImRect(const V &v) : Min(v.x, v.y), Max(v.z, v.w) {}
+  constexpr TypedImRect(float x1, float y1, float x2, float y2)
+      : Min(x1, y1), Max(x2, y2) {}
+
+  Vec2DType GetCenter() const {
+    return Vec2DType((Min.x + Max.x) * 0.5f, (Min.y + Max.y) * 0.5f);
+  }
+  Vec2DType GetSize() const { return Vec2DType(Max.x - Min.x, Max.y - Min.y); }
+  float GetWidth() const { return Max.x - Min.x; }
+  float GetHeight() const { return Max.y - Min.y; }
+  float GetArea() const { return (Max.x - Min.x) * (Max.y - Min.y); }
+  Vec2DType GetTL() const { return Min; }                     // Top-left
+  Vec2DType GetTR() const { return Vec2DType(Max.x, Min.y); } // Top-right
+  Vec2DType GetBL() const { return Vec2DType(Min.x, Max.y); } // Bottom-left
+  Vec2DType GetBR() const { return Max; }                     // Bottom-right
+  bool Contains(const Vec2DType &p) const {
+    return p.x >= Min.x && p.y >= Min.y && p.x < Max.x && p.y < Max.y;
+  }
+  bool Contains(const TypedImRect<Vec2DType> &r) const {
+    return r.Min.x >= Min.x && r.Min.y >= Min.y && r.Max.x <= Max.x &&
+           r.Max.y <= Max.y;
+  }
+  bool ContainsWithPad(const Vec2DType &p, const Vec2DType &pad) const {
+    return p.x >= Min.x - pad.x && p.y >= Min.y - pad.y &&
+           p.x < Max.x + pad.x && p.y < Max.y + pad.y;
+  }
+  bool Overlaps(const TypedImRect<Vec2DType> &r) const {
+    return r.Min.y < Max.y && r.Max.y > Min.y && r.Min.x < Max.x &&
+           r.Max.x > Min.x;
+  }
+  void Add(const Vec2DType &p) {
+    if (Min.x > p.x)
+      Min.x = p.x;
+    if (Min.y > p.y)
+      Min.y = p.y;
+    if (Max.x < p.x)
+      Max.x = p.x;
+    if (Max.y < p.y)
+      Max.y = p.y;
+  }
+  void Add(const TypedImRect<Vec2DType> &r) {
+    if (Min.x > r.Min.x)
+      Min.x = r.Min.x;
+    if (Min.y > r.Min.y)
+      Min.y = r.Min.y;
+    if (Max.x < r.Max.x)
+      Max.x = r.Max.x;
+    if (Max.y < r.Max.y)
+      Max.y = r.Max.y;
+  }
+  void Expand(const float amount) {
+    Min.x -= amount;
+    Min.y -= amount;
+    Max.x += amount;
+    Max.y += amount;
+  }
+  void Expand(const Vec2DType &amount) {
+    Min.x -= amount.x;
+    Min.y -= amount.y;
+    Max.x += amount.x;
+    Max.y += amount.y;
+  }
+  void Translate(const Vec2DType &d) {
+    Min.x += d.x;
+    Min.y += d.y;
+    Max.x += d.x;
+    Max.y += d.y;
+  }
+  void TranslateX(float dx) {
+    Min.x += dx;
+    Max.x += dx;
+  }
+  void TranslateY(float dy) {
+    Min.y += dy;
+    Max.y += dy;
+  }
+  void ClipWith(const TypedImRect<Vec2DType> &r) {
+    Min = Vec2DType(IM_MAX(Min.x, r.Min.x), IM_MAX(Min.y, r.Min.y));
+    Max = Vec2DType(IM_MIN(Max.x, r.Max.x), IM_MIN(Max.y, r.Max.y));
+  } // Simple version, may lead to an inverted rectangle, which is fine for
+    // Contains/Overlaps test but not for display.
+  void ClipWithFull(const TypedImRect<Vec2DType> &r) {
+    Min = Vec2DType(IM_MIN(IM_MAX(Min.x, r.Min.x), r.Max.x),
+                    IM_MIN(IM_MAX(Min.y, r.Min.y), r.Max.y));
+    Max = Vec2DType(IM_MIN(IM_MAX(Max.x, r.Min.x), r.Max.x),
+                    IM_MIN(IM_MAX(Max.y, r.Min.y), r.Max.y));
+  } // Full version, ensure both points are fully clipped.
+  void Floor() {
+    Min.x = IM_TRUNC(Min.x);
+    Min.y = IM_TRUNC(Min.y);
+    Max.x = IM_TRUNC(Max.x);
+    Max.y = IM_TRUNC(Max.y);
+  }
+  bool IsInverted() const { return Min.x > Max.x || Min.y > Max.y; }
+  template <typename V4 = ImVec4> V4 ToVec4() const {
+    return V4(Min.x, Min.y, Max.x, Max.y);
+  }
+};
+
+using ScreenSpacePosition = TypedImVec2<ScreenSpace>;
+using ScreenSpaceRect = TypedImRect<ScreenSpacePosition>;
+
+using GridSpacePosition = TypedImVec2<GridSpace>;
+using GridSpaceRect = TypedImRect<GridSpacePosition>;
+
+struct ImGridEntry {
+  int Id;
+
+  // GRID VALUES
+  ImGridPosition Position;
+  ImGridEngine *ParentContext;
+
+  bool AutoPosition;
+  float MinW, MinH;
+  float MaxW, MaxH;
+  bool NoResize;
+  bool NoMove;
+  bool Locked;
+  bool Resizable;
+
+  bool AutoSize;
+
+  bool Dirty;
+  bool Updating;
+  bool SkipDown;
+  ImGridPosition PrevPosition;
+  ImGridPosition Rect;
+  ScreenSpacePosition LastUIPosition;
+  ImGridPosition LastTried;
+  ImGridPosition WillFitPos;
+
+  // if Moving, use the moving position since we should drag smoothly, not in
+  // grid steps
+  ScreenSpacePosition MovingPosition;
+  bool Moving;
+
+  // if HasPreview, we render another rect at the PreviewPosition to show where
+  // this node will snap to if it is dropped
+  ScreenSpacePosition PreviewPosition;
+  bool HasPreview;
+
+  bool BorderHovered;
+  bool BorderHeld;
+
+  ScreenSpacePosition MoveMouseOffsetRel;
+
+  // cells this entry is stamped into in ImGridEngine::Occupancy, valid while
+  // OccupancyEpoch matches the index epoch. An empty rect means unindexed.
+  int OccupancyEpoch;
+  GridSpaceRect OccupiedCells;
+
+  // slot in ImGridEngine::Packed, valid while Packed.Handles[PackedIdx] is
+  // this entry's Handle
+  int PackedIdx;
+
+  // slot in ImGridEngine::Entries, valid while Entries[EngineIdx] is this
+  // entry
+  int EngineIdx;
+
+  // ImGridMoveJournal::Epoch this entry was last recorded under
+  int JournalEpoch;
+
+  // slot in ParentContext->Handles, 0 while the entry isn't in an engine
+  ImGridEntryHandle Handle;
+
+  struct {
+    ImU32 Background, BackgroundHovered, BackgroundSelected, Outline, Titlebar,
+        TitlebarHovered, TitlebarSelected, PreviewFill, PreviewOutline;
+  } ColorStyle;
+
+  struct {
+    float CornerRounding;
+    ScreenSpacePosition Padding;
+    float BorderThickness;
+  } LayoutStyle;
+
+  // Position is in integer grid coordinates, so we need to get
+
+  ImGridEntry(const int id, ImGridPosition ps);
+  ImGridEntry(const int id);
+  ImGridEntry(ImGridPosition pos);
+  ~ImGridEntry() { Id = INT_MIN; }
+};
+
 typedef int ImGridCellHeightMode; // -> enum ImGridCellHeightMode_
 
 enum ImGridCellHeightMode_ {
@@ -43,7 +450,7 @@ struct ImGridColumnOpts {
   int ColumnWidth;
   int ColumnMax;
 
-  ImVector<ImGridBreakpoint> Breakpoints;
+  ImGridVector<ImGridBreakpoint> Breakpoints;
 
   bool BreakpointForWindow;
 
@@ -65,7 +472,7 @@ struct ImGridOptions {
   int MarginLeft;
   int MarginRight;
 
-  ImVector<ImGridEntry *> InitialEntries;
+  ImGridVector<ImGridEntry *> InitialEntries;
 
   ImGridCellHeightOption CellHeight;
   ImGridColumnOption Column;
@@ -82,13 +489,186 @@ struct ImGridOptions {
 
   bool SizeToContent;
 
+  // solve column changes on a worker thread, see GridColumnChangedAsync()
+  bool AsyncColumnChange;
+
   ImGridOptions()
       : AcceptWidgets(true), AlwaysShowResizeHandle(false), Animate(false),
-        Auto(true), CellHeight({ImGridCellHeightMode_Auto, 50, 100}),
-        Column({true, 1024}), DisableDrag(false), DisableResize(false),
-        Float(false), Margin(10), MaxRow(-1), MinRow(0), SizeToContent(true) {}
+        Auto(true), MarginTop(0), MarginBottom(0), MarginLeft(0),
+        MarginRight(0), CellHeight({ImGridCellHeightMode_Auto, 50, 100}),
+        Column({true, 1024}), ColumnOpts(NULL), DisableDrag(false),
+        DisableResize(false), Float(false), Margin(10), MaxRow(-1), MinRow(0),
+        SizeToContent(true), AsyncColumnChange(false) {}
+};
+
+// An entry covering a cell that already has an owner, see ImGridOccupancy.
+struct ImGridOccupancyCover {
+  int Cell;
+  ImGridEntry *Entry;
+};
+
+// Column x row cell occupancy bitmap used to answer collision queries by
+// looking at the cells under an area instead of scanning every entry. Each
+// cell stores one owning entry and the number of entries covering it; a cell
+// whose owner is unknown (overlapping entries) falls back to a linear scan.
+// The other entries covering a cell are listed in Covers while there are few
+// of them, so a swap that overlaps two entries for a moment hands the cells
+// over instead of leaving them unknown.
+//
+// Entries record the Epoch and cells they were stamped with, so the index can
+// be re-synced against ImGridEngine::Entries in O(N) and then kept up to date
+// incrementally while inside a GridOccupancyBegin()/GridOccupancyEnd() scope.
+//
+// RunTree is a max segment tree over the longest run of free cells in each
+// row: leaf RunLeaves + y holds row y's, rows past Rows count as free, node i
+// the larger of nodes 2i and 2i+1. First-fit searches for free space find the
+// next row able to hold the requested width in O(log rows) instead of
+// visiting every row above it.
+struct ImGridOccupancy {
+  int Columns;
+  int Rows;
+  ImGridVector<ImGridEntry *> Owners;
+  ImGridVector<int> Counts;
+  ImGridVector<int> RunTree;
+  int RunLeaves; // power of two, >= Rows
+  ImGridVector<ImGridOccupancyCover> Covers;
+
+  int Epoch;
+  int Unindexed; // entries whose position can't be stamped (unset/negative)
+  int Ambiguous;  // covered cells with an unknown owner
+  int Overlapped; // covers of a cell past its first one
+  int ScopeDepth;
+  bool Valid;
+
+  ImGridOccupancy()
+      : Columns(0), Rows(0), RunLeaves(0), Epoch(0), Unindexed(0),
+        Ambiguous(0), Overlapped(0), ScopeDepth(0), Valid(false) {}
+};
+
+// Struct-of-arrays copy of entry positions in integer grid units, so
+// collision scans walk contiguous int16 arrays instead of chasing ImGridEntry
+// pointers and comparing floats. ImGridEntry::Position stays the source of
+// truth: the mirror is repacked lazily after the occupancy index syncs, then
+// refreshed alongside it and reordered by GridSortEntriesInplace().
+//
+// Positions that aren't whole numbers or don't fit in 16 bits (including
+// x + w and y + h) are counted in InexactCount; while it is non-zero callers
+// keep using the float positions.
+struct ImGridPackedPositions {
+  ImGridVector<ImS16> X, Y, W, H;
+  ImGridVector<int> Ids;
+  ImGridVector<ImGridEntryHandle> Handles; // 0 for entries without one
+  ImGridVector<ImU8> Inexact;
+
+  int InexactCount;
+  bool Valid;
+
+  ImGridPackedPositions() : InexactCount(0), Valid(false) {}
+  int Size() const { return Ids.Size; }
+};
+
+// Cells whose occupancy changed since the last top gravity pack: the rows and
+// columns around them. Only entries in those columns, from the topmost
+// changed row down, can rise, so GridPackEntries() leaves the rest alone. Full
+// when the changes aren't known (rebuilt index, unset positions).
+struct ImGridPackRegion {
+  int MinY, MaxY;
+  int MinX, MaxX;
+  bool Full;
+
+  ImGridPackRegion() { Reset(true); }
+  void Reset(bool full) {
+    MinY = MinX = INT_MAX;
+    MaxY = MaxX = INT_MIN;
+    Full = full;
+  }
+  bool Empty() const { return !Full && MinX >= MaxX; }
+  void Add(const GridSpaceRect &cells) {
+    MinY = IM_MIN(MinY, cells.Min.y);
+    MaxY = IM_MAX(MaxY, cells.Max.y);
+    MinX = IM_MIN(MinX, cells.Min.x);
+    MaxX = IM_MAX(MaxX, cells.Max.x);
+  }
+  void Add(const ImGridPackRegion &other) {
+    MinY = IM_MIN(MinY, other.MinY);
+    MaxY = IM_MAX(MaxY, other.MaxY);
+    MinX = IM_MIN(MinX, other.MinX);
+    MaxX = IM_MAX(MaxX, other.MaxX);
+    Full = Full || other.Full;
+  }
+};
+
+// Undo log for speculative moves. While Active, the engine records the move
+// state of an entry (position, last tried position, dirty and skip down flags)
+// the first time a move touches it, so a rejected trial can be rolled back
+// without cloning the grid and a successful one is kept as is.
+struct ImGridMoveRecord {
+  ImGridEntry *Entry;
+  ImGridPosition Position;
+  ImGridPosition LastTried;
+  bool Dirty;
+  bool SkipDown;
+};
+
+struct ImGridMoveJournal {
+  ImGridVector<ImGridMoveRecord> Records;
+  int Epoch;
+  int SavedMaxRow;
+  ImGridPackRegion SavedPackRegion; // a trial pack may consume the region
+  bool Active;
+
+  ImGridMoveJournal() : Epoch(0), SavedMaxRow(0), Active(false) {}
+};
+
+// Slots behind ImGridEntryHandle. Generations start at 1 and skip 0 when they
+// wrap, so a live handle is never 0.
+struct ImGridEntryTable {
+  static const int IndexBits = 20;
+  static const ImU32 IndexMask = (1u << IndexBits) - 1;
+  static const ImU32 GenerationMask = (1u << (32 - IndexBits)) - 1;
+
+  ImGridVector<ImGridEntry *> Entries; // NULL for free slots
+  ImGridVector<ImU16> Generations;
+  ImGridVector<int> FreeList;
+};
+
+// Engine work counted under IMGRID_ENABLE_STATS. The engine only adds to
+// them, whoever reads them resets them (EndGrid() does, once per frame).
+struct ImGridEngineStats {
+  int CollideCalls;   // GridCollide() and GridCollideAll()
+  int EntriesScanned; // occupancy cells, packed slots or entries they tested
+  int MoveNodeDepth;  // GridMoveNode() calls in progress
+  int MaxMoveNodeDepth;
+  int PackIterations; // entries walked or rows stepped by the packs
+
+  ImGridEngineStats()
+      : CollideCalls(0), EntriesScanned(0), MoveNodeDepth(0),
+        MaxMoveNodeDepth(0), PackIterations(0) {}
+};
+
+// The layouts GridPrecomputeLayouts() solved and the positions it solved them
+// from. GridColumnChanged() uses one of them in place of a solve while the
+// entries still sit where they were then. Kept apart from CacheLayouts, which
+// holds the layouts the user left at each column count.
+struct ImGridPrecomputedLayouts {
+  int FromColumn;
+  ImGridVector<int> Columns;
+  ImGridVector<ImGridColumnFlags> Flags; // each of Columns was solved with
+  ImGridVector<int> Ids;
+  ImGridVector<ImGridPosition> Positions;
+  // one run of Ids.Size entries per column, in the order it was solved in
+  ImGridVector<ImGridEntry> Layouts;
+  // set by committed changes (entries added, removed or moved) since
+  bool Stale;
+
+  ImGridPrecomputedLayouts() : FromColumn(0), Stale(true) {}
 };
 
+// Worker thread and buffers behind GridColumnChangedAsync()
+struct ImGridAsyncSolve;
+// Worker threads GridPrecomputeLayouts() shares its solves with
+struct ImGridSolvePool;
+
 struct ImGridEngine {
   ImGridOptions Options;
 
@@ -107,18 +687,60 @@ struct ImGridEngine {
   float LastMovingCellHeight;
   float LastMovingCellWidth;
 
-  ImVector<ImGridEntry *> AddedEntries;
-  ImVector<ImGridEntry *> RemovedEntries;
-  ImVector<ImGridEntry *> Entries;
-  std::map<int, ImVector<ImGridEntry>> CacheLayouts;
+  ImGridVector<ImGridEntryHandle> AddedEntries;
+  ImGridVector<ImGridEntryHandle> RemovedEntries;
+  // Every listed entry holds a live handle from Handles.
+  // TODO: list handles here too, as Packed and ImGridMoveOptions do. The
+  // collision and pack loops walk this list and would resolve each one.
+  ImGridVector<ImGridEntry *> Entries;
+  ImGridEntryTable Handles;
+  // AddedEntries/RemovedEntries resolved for the Trigger*Event() functions
+  ImGridVector<ImGridEntry *> EventEntries;
+  // entries GridPackColumns() revisits and its per-column heights
+  ImGridVector<ImGridEntry *> PackScratch;
+  ImGridVector<int> PackProfile;
+  std::map<int, ImGridVector<ImGridEntry>> CacheLayouts;
+  ImGridPrecomputedLayouts Precomputed;
+
+  ImGridOccupancy Occupancy;
+  ImGridPackedPositions Packed;        // mirrors Entries, in the same order
+  ImGridPackedPositions PackedScratch; // ad-hoc entry lists
+  ImGridVector<ImU64> SortScratch;
+  ImGridVector<ImU64> RadixScratch; // second buffer for the radix sort passes
+  // 1 or -1 while Entries are known to be sorted down or upwards since the
+  // last GridSortEntriesInplace(), 0 once anything may have moved
+  int SortedDirection;
+  ImGridMoveJournal Journal;
+  ImGridPackRegion PackRegion;
+  ImGridEngineStats Stats;
+
+  // NULL until the first GridColumnChangedAsync()
+  ImGridAsyncSolve *Async;
+  // NULL until the first GridPrecomputeLayouts() with more than one column
+  ImGridSolvePool *SolvePool;
+  // Set on the private engine a background solve runs on: its long loops give
+  // up once *CancelGeneration moves past SolveGeneration.
+  const std::atomic<int> *CancelGeneration;
+  int SolveGeneration;
 
   ImGridContext *ParentContext;
 
+  // called by GridTriggerChangeEvent()/GridTriggerAddEvent() with the entries
+  // that changed, before their Dirty flags are cleared
+  void (*ChangeCallback)(ImGridEngine &ctx,
+                         const ImGridVector<ImGridEntry *> &entries);
+  // called by GridTriggerRemoveEvent() with the entries removed since the
+  // last event, skipping those already destroyed
+  void (*RemoveCallback)(ImGridEngine &ctx,
+                         const ImGridVector<ImGridEntry *> &entries);
+
   ImGridEngine(ImGridOptions opts = {}) {
     Column = opts.Column.Auto ? 1024 : opts.Column.Columns;
     MaxRow = opts.MaxRow;
     Float = opts.Float;
     Entries = opts.InitialEntries;
+    for (int i = 0; i < Entries.Size; ++i)
+      Entries[i]->EngineIdx = i;
     IgnoreLayoutsNodeChange = false;
     PrevFloat = Float;
     BatchMode = false;
@@ -129,13 +751,50 @@ struct ImGridEngine {
     IsAutoCellHeight = true;
     LastMovingCellHeight = 0;
     LastMovingCellWidth = 0;
+    ParentContext = NULL;
+    ChangeCallback = NULL;
+    RemoveCallback = NULL;
+    SortedDirection = 0;
+    Async = NULL;
+    SolvePool = NULL;
+    CancelGeneration = NULL;
+    SolveGeneration = 0;
   }
+  // stops and joins the background solver and the precompute threads
+  ~ImGridEngine();
+  ImGridEngine(const ImGridEngine &) = delete;
+  ImGridEngine &operator=(const ImGridEngine &) = delete;
 };
 
 namespace ImGrid::Engine {
 
+// entry's slot in ctx.Entries, or -1 if it isn't listed
+inline int GridEntryIndex(const ImGridEngine &ctx, const ImGridEntry *entry) {
+  const int idx = entry->EngineIdx;
+  return idx >= 0 && idx < ctx.Entries.Size && ctx.Entries.Data[idx] == entry
+             ? idx
+             : -1;
+}
+
+// Section [Handles]
+// Gives entry a handle unless it already has a live one in ctx.
+ImGridEntryHandle GridAcquireHandle(ImGridEngine &ctx, ImGridEntry *entry);
+// Invalidates entry's handle and frees its slot for reuse.
+void GridReleaseHandle(ImGridEngine &ctx, ImGridEntry *entry);
+
+// The entry handle refers to, or NULL if it has been released.
+inline ImGridEntry *GridResolveEntry(const ImGridEngine &ctx,
+                                     const ImGridEntryHandle handle) {
+  const ImGridEntryTable &table = ctx.Handles;
+  const int index = static_cast<int>(handle & ImGridEntryTable::IndexMask);
+  if (index >= table.Entries.Size ||
+      table.Generations.Data[index] != handle >> ImGridEntryTable::IndexBits)
+    return NULL;
+  return table.Entries.Data[index];
+}
+
 bool GridFindEmptyPosition(ImGridEngine &ctx, ImGridEntry &entry, int column,
-                           ImVector<ImGridEntry *> &entries,
+                           ImGridVector<ImGridEntry *> &entries,
                            ImGridEntry *after);
 
 // Section [Caching]
@@ -148,18 +807,68 @@ void GridNodeBoundFix(ImGridEngine &ctx, ImGridEntry *entry,
 ImGridEntry *GridPrepareEntry(ImGridEngine &ctx, ImGridEntry *entry,
                               bool resizing = false);
 
+// Section [Occupancy]
+void GridOccupancyClear(ImGridEngine &ctx);
+void GridOccupancyRebuild(ImGridEngine &ctx);
+void GridOccupancyInvalidate(ImGridEngine &ctx);
+void GridOccupancySync(ImGridEngine &ctx);
+void GridOccupancyInsert(ImGridEngine &ctx, ImGridEntry *entry);
+void GridOccupancyUpdate(ImGridEngine &ctx, ImGridEntry *entry);
+void GridOccupancyBegin(ImGridEngine &ctx);
+void GridOccupancyEnd(ImGridEngine &ctx);
+
+// Section [Packed]
+void GridPackedRebuild(ImGridEngine &ctx);
+void GridPackedInvalidate(ImGridEngine &ctx);
+// Tests area (x, y, w, h) against the IMGRID_PACKED_BATCH slots starting at
+// start and returns a bitmask of the intercepting ones, bit n standing for
+// slot start + n. Slots past the end and slots with a skipped id are 0.
+ImU32 GridPackedInterceptMask(const ImGridPackedPositions &packed, int start,
+                              const ImS16 area[4], int skip_id = INT_MIN,
+                              int skip2_id = INT_MIN);
+// Scalar reference for GridPackedInterceptMask(), same results on any ISA
+ImU32 GridPackedInterceptMaskScalar(const ImGridPackedPositions &packed,
+                                    int start, const ImS16 area[4],
+                                    int skip_id = INT_MIN,
+                                    int skip2_id = INT_MIN);
+const char *GridPackedKernelName();
+// Returns the first slot at or after start whose rect intercepts area (x, y,
+// w, h), skipping the given ids, or -1. INT_MIN never matches a live entry.
+int GridPackedFindIntercept(const ImGridPackedPositions &packed, int start,
+                            const ImS16 area[4], int skip_id = INT_MIN,
+                            int skip2_id = INT_MIN);
+
 // Section [Collision]
 ImGridEntry *GridCollide(ImGridEngine &ctx, ImGridEntry *skip,
                          ImGridPosition area, ImGridEntry *skip2);
-ImVector<ImGridEntry *> GridCollideAll(ImGridEngine &ctx, ImGridEntry *skip,
-                                       ImGridPosition area, ImGridEntry *skip2);
+ImGridVector<ImGridEntry *> GridCollideAll(ImGridEngine &ctx, ImGridEntry *skip,
+                                           ImGridPosition area,
+                                           ImGridEntry *skip2);
 
 // Section [Sorting]
-void GridSortNodesInplace(ImVector<ImGridEntry *> &nodes, bool upwards);
-ImVector<ImGridEntry *> GridSortNodes(ImVector<ImGridEntry *> nodes,
-                                      bool upwards);
-
+// Stable sort by (y, x), unset coordinates last, reversed when upwards. Whole
+// positions are radix sorted on a 32-bit key once there are enough of them.
+void GridSortNodesInplace(ImGridVector<ImGridEntry *> &nodes, bool upwards);
+// Sorts ctx.Entries like GridSortNodesInplace, keeping ctx.Packed in step.
+// Inside an occupancy scope it returns straight away if nothing moved since
+// the last sort in the same direction.
+void GridSortEntriesInplace(ImGridEngine &ctx, bool upwards);
+ImGridVector<ImGridEntry *> GridSortNodes(ImGridVector<ImGridEntry *> nodes,
+                                          bool upwards);
+
+// Packs the entries towards the top. Without float only ctx.PackRegion is
+// revisited, see GridPackColumns().
 void GridPackEntries(ImGridEngine &ctx);
+// Top gravity pack of the entries in columns [min_x, max_x) from row min_y
+// down, assuming the grid outside of rows [min_y, max_y) of those columns is
+// packed already. Each entry rises straight to the top free row given by a
+// per-column height profile, and the column span widens as entries move. On
+// an overlap-free occupancy index only the columns that may still differ from
+// the packed grid are followed down, so past max_y the cost depends on the
+// entries that move rather than on the rows left. No-op in batch or float
+// mode.
+void GridPackColumns(ImGridEngine &ctx, int min_x, int max_x, int min_y,
+                     int max_y);
 
 ImGridEntry *GridCopyPosition(ImGridEntry *a, ImGridEntry *b,
                               bool include_minmax = false);
@@ -168,9 +877,9 @@ ImGridEntry *GridCopyPositionFromOpts(ImGridEntry *a, ImGridMoveOptions *b,
 ImGridEntry *GridCopyPositionToOpts(ImGridEntry *b, ImGridMoveOptions *a,
                                     bool include_minmax = false);
 
-ImGridEntry *GridDirectionCollideCoverage(ImGridEntry *entry,
-                                          ImGridMoveOptions &opts,
-                                          ImVector<ImGridEntry *> &collides);
+ImGridEntry *
+GridDirectionCollideCoverage(ImGridEntry *entry, ImGridMoveOptions &opts,
+                             ImGridVector<ImGridEntry *> &collides);
 
 bool GridUseEntireRowArea(ImGridEngine &ctx, ImGridEntry *entry,
                           ImGridPosition new_position);
@@ -180,6 +889,7 @@ bool GridFixCollisions(ImGridEngine &ctx, ImGridEntry *entry,
                        ImGridEntry *collide = NULL,
                        ImGridMoveOptions opts = {});
 
+// Returns true when the entry ended up somewhere else.
 bool GridMoveNode(ImGridEngine &ctx, ImGridEntry *entry,
                   ImGridMoveOptions &opts);
 
@@ -194,16 +904,29 @@ bool GridChangedPosConstrain(ImGridEntry *entry, ImGridPosition &p);
 
 int GridGetRow(ImGridEngine &ctx);
 
+// Returns true when the entry moved, like GridMoveNode().
 bool GridEntryMoveCheck(ImGridEngine &ctx, ImGridEntry *entry,
                         ImGridMoveOptions opts);
 
+// Section [Journal]
+// Starts a speculative move. Until GridCommitMove() or GridRollbackMove()
+// the grid is treated as unbounded (MaxRow 0) and every entry the engine
+// repositions or flags is logged once with its previous move state.
+void GridBeginSpeculativeMove(ImGridEngine &ctx);
+// Keeps the trial positions and drops the log.
+void GridCommitMove(ImGridEngine &ctx);
+// Restores the logged entries in reverse order and drops the log.
+void GridRollbackMove(ImGridEngine &ctx);
+// Logs entry's current move state if a speculative move is running.
+void GridJournalRecord(ImGridEngine &ctx, ImGridEntry *entry);
+
 void GridCleanNodes(ImGridEngine &ctx);
 
 void GridSaveInitial(ImGridEngine &ctx);
 
 void GridBatchUpdate(ImGridEngine &ctx, bool flag = true, bool do_pack = true);
 
-void GridCacheLayout(ImGridEngine &ctx, ImVector<ImGridEntry *> nodes,
+void GridCacheLayout(ImGridEngine &ctx, ImGridVector<ImGridEntry *> nodes,
                      int column, bool clear = false);
 
 void GridCompact(ImGridEngine &ctx,
@@ -214,9 +937,10 @@ void GridColumnChanged(ImGridEngine &ctx, int previous_column, int column,
                        ImGridColumnOptions opts = ImGridColumnOptions{
                            ImGridColumnFlags_MoveScale});
 
-ImVector<ImGridEntry *> GridGetDirtyNodes(ImGridEngine &ctx);
+ImGridVector<ImGridEntry *> GridGetDirtyNodes(ImGridEngine &ctx);
 
-void GridLayoutsNodesChanged(ImGridEngine &ctx, ImVector<ImGridEntry *> &nodes);
+void GridLayoutsNodesChanged(ImGridEngine &ctx,
+                             ImGridVector<ImGridEntry *> &nodes);
 
 void GridTriggerChangeEvent(ImGridEngine &ctx);
 void GridTriggerAddEvent(ImGridEngine &ctx);
@@ -226,7 +950,47 @@ void GridBeginUpdate(ImGridEngine &ctx, ImGridEntry *node);
 void GridEndUpdate(ImGridEngine &ctx);
 
 void GridFindSpace(ImGridEngine &ctx, ImGridEntry *entry,
-                   ImVector<ImGridEntry *> &node_list, int column,
+                   ImGridVector<ImGridEntry *> &node_list, int column,
                    ImGridEntry *after = NULL);
 
+// Section [Async]
+// Runs GridColumnChanged() on a worker thread, on a snapshot of the entries,
+// so a large grid keeps its current layout on screen instead of stalling
+// until the new one is ready. A new request supersedes the one in flight, a
+// repeat of it is ignored and one back to previous_column drops it. The engine
+// does not use ImGui, so the solve can run while an ImGui context is in use;
+// opts.Func runs on the worker too.
+void GridColumnChangedAsync(ImGridEngine &ctx, int previous_column, int column,
+                            ImGridColumnOptions opts = ImGridColumnOptions{
+                                ImGridColumnFlags_MoveScale});
+// Commits a finished solve: positions, entry order, column count and cached
+// layouts. If the entries were added, removed or moved since the snapshot the
+// result is dropped and the request solved again from the current layout.
+// Returns true once committed.
+bool GridAsyncSolvePoll(ImGridEngine &ctx);
+// Stops the solve in flight, e.g. while the user drags. The request is kept
+// and solved again by the next GridAsyncSolvePoll().
+void GridCancelAsyncSolve(ImGridEngine &ctx);
+// Whether a request is waiting to be committed.
+bool GridAsyncSolvePending(const ImGridEngine &ctx);
+// Blocks until the worker is idle. A finished solve still needs
+// GridAsyncSolvePoll().
+void GridAsyncSolveWait(ImGridEngine &ctx);
+
+// Solves the layout of every breakpoint column of opts (and ColumnMax) from
+// the current one, in parallel, into ctx.Precomputed. The first call starts
+// the engine's precompute threads, later calls reuse them. Switching to one of
+// those columns afterwards copies the solved positions instead of solving, for
+// as long as the entries haven't changed.
+void GridPrecomputeLayouts(ImGridEngine &ctx, const ImGridColumnOpts &opts);
+// Whether entries were added, removed or moved, or the column count changed,
+// since the last GridPrecomputeLayouts(), which would then solve again.
+bool GridPrecomputedLayoutsStale(const ImGridEngine &ctx);
+
+inline bool GridSolveCancelled(const ImGridEngine &ctx) {
+  return ctx.CancelGeneration != NULL &&
+         ctx.CancelGeneration->load(std::memory_order_relaxed) !=
+             ctx.SolveGeneration;
+}
+
 } // namespace ImGrid::Engine
@@ -10,10 +10,6 @@
 #include <limits.h>
 #include <map>
 
-#define IM_MIN(x, y) ((x) > (y) ? (y) : (x))
-#define IM_MAX(x, y) ((x) > (y) ? (x) : (y))
-#define IM_CEIL(x) ((float)(int)((x) + 0.999999f))
-
 struct ImGridContext;
 
 // from imgrid_grid_internal.h
@@ -41,6 +37,184 @@ enum ImGridClickInteractionType_ {
 };
 
 // [SECTION] internal data structures
+
+// Array of fixed size chunks whose elements never move once allocated, so
+// pointers to them (like the ImGridEntry pointers held by the engine) stay
+// valid while the array grows. Like ImVector, resize() doesn't construct or
+// destroy elements.
+template <typename T> struct ImStableVector {
+  static const int ChunkShift = 6;
+  static const int ChunkSize = 1 << ChunkShift;
+
+  int Size;
+  ImVector<T *> Chunks;
+  // allocations the chunks are carved from
+  ImVector<void *> Blocks;
+
+  template <typename V, typename U> struct Iterator {
+    V *Vector;
+    int Index;
+
+    U &operator*() const { return (*Vector)[Index]; }
+    Iterator &operator++() {
+      ++Index;
+      return *this;
+    }
+    bool operator!=(const Iterator &rhs) const { return Index != rhs.Index; }
+  };
+  typedef Iterator<ImStableVector, T> iterator;
+  typedef Iterator<const ImStableVector, const T> const_iterator;
+
+  ImStableVector() : Size(0) {}
+  ImStableVector(const ImStableVector &) = delete;
+  ImStableVector &operator=(const ImStableVector &) = delete;
+  ~ImStableVector() {
+    for (void *block : Blocks)
+      IM_FREE(block);
+  }
+
+  inline bool empty() const { return Size == 0; }
+  inline int size() const { return Size; }
+  inline int capacity() const { return Chunks.Size << ChunkShift; }
+
+  inline T &operator[](int i) {
+    IM_ASSERT(i >= 0 && i < Size);
+    return Chunks.Data[i >> ChunkShift][i & (ChunkSize - 1)];
+  }
+  inline const T &operator[](int i) const {
+    IM_ASSERT(i >= 0 && i < Size);
+    return Chunks.Data[i >> ChunkShift][i & (ChunkSize - 1)];
+  }
+
+  inline iterator begin() { return {this, 0}; }
+  inline iterator end() { return {this, Size}; }
+  inline const_iterator begin() const { return {this, 0}; }
+  inline const_iterator end() const { return {this, Size}; }
+
+  // Allocates all missing chunks as one block.
+  void reserve(int new_capacity) {
+    if (new_capacity <= capacity())
+      return;
+    const int new_chunks =
+        ((new_capacity + ChunkSize - 1) >> ChunkShift) - Chunks.Size;
+    T *block = (T *)IM_ALLOC((size_t)new_chunks * ChunkSize * sizeof(T));
+    Blocks.push_back(block);
+    Chunks.reserve(Chunks.Size + new_chunks);
+    for (int i = 0; i < new_chunks; ++i)
+      Chunks.push_back(block + i * ChunkSize);
+  }
+
+  // Grows the capacity by half at a time, so a pool filled one element at a
+  // time ends up with a logarithmic number of blocks.
+  void resize(int new_size) {
+    if (new_size > capacity())
+      reserve(ImMax(new_size, capacity() + capacity() / 2));
+    Size = new_size;
+  }
+};
+
+// Maps object ids to pool indices. Open addressing with linear probing, kept
+// at most half full. Removal shifts the rest of the probe run back instead of
+// leaving tombstones, so lookups stay short however often entries come and go.
+struct ImIdIndexMap {
+  struct Slot {
+    ImGuiID Id;
+    int Index; // -1 = empty slot
+  };
+
+  ImVector<Slot> Slots; // power of two, or empty
+  int Count;
+
+  ImIdIndexMap() : Slots(), Count(0) {}
+
+  // murmur3 finalizer, ids are often small consecutive integers
+  static inline ImU32 Hash(ImGuiID id) {
+    id ^= id >> 16;
+    id *= 0x85ebca6bu;
+    id ^= id >> 13;
+    id *= 0xc2b2ae35u;
+    id ^= id >> 16;
+    return id;
+  }
+
+  inline int GetIndex(const ImGuiID id) const {
+    if (Slots.Size == 0)
+      return -1;
+    const ImU32 mask = (ImU32)Slots.Size - 1;
+    for (ImU32 i = Hash(id) & mask;; i = (i + 1) & mask) {
+      const Slot &slot = Slots.Data[i];
+      if (slot.Index == -1 || slot.Id == id)
+        return slot.Index;
+    }
+  }
+
+  void SetIndex(const ImGuiID id, const int index) {
+    IM_ASSERT(index >= 0);
+    if ((Count + 1) * 2 > Slots.Size)
+      Rehash(ImMax(16, Slots.Size * 2));
+    const ImU32 mask = (ImU32)Slots.Size - 1;
+    ImU32 i = Hash(id) & mask;
+    while (Slots.Data[i].Index != -1 && Slots.Data[i].Id != id)
+      i = (i + 1) & mask;
+    if (Slots.Data[i].Index == -1)
+      Count++;
+    Slots.Data[i].Id = id;
+    Slots.Data[i].Index = index;
+  }
+
+  void Remove(const ImGuiID id) {
+    if (Slots.Size == 0)
+      return;
+    const ImU32 mask = (ImU32)Slots.Size - 1;
+    ImU32 hole = Hash(id) & mask;
+    for (;; hole = (hole + 1) & mask) {
+      if (Slots.Data[hole].Index == -1)
+        return;
+      if (Slots.Data[hole].Id == id)
+        break;
+    }
+    // Pull back every later slot of the run whose home is at or before the
+    // hole, so no lookup stops early at it.
+    for (ImU32 i = (hole + 1) & mask; Slots.Data[i].Index != -1;
+         i = (i + 1) & mask) {
+      const ImU32 home = Hash(Slots.Data[i].Id) & mask;
+      if (((i - home) & mask) >= ((i - hole) & mask)) {
+        Slots.Data[hole] = Slots.Data[i];
+        hole = i;
+      }
+    }
+    Slots.Data[hole].Index = -1;
+    Count--;
+  }
+
+  // Makes room for count ids without rehashing.
+  void Reserve(const int count) {
+    int capacity = 16;
+    while (capacity < count * 2)
+      capacity *= 2;
+    if (capacity > Slots.Size)
+      Rehash(capacity);
+  }
+
+  void Rehash(const int capacity) {
+    IM_ASSERT((capacity & (capacity - 1)) == 0 && capacity >= Count * 2);
+    ImVector<Slot> old_slots;
+    old_slots.swap(Slots);
+    Slots.resize(capacity);
+    for (Slot &slot : Slots)
+      slot.Index = -1;
+    const ImU32 mask = (ImU32)capacity - 1;
+    for (const Slot &slot : old_slots) {
+      if (slot.Index == -1)
+        continue;
+      ImU32 i = Hash(slot.Id) & mask;
+      while (Slots.Data[i].Index != -1)
+        i = (i + 1) & mask;
+      Slots.Data[i] = slot;
+    }
+  }
+};
+
 // from ImNodes
 
 // The object T must have the following interface:
@@ -52,10 +226,10 @@ enum ImGridClickInteractionType_ {
 //     int id;
 // };
 template <typename T> struct ImObjectPool {
-  ImVector<T> Pool;
+  ImStableVector<T> Pool;
   ImVector<bool> InUse;
   ImVector<int> FreeList;
-  ImGuiStorage IdMap;
+  ImIdIndexMap IdMap;
 
   ImObjectPool() : Pool(), InUse(), FreeList(), IdMap() {}
 };
@@ -101,231 +275,6 @@ private:
   int _Index;
 };
 
-using ScreenSpace = float;
-using GridSpace = int;
-
-template <typename UnderlyingType> struct TypedImVec2 {
-  UnderlyingType x, y;
-  constexpr TypedImVec2() : x(), y() {}
-  constexpr TypedImVec2(ImVec2 vec) : x(vec.x), y(vec.y) {}
-  constexpr TypedImVec2(UnderlyingType _x, UnderlyingType _y) : x(_x), y(_y) {}
-  UnderlyingType &operator[](size_t idx) {
-    IM_ASSERT(idx == 0 || idx == 1);
-    return ((UnderlyingType *)(void *)(char *)this)[idx];
-  } // We very rarely use this [] operator, so the assert overhead is fine.
-  UnderlyingType operator[](size_t idx) const {
-    IM_ASSERT(idx == 0 || idx == 1);
-    return ((const UnderlyingType *)(const void *)(const char *)this)[idx];
-  }
-  // conversion to ImVec2
-  operator ImVec2() const { return ImVec2(x, y); }
-};
-
-template <typename UnderlyingType>
-static inline TypedImVec2<UnderlyingType>
-operator*(const TypedImVec2<UnderlyingType> &lhs, const UnderlyingType rhs) {
-  return TypedImVec2<UnderlyingType>(lhs.x * rhs, lhs.y * rhs);
-}
-
-template <typename UnderlyingType>
-static inline TypedImVec2<UnderlyingType>
-operator/(const TypedImVec2<UnderlyingType> &lhs, const UnderlyingType rhs) {
-  return TypedImVec2<UnderlyingType>(lhs.x / rhs, lhs.y / rhs);
-}
-template <typename UnderlyingType>
-static inline TypedImVec2<UnderlyingType>
-operator+(const TypedImVec2<UnderlyingType> &lhs,
-          const TypedImVec2<UnderlyingType> &rhs) {
-  return TypedImVec2<UnderlyingType>(lhs.x + rhs.x, lhs.y + rhs.y);
-}
-template <typename UnderlyingType>
-static inline TypedImVec2<UnderlyingType>
-operator-(const TypedImVec2<UnderlyingType> &lhs,
-          const TypedImVec2<UnderlyingType> &rhs) {
-  return TypedImVec2<UnderlyingType>(lhs.x - rhs.x, lhs.y - rhs.y);
-}
-template <typename UnderlyingType>
-static inline TypedImVec2<UnderlyingType>
-operator*(const TypedImVec2<UnderlyingType> &lhs,
-          const TypedImVec2<UnderlyingType> &rhs) {
-  return TypedImVec2<UnderlyingType>(lhs.x * rhs.x, lhs.y * rhs.y);
-}
-template <typename UnderlyingType>
-static inline TypedImVec2<UnderlyingType>
-operator/(const TypedImVec2<UnderlyingType> &lhs,
-          const TypedImVec2<UnderlyingType> &rhs) {
-  return TypedImVec2<UnderlyingType>(lhs.x / rhs.x, lhs.y / rhs.y);
-}
-template <typename UnderlyingType>
-static inline TypedImVec2<UnderlyingType>
-operator-(const TypedImVec2<UnderlyingType> &lhs) {
-  return TypedImVec2<UnderlyingType>(-lhs.x, -lhs.y);
-}
-template <typename UnderlyingType>
-static inline TypedImVec2<UnderlyingType> &
-operator*=(TypedImVec2<UnderlyingType> &lhs, const UnderlyingType rhs) {
-  lhs.x *= rhs;
-  lhs.y *= rhs;
-  return lhs;
-}
-template <typename UnderlyingType>
-static inline TypedImVec2<UnderlyingType> &
-operator/=(TypedImVec2<UnderlyingType> &lhs, const UnderlyingType rhs) {
-  lhs.x /= rhs;
-  lhs.y /= rhs;
-  return lhs;
-}
-template <typename UnderlyingType>
-static inline TypedImVec2<UnderlyingType> &
-operator+=(TypedImVec2<UnderlyingType> &lhs,
-           const TypedImVec2<UnderlyingType> &rhs) {
-  lhs.x += rhs.x;
-  lhs.y += rhs.y;
-  return lhs;
-}
-template <typename UnderlyingType>
-static inline TypedImVec2<UnderlyingType> &
-operator-=(TypedImVec2<UnderlyingType> &lhs,
-           const TypedImVec2<UnderlyingType> &rhs) {
-  lhs.x -= rhs.x;
-  lhs.y -= rhs.y;
-  return lhs;
-}
-template <typename UnderlyingType>
-static inline TypedImVec2<UnderlyingType> &
-operator*=(TypedImVec2<UnderlyingType> &lhs,
-           const TypedImVec2<UnderlyingType> &rhs) {
-  lhs.x *= rhs.x;
-  lhs.y *= rhs.y;
-  return lhs;
-}
-template <typename UnderlyingType>
-static inline TypedImVec2<UnderlyingType> &
-operator/=(TypedImVec2<UnderlyingType> &lhs,
-           const TypedImVec2<UnderlyingType> &rhs) {
-  lhs.x /= rhs.x;
-  lhs.y /= rhs.y;
-  return lhs;
-}
-template <typename UnderlyingType>
-static inline bool operator==(const TypedImVec2<UnderlyingType> &lhs,
-                              const TypedImVec2<UnderlyingType> &rhs) {
-  return lhs.x == rhs.x && lhs.y == rhs.y;
-}
-template <typename UnderlyingType>
-static inline bool operator!=(const TypedImVec2<UnderlyingType> &lhs,
-                              const TypedImVec2<UnderlyingType> &rhs) {
-  return lhs.x != rhs.x || lhs.y != rhs.y;
-}
-
-template <typename Vec2DType> struct TypedImRect {
-  Vec2DType Min; // Upper-left
-  Vec2DType Max; // Lower-right
-
-  constexpr TypedImRect() : Min(0.0f, 0.0f), Max(0.0f, 0.0f) {}
-  constexpr TypedImRect(const Vec2DType &min, const Vec2DType &max)
-      : Min(min), Max(max) {}
-  constexpr TypedImRect(const ImVec4 &v) : Min(v.x, v.y), Max(v.z, v.w) {}
-  constexpr TypedImRect(float x1, float y1, float x2, float y2)
-      : Min(x1, y1), Max(x2, y2) {}
-
-  Vec2DType GetCenter() const {
-    return Vec2DType((Min.x + Max.x) * 0.5f, (Min.y + Max.y) * 0.5f);
-  }
-  Vec2DType GetSize() const { return Vec2DType(Max.x - Min.x, Max.y - Min.y); }
-  float GetWidth() const { return Max.x - Min.x; }
-  float GetHeight() const { return Max.y - Min.y; }
-  float GetArea() const { return (Max.x - Min.x) * (Max.y - Min.y); }
-  Vec2DType GetTL() const { return Min; }                     // Top-left
-  Vec2DType GetTR() const { return Vec2DType(Max.x, Min.y); } // Top-right
-  Vec2DType GetBL() const { return Vec2DType(Min.x, Max.y); } // Bottom-left
-  Vec2DType GetBR() const { return Max; }                     // Bottom-right
-  bool Contains(const Vec2DType &p) const {
-    return p.x >= Min.x && p.y >= Min.y && p.x < Max.x && p.y < Max.y;
-  }
-  bool Contains(const TypedImRect<Vec2DType> &r) const {
-    return r.Min.x >= Min.x && r.Min.y >= Min.y && r.Max.x <= Max.x &&
-           r.Max.y <= Max.y;
-  }
-  bool ContainsWithPad(const Vec2DType &p, const Vec2DType &pad) const {
-    return p.x >= Min.x - pad.x && p.y >= Min.y - pad.y &&
-           p.x < Max.x + pad.x && p.y < Max.y + pad.y;
-  }
-  bool Overlaps(const TypedImRect<Vec2DType> &r) const {
-    return r.Min.y < Max.y && r.Max.y > Min.y && r.Min.x < Max.x &&
-           r.Max.x > Min.x;
-  }
-  void Add(const Vec2DType &p) {
-    if (Min.x > p.x)
-      Min.x = p.x;
-    if (Min.y > p.y)
-      Min.y = p.y;
-    if (Max.x < p.x)
-      Max.x = p.x;
-    if (Max.y < p.y)
-      Max.y = p.y;
-  }
-  void Add(const TypedImRect<Vec2DType> &r) {
-    if (Min.x > r.Min.x)
-      Min.x = r.Min.x;
-    if (Min.y > r.Min.y)
-      Min.y = r.Min.y;
-    if (Max.x < r.Max.x)
-      Max.x = r.Max.x;
-    if (Max.y < r.Max.y)
-      Max.y = r.Max.y;
-  }
-  void Expand(const float amount) {
-    Min.x -= amount;
-    Min.y -= amount;
-    Max.x += amount;
-    Max.y += amount;
-  }
-  void Expand(const Vec2DType &amount) {
-    Min.x -= amount.x;
-    Min.y -= amount.y;
-    Max.x += amount.x;
-    Max.y += amount.y;
-  }
-  void Translate(const Vec2DType &d) {
-    Min.x += d.x;
-    Min.y += d.y;
-    Max.x += d.x;
-    Max.y += d.y;
-  }
-  void TranslateX(float dx) {
-    Min.x += dx;
-    Max.x += dx;
-  }
-  void TranslateY(float dy) {
-    Min.y += dy;
-    Max.y += dy;
-  }
-  void ClipWith(const TypedImRect<Vec2DType> &r) {
-    Min = ImMax(Min, r.Min);
-    Max = ImMin(Max, r.Max);
-  } // Simple version, may lead to an inverted rectangle, which is fine for
-    // Contains/Overlaps test but not for display.
-  void ClipWithFull(const TypedImRect<Vec2DType> &r) {
-    Min = ImClamp(Min, r.Min, r.Max);
-    Max = ImClamp(Max, r.Min, r.Max);
-  } // Full version, ensure both points are fully clipped.
-  void Floor() {
-    Min.x = IM_TRUNC(Min.x);
-    Min.y = IM_TRUNC(Min.y);
-    Max.x = IM_TRUNC(Max.x);
-    Max.y = IM_TRUNC(Max.y);
-  }
-  bool IsInverted() const { return Min.x > Max.x || Min.y > Max.y; }
-  ImVec4 ToVec4() const { return ImVec4(Min.x, Min.y, Max.x, Max.y); }
-};
-
-using ScreenSpacePosition = TypedImVec2<ScreenSpace>;
-using ScreenSpaceRect = TypedImRect<ScreenSpacePosition>;
-
-using GridSpacePosition = TypedImVec2<GridSpace>;
-using GridSpaceRect = TypedImRect<GridSpacePosition>;
-
 struct ImGridClickInteractionState {
 
   ImGridClickInteractionType Type;
@@ -337,66 +286,6 @@ struct ImGridClickInteractionState {
   ImGridClickInteractionState() : Type(ImGridClickInteractionType_None) {}
 };
 
-struct ImGridEntry {
-  int Id;
-
-  // GRID VALUES
-  ImGridPosition Position;
-  ImGridEngine *ParentContext;
-
-  bool AutoPosition;
-  float MinW, MinH;
-  float MaxW, MaxH;
-  bool NoResize;
-  bool NoMove;
-  bool Locked;
-  bool Resizable;
-
-  bool AutoSize;
-
-  bool Dirty;
-  bool Updating;
-  bool SkipDown;
-  ImGridPosition PrevPosition;
-  ImGridPosition Rect;
-  ScreenSpacePosition LastUIPosition;
-  ImGridPosition LastTried;
-  ImGridPosition WillFitPos;
-
-  // if Moving, use the moving position since we should drag smoothly, not in
-  // grid steps
-  ScreenSpacePosition MovingPosition;
-  bool Moving;
-
-  // if HasPreview, we render another rect at the PreviewPosition to show where
-  // this node will snap to if it is dropped
-  ScreenSpacePosition PreviewPosition;
-  bool HasPreview;
-
-  bool BorderHovered;
-  bool BorderHeld;
-
-  ScreenSpacePosition MoveMouseOffsetRel;
-
-  struct {
-    ImU32 Background, BackgroundHovered, BackgroundSelected, Outline, Titlebar,
-        TitlebarHovered, TitlebarSelected, PreviewFill, PreviewOutline;
-  } ColorStyle;
-
-  struct {
-    float CornerRounding;
-    ImVec2 Padding;
-    float BorderThickness;
-  } LayoutStyle;
-
-  // Position is in integer grid coordinates, so we need to get
-
-  ImGridEntry(const int id, ImGridPosition ps);
-  ImGridEntry(const int id);
-  ImGridEntry(ImGridPosition pos);
-  ~ImGridEntry() { Id = INT_MIN; }
-};
-
 struct ImGridColElement {
   ImU32 Color;
   ImGridCol Item;
@@ -420,6 +309,105 @@ struct ImGridStyleVarElement {
   }
 };
 
+// Uniform grid over the screen rects of the entries in use, so hover
+// resolution and box selection only test the entries in the buckets they
+// touch. Buckets are stored back to back: bucket i holds
+// Items[BucketStart[i] .. BucketStart[i + 1]).
+//
+// Built lazily once per frame, and again if entries were inserted or the
+// canvas was panned or zoomed since.
+struct ImGridEntryBuckets {
+  ScreenSpacePosition Origin;
+  float BucketSize;
+  int Columns;
+  int Rows;
+  ImVector<int> BucketStart;
+  ImVector<int> Items;
+  ImVector<int> BucketFill;
+
+  // indexed by entry idx, inverted for entries that aren't indexed
+  ImVector<ScreenSpaceRect> EntryRects;
+  // indexed by entry idx, to visit entries spanning several buckets once
+  ImVector<int> QueryStamp;
+  int QueryEpoch;
+
+  bool Valid;
+  ScreenSpacePosition BuiltPanning;
+  float BuiltZoom;
+
+  ImGridEntryBuckets()
+      : Origin(), BucketSize(0.f), Columns(0), Rows(0), QueryEpoch(0),
+        Valid(false), BuiltPanning(), BuiltZoom(0.f) {}
+};
+
+struct ImGridDrawCacheCmd {
+  ImVec4 ClipRect;
+  ImTextureID TextureId;
+  int VtxCount;
+  int IdxCount;
+};
+
+// Draw commands copied out of a draw list, replayed translated by
+// DrawCacheReplay(). Each command owns the next VtxCount vertices and
+// IdxCount indices, its indices count from its first vertex.
+struct ImGridDrawCache {
+  ImVector<ImDrawVert> VtxBuffer;
+  ImVector<ImDrawIdx> IdxBuffer;
+  ImVector<ImGridDrawCacheCmd> CmdBuffer;
+  ScreenSpacePosition Origin; // entry rect min when captured
+  bool Valid;
+
+  ImGridDrawCache() : Origin(), Valid(false) {}
+};
+
+// The captured drawing of an ImGridEntryFlags_Retained entry and what it was
+// drawn with. Kept while the entry is submitted with the flag, culled or not.
+struct ImGridRetainedEntry {
+  int Id;
+  ImGuiID ContentHash;
+  ImVec2 Size; // entry screen size, follows resizes and zoom
+  float Zoom;
+  bool Selected;
+  // the content was replayed this frame, DrawEntry() replays the background
+  bool Replayed;
+  ImU32 BackgroundColor;
+  ImU32 OutlineColor;
+
+  ImGridDrawCache Background; // DrawEntry() shapes
+  ImGridDrawCache Content;    // the entry's child window
+
+  ImGridRetainedEntry(const int id)
+      : Id(id), ContentHash(0), Size(), Zoom(0.f), Selected(false),
+        Replayed(false), BackgroundColor(0), OutlineColor(0) {}
+};
+
+// Append-only log of the entries changed since the last full snapshot, see
+// OpenGridStateJournal(). Each engine change event appends one block holding
+// just the dirty entries; once the log outgrows CompactThreshold records it is
+// folded into a new snapshot and started over.
+struct ImGridStateJournal {
+  FILE *File;
+  char *FileName;
+  char *SnapshotFileName;
+  // scratch for the block being appended
+  ImVector<char> Block;
+  int RecordCount;
+  // 0 = compact once the log holds more records than there are live entries
+  int CompactThreshold;
+  // checksum of the snapshot the log applies on top of
+  ImU32 SnapshotChecksum;
+
+  ImGridStateJournal()
+      : File(NULL), FileName(NULL), SnapshotFileName(NULL), RecordCount(0),
+        CompactThreshold(0), SnapshotChecksum(0) {}
+  ~ImGridStateJournal() {
+    if (File != NULL)
+      fclose(File);
+    IM_FREE(FileName);
+    IM_FREE(SnapshotFileName);
+  }
+};
+
 struct ImGridContext {
   ImObjectPool<ImGridEntry> Entries;
 
@@ -441,10 +429,18 @@ struct ImGridContext {
 
   ImGuiStorage EntryIdxToSubmissionIdx;
   ImVector<int> EntryIdxSubmissionOrder;
+  ImGridEntryBuckets EntryBuckets;
   ImVector<int> EntryIndicesOverlappingWithMouse;
   ImVector<int> EntryTitleBarIndicesOverlappingWithMouse;
 
   ImVector<int> EntryDepthOrder;
+  // inverse of EntryDepthOrder, indexed by entry idx
+  ImVector<int> EntryDepthRank;
+  // EntryDepthOrder without the entries culled this frame, only filled when
+  // CulledEntryCount > 0
+  ImVector<int> VisibleEntryDepthOrder;
+  // scratch for DrawListSortChannelsByDepth()
+  ImVector<int> DepthSortSource;
 
   ImVector<int> SelectedEntryIndices;
   // Relative origins of selected nodes for snapping of dragged nodes
@@ -460,6 +456,16 @@ struct ImGridContext {
   ImVector<ImGridStyleVarElement> StyleModifierStack;
 
   int CurrentEntryIdx;
+  // false when the current entry is outside CanvasRectScreenSpace and only
+  // its layout is kept, see BeginEntry()
+  bool CurrentEntryVisible;
+  int CulledEntryCount;
+
+  // keyed by entry id, for the entries submitted with
+  // ImGridEntryFlags_Retained this frame
+  ImObjectPool<ImGridRetainedEntry> RetainedEntries;
+  // index in RetainedEntries of the current entry, -1 if it isn't retained
+  int CurrentRetainedIdx;
 
   ImOptionalIndex HoveredEntryIdx;
   ImOptionalIndex HoveredEntryTitleBarIdx;
@@ -477,6 +483,34 @@ struct ImGridContext {
   float GridHeight;
 
   ImGridEngine *Engine;
+  // set by PrecomputeColumnLayouts(), EndGrid() then solves the breakpoint
+  // layouts again once they went stale
+  bool PrecomputeLayouts;
+  // scratch for the entries EndGrid() adds to the engine this frame
+  ImVector<ImGridEntry *> NewEntries;
+
+  // column count and layout cache read by LoadGridStateFrom*() before the
+  // engine exists, handed over by InitializeEngine()
+  int PendingColumn;
+  std::map<int, ImGridVector<ImGridEntry>> PendingCacheLayouts;
+
+  // output of the SaveGridStateTo*() functions, which take a const context
+  mutable ImGuiTextBuffer TextBuffer;
+  mutable ImVector<char> SnapshotBuffer;
+
+  ImGridStateJournal StateJournal;
+
+  // see SetEntriesRemovedCallback(), RemovedIds is the scratch for its ids
+  ImGridEntriesRemovedFunc EntriesRemovedFunc;
+  void *EntriesRemovedUserData;
+  ImVector<int> RemovedIds;
+
+  // stats of the frame in progress, moved into FrameStatsHistory (a ring of
+  // recent frames for RenderDebug()) by EndGrid()
+  ImGridFrameStats FrameStats;
+  ImVector<ImGridFrameStats> FrameStatsHistory;
+  int FrameStatsHistoryIdx; // next slot to overwrite
+  double EntryStartTime;    // of the current BeginEntry()
 };
 
 namespace ImGrid {
@@ -492,7 +526,7 @@ static inline ImGridContext &Context() {
 
 template <typename T>
 static inline int ObjectPoolFind(const ImObjectPool<T> &objects, const int id) {
-  const int index = objects.IdMap.GetInt(static_cast<ImGuiID>(id), -1);
+  const int index = objects.IdMap.GetIndex(static_cast<ImGuiID>(id));
   return index;
 }
 
@@ -501,20 +535,36 @@ static inline void ObjectPoolUpdate(ImObjectPool<T> &objects) {
   for (int i = 0; i < objects.InUse.size(); ++i) {
     const int id = objects.Pool[i].Id;
 
-    if (!objects.InUse[i] && objects.IdMap.GetInt(id, -1) == i) {
-      objects.IdMap.SetInt(id, -1);
+    if (!objects.InUse[i] && objects.IdMap.GetIndex(id) == i) {
+      objects.IdMap.Remove(id);
       objects.FreeList.push_back(i);
-      (objects.Pool.Data + i)->~T();
+      objects.Pool[i].~T();
     }
   }
 }
 
 template <> inline void ObjectPoolUpdate(ImObjectPool<ImGridEntry> &nodes) {
+  // Take the entries that stopped being submitted out of the engine as one
+  // batch, so the grid packs and sends its events once for all of them
+  bool batch = false;
+  for (int i = 0; i < nodes.InUse.size(); ++i) {
+    ImGridEntry &node = nodes.Pool[i];
+    if (!nodes.InUse[i] && nodes.IdMap.GetIndex(node.Id) == i &&
+        node.ParentContext != NULL) {
+      if (!batch)
+        BatchUpdate(GImGrid);
+      batch = true;
+      RemoveWidget(GImGrid, &node);
+    }
+  }
+  if (batch)
+    BatchUpdate(GImGrid, false);
+
   for (int i = 0; i < nodes.InUse.size(); ++i) {
     if (!nodes.InUse[i]) {
       const int id = nodes.Pool[i].Id;
 
-      if (nodes.IdMap.GetInt(id, -1) == i) {
+      if (nodes.IdMap.GetIndex(id) == i) {
         // Remove node idx form depth stack the first time we detect that this
         // idx slot is unused
         ImVector<int> &depth_stack = GImGrid->EntryDepthOrder;
@@ -522,9 +572,14 @@ template <> inline void ObjectPoolUpdate(ImObjectPool<ImGridEntry> &nodes) {
         IM_ASSERT(elem != depth_stack.end());
         depth_stack.erase(elem);
 
-        nodes.IdMap.SetInt(id, -1);
+        ImGridEntry &node = nodes.Pool[i];
+        // the batch's remove event has resolved the handle by now
+        if (batch)
+          Engine::GridReleaseHandle(*GImGrid->Engine, &node);
+
+        nodes.IdMap.Remove(id);
         nodes.FreeList.push_back(i);
-        (nodes.Pool.Data + i)->~ImGridEntry();
+        node.~ImGridEntry();
       }
     }
   }
@@ -537,10 +592,21 @@ static inline void ObjectPoolReset(ImObjectPool<T> &objects) {
   }
 }
 
+// Destroys the objects still alive, for DestroyContext(). Outside of a frame
+// those are exactly the ones in use, ObjectPoolUpdate() destroyed the rest.
+// The pool storage itself is released by its destructor.
+template <typename T>
+static inline void ObjectPoolClear(ImObjectPool<T> &objects) {
+  for (int i = 0; i < objects.InUse.size(); ++i) {
+    if (objects.InUse[i])
+      objects.Pool[i].~T();
+  }
+}
+
 template <typename T>
 static inline int ObjectPoolFindOrCreateIndex(ImObjectPool<T> &objects,
                                               const int id) {
-  int index = objects.IdMap.GetInt(static_cast<ImGuiID>(id), -1);
+  int index = objects.IdMap.GetIndex(static_cast<ImGuiID>(id));
 
   // Construct new object
   if (index == -1) {
@@ -554,8 +620,8 @@ static inline int ObjectPoolFindOrCreateIndex(ImObjectPool<T> &objects,
       index = objects.FreeList.back();
       objects.FreeList.pop_back();
     }
-    IM_PLACEMENT_NEW(objects.Pool.Data + index) T(id);
-    objects.IdMap.SetInt(static_cast<ImGuiID>(id), index);
+    IM_PLACEMENT_NEW(&objects.Pool[index]) T(id);
+    objects.IdMap.SetIndex(static_cast<ImGuiID>(id), index);
   }
 
   // Flag it as used
@@ -567,7 +633,7 @@ static inline int ObjectPoolFindOrCreateIndex(ImObjectPool<T> &objects,
 template <>
 inline int ObjectPoolFindOrCreateIndex(ImObjectPool<ImGridEntry> &nodes,
                                        const int node_id) {
-  int node_idx = nodes.IdMap.GetInt(static_cast<ImGuiID>(node_id), -1);
+  int node_idx = nodes.IdMap.GetIndex(static_cast<ImGuiID>(node_id));
 
   // Construct new node
   if (node_idx == -1) {
@@ -581,8 +647,8 @@ inline int ObjectPoolFindOrCreateIndex(ImObjectPool<ImGridEntry> &nodes,
       node_idx = nodes.FreeList.back();
       nodes.FreeList.pop_back();
     }
-    IM_PLACEMENT_NEW(nodes.Pool.Data + node_idx) ImGridEntry(node_id);
-    nodes.IdMap.SetInt(static_cast<ImGuiID>(node_id), node_idx);
+    IM_PLACEMENT_NEW(&nodes.Pool[node_idx]) ImGridEntry(node_id);
+    nodes.IdMap.SetIndex(static_cast<ImGuiID>(node_id), node_idx);
 
     GImGrid->EntryDepthOrder.push_back(node_idx);
   }
@@ -593,6 +659,25 @@ inline int ObjectPoolFindOrCreateIndex(ImObjectPool<ImGridEntry> &nodes,
   return node_idx;
 }
 
+// Makes room for count objects in total, so creating them doesn't grow the
+// pool, the id map or the depth order one object at a time.
+template <typename T>
+static inline void ObjectPoolReserve(ImObjectPool<T> &objects,
+                                     const int count) {
+  objects.Pool.reserve(count);
+  objects.InUse.reserve(count);
+  objects.IdMap.Reserve(count);
+}
+
+template <>
+inline void ObjectPoolReserve(ImObjectPool<ImGridEntry> &nodes,
+                              const int count) {
+  nodes.Pool.reserve(count);
+  nodes.InUse.reserve(count);
+  nodes.IdMap.Reserve(count);
+  GImGrid->EntryDepthOrder.reserve(count);
+}
+
 template <typename T>
 static inline T &ObjectPoolFindOrCreateObject(ImObjectPool<T> &objects,
                                               const int id) {
@@ -658,6 +743,15 @@ static inline ScreenSpaceRect GetNodeScreenRect(const ImGridContext &ctx,
   return ScreenSpaceRect(min_screen_pos, max_screen_pos);
 }
 
+// Entries that are not in the engine yet have no position, they are always
+// submitted so their content size can be measured.
+static inline bool IsEntryInsideCanvas(const ImGridContext &ctx,
+                                       const ImGridEntry &entry) {
+  if (entry.ParentContext == NULL || entry.Moving)
+    return true;
+  return GetNodeScreenRect(ctx, entry).Overlaps(ctx.CanvasRectScreenSpace);
+}
+
 static inline void UpdateNodeGridSpaceSize(ImGridContext &ctx,
                                            ImGridEntry &entry,
                                            float width_pixels,
@@ -0,0 +1,340 @@
+#pragma once
+
+// Types shared by the layout engine and the ImGui layer. Only ImGui's config
+// is read (IMGUI_USER_CONFIG or imconfig.h, when on the include path) for
+// IM_ASSERT, so the engine builds and runs without ImGui.
+#ifdef IMGUI_USER_CONFIG
+#include IMGUI_USER_CONFIG
+#endif
+#if __has_include("imconfig.h")
+#include "imconfig.h"
+#endif
+#ifndef IM_ASSERT
+#include <assert.h>
+#define IM_ASSERT(_EXPR) assert(_EXPR)
+#endif
+
+#include <functional>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+// the scalar types of imgui.h, which may be included before or after this
+typedef unsigned char ImU8;
+typedef signed short ImS16;
+typedef unsigned short ImU16;
+typedef unsigned int ImU32;
+typedef unsigned long long ImU64;
+
+typedef int ImGridColumnFlags; // -> emum ImGridColumnFlags_
+
+enum ImGridColumnFlags_ {
+  ImGridColumnFlags_None = 0,
+  ImGridColumnFlags_MoveScale = 1 << 0,
+  ImGridColumnFlags_Compact = 1 << 1,
+  ImGridColumnFlags_List = 1 << 2,
+  ImGridColumnFlags_Scale = 1 << 3,
+  ImGridColumnFlags_Move = 1 << 4,
+};
+
+struct ImGridEntry;
+
+// Compact reference to an entry added to an engine: the slot index in
+// ImGridEngine::Handles in the low bits and the slot's generation in the high
+// bits. Releasing a slot bumps its generation, so a handle kept past its
+// entry's removal resolves to NULL instead of to whatever reuses the slot.
+// 0 is never a valid handle.
+typedef ImU32 ImGridEntryHandle;
+
+// ImVector with the same interface and semantics (trivially copyable T, no
+// constructors or destructors run), allocating with malloc()/free() instead of
+// ImGui::MemAlloc()/MemFree(). The engine's containers use it, so the engine
+// needs no ImGui context and layouts can be solved on threads of their own
+// while one is in use.
+template <typename T> struct ImGridVector {
+  int Size;
+  int Capacity;
+  T *Data;
+
+  typedef T value_type;
+  typedef value_type *iterator;
+  typedef const value_type *const_iterator;
+
+  ImGridVector() : Size(0), Capacity(0), Data(NULL) {}
+  ImGridVector(const ImGridVector<T> &src) : Size(0), Capacity(0), Data(NULL) {
+    operator=(src);
+  }
+  ImGridVector<T> &operator=(const ImGridVector<T> &src) {
+    clear();
+    resize(src.Size);
+    if (src.Data)
+      memcpy((void *)Data, (const void *)src.Data, (size_t)Size * sizeof(T));
+    return *this;
+  }
+  ~ImGridVector() { free(Data); }
+
+  void clear() {
+    free(Data);
+    Size = Capacity = 0;
+    Data = NULL;
+  }
+
+  bool empty() const { return Size == 0; }
+  int size() const { return Size; }
+  int size_in_bytes() const { return Size * (int)sizeof(T); }
+  int capacity() const { return Capacity; }
+  T &operator[](int i) {
+    IM_ASSERT(i >= 0 && i < Size);
+    return Data[i];
+  }
+  const T &operator[](int i) const {
+    IM_ASSERT(i >= 0 && i < Size);
+    return Data[i];
+  }
+
+  T *begin() { return Data; }
+  const T *begin() const { return Data; }
+  T *end() { return Data + Size; }
+  const T *end() const { return Data + Size; }
+  T &front() {
+    IM_ASSERT(Size > 0);
+    return Data[0];
+  }
+  const T &front() const {
+    IM_ASSERT(Size > 0);
+    return Data[0];
+  }
+  T &back() {
+    IM_ASSERT(Size > 0);
+    return Data[Size - 1];
+  }
+  const T &back() const {
+    IM_ASSERT(Size > 0);
+    return Data[Size - 1];
+  }
+  void swap(ImGridVector<T> &rhs) {
+    const int rhs_size = rhs.Size;
+    const int rhs_capacity = rhs.Capacity;
+    T *rhs_data = rhs.Data;
+    rhs.Size = Size;
+    rhs.Capacity = Capacity;
+    rhs.Data = Data;
+    Size = rhs_size;
+    Capacity = rhs_capacity;
+    Data = rhs_data;
+  }
+
+  int _grow_capacity(int sz) const {
+    const int new_capacity = Capacity ? (Capacity + Capacity / 2) : 8;
+    return new_capacity > sz ? new_capacity : sz;
+  }
+  void resize(int new_size) {
+    if (new_size > Capacity)
+      reserve(_grow_capacity(new_size));
+    Size = new_size;
+  }
+  void resize(int new_size, const T &v) {
+    if (new_size > Capacity)
+      reserve(_grow_capacity(new_size));
+    for (int n = Size; n < new_size; n++)
+      memcpy((void *)&Data[n], (const void *)&v, sizeof(v));
+    Size = new_size;
+  }
+  void shrink(int new_size) {
+    IM_ASSERT(new_size <= Size);
+    Size = new_size;
+  }
+  void reserve(int new_capacity) {
+    if (new_capacity <= Capacity)
+      return;
+    T *new_data = (T *)malloc((size_t)new_capacity * sizeof(T));
+    IM_ASSERT(new_data != NULL);
+    if (Data) {
+      memcpy((void *)new_data, (const void *)Data, (size_t)Size * sizeof(T));
+      free(Data);
+    }
+    Data = new_data;
+    Capacity = new_capacity;
+  }
+
+  // as with ImVector, v must not point into the vector itself
+  void push_back(const T &v) {
+    if (Size == Capacity)
+      reserve(_grow_capacity(Size + 1));
+    memcpy((void *)&Data[Size], (const void *)&v, sizeof(v));
+    Size++;
+  }
+  void pop_back() {
+    IM_ASSERT(Size > 0);
+    Size--;
+  }
+  void push_front(const T &v) {
+    if (Size == 0)
+      push_back(v);
+    else
+      insert(Data, v);
+  }
+  T *erase(const T *it) { return erase(it, it + 1); }
+  T *erase(const T *it, const T *it_last) {
+    IM_ASSERT(it >= Data && it < Data + Size && it_last >= it &&
+              it_last <= Data + Size);
+    const ptrdiff_t count = it_last - it;
+    const ptrdiff_t off = it - Data;
+    memmove((void *)(Data + off), (const void *)(Data + off + count),
+            ((size_t)Size - (size_t)off - (size_t)count) * sizeof(T));
+    Size -= (int)count;
+    return Data + off;
+  }
+  T *erase_unsorted(const T *it) {
+    IM_ASSERT(it >= Data && it < Data + Size);
+    const ptrdiff_t off = it - Data;
+    if (it < Data + Size - 1)
+      memcpy((void *)(Data + off), (const void *)(Data + Size - 1), sizeof(T));
+    Size--;
+    return Data + off;
+  }
+  T *insert(const T *it, const T &v) {
+    IM_ASSERT(it >= Data && it <= Data + Size);
+    const ptrdiff_t off = it - Data;
+    if (Size == Capacity)
+      reserve(_grow_capacity(Size + 1));
+    if (off < (int)Size)
+      memmove((void *)(Data + off + 1), (const void *)(Data + off),
+              ((size_t)Size - (size_t)off) * sizeof(T));
+    memcpy((void *)&Data[off], (const void *)&v, sizeof(v));
+    Size++;
+    return Data + off;
+  }
+  bool contains(const T &v) const { return find(v) != end(); }
+  T *find(const T &v) {
+    T *data = Data;
+    while (data < Data + Size && !(*data == v))
+      ++data;
+    return data;
+  }
+  const T *find(const T &v) const {
+    const T *data = Data;
+    while (data < Data + Size && !(*data == v))
+      ++data;
+    return data;
+  }
+  int find_index(const T &v) const {
+    const T *it = find(v);
+    return it == end() ? -1 : (int)(it - Data);
+  }
+  bool find_erase(const T &v) {
+    const T *it = find(v);
+    if (it == end())
+      return false;
+    erase(it);
+    return true;
+  }
+  bool find_erase_unsorted(const T &v) {
+    const T *it = find(v);
+    if (it == end())
+      return false;
+    erase_unsorted(it);
+    return true;
+  }
+  int index_from_ptr(const T *it) const {
+    IM_ASSERT(it >= Data && it < Data + Size);
+    return (int)(it - Data);
+  }
+};
+
+struct ImGridPosition {
+  float x, y, w, h;
+
+  void Reset() { x = y = w = h = -1; };
+  bool Valid() const { return x != -1 && y != -1; }
+  void SetDefault(const ImGridPosition &defaults) {
+    if (x == -1)
+      x = defaults.x;
+    if (y == -1)
+      y = defaults.y;
+    if (w == -1)
+      w = defaults.w;
+    if (h == -1)
+      h = defaults.h;
+  }
+
+  ImGridPosition() : x(-1), y(-1), w(-1), h(-1) {}
+  ImGridPosition(float _x, float _y, float _w, float _h)
+      : x(_x), y(_y), w(_w), h(_h) {}
+
+  operator bool() const { return (x != -1 && y != -1 && w != -1 && h != -1); }
+};
+
+inline bool operator==(const ImGridPosition &lhs, const ImGridPosition &rhs) {
+  return (lhs.x == rhs.x) && (lhs.y == rhs.y) &&
+         ((lhs.w != -1 ? lhs.w : 1) == (rhs.w != -1 ? rhs.w : 1)) &&
+         ((lhs.h != -1 ? lhs.h : 1) == (rhs.h != -1 ? rhs.h : 1));
+}
+
+struct ImGridColumnOptions {
+  ImGridColumnFlags Flags;
+  // Positions the entries without a cached layout for the new column count
+  // instead of Flags: (column, previous_column, cached, uncached). The lists
+  // are copies, entries stay where it puts them. Runs on the thread solving
+  // the change, the worker for GridColumnChangedAsync().
+  std::function<void(int, int, ImGridVector<ImGridEntry *>,
+                     ImGridVector<ImGridEntry *>)>
+      Func;
+  ImGridColumnOptions(ImGridColumnFlags flags) : Flags(flags), Func() {}
+};
+
+struct ImGridMoveOptions {
+  ImGridPosition Position;
+  float MinW, MinH;
+  float MaxW, MaxH;
+
+  ImGridEntryHandle Skip; // 0 for none
+  bool Pack;
+  bool Nested;
+
+  int CellWidth;
+  int CellHeight;
+
+  int MarginTop;
+  int MarginBottom;
+  int MarginLeft;
+  int MarginRight;
+
+  ImGridPosition Rect;
+
+  bool Resizing;
+
+  ImGridEntryHandle Collide; // set by the collision checks, 0 for none
+
+  bool ForceCollide;
+
+  ImGridMoveOptions()
+      : Position(), MinW(-1), MinH(-1), MaxW(-1), MaxH(-1), Skip(0),
+        Pack(false), Nested(false), CellWidth(0), CellHeight(0), MarginTop(0),
+        MarginBottom(0), MarginLeft(0), MarginRight(0), Rect(),
+        Resizing(false), Collide(0), ForceCollide(false) {}
+};
+
+// Called with a zone's name when it opens and closes, on the thread running
+// it. Names are string literals.
+typedef void (*ImGridProfileZoneFunc)(const char *name, void *user_data);
+
+// Defined by the engine, so they work without ImGui too.
+namespace ImGrid {
+
+// Profiler hooks around BeginGrid(), EndGrid(), BeginEntry(), EndEntry(),
+// the draw list channel operations and the engine's collision fixing,
+// packing and column changes. Only compiled in with IMGRID_ENABLE_PROFILER,
+// see IMGRID_PROFILE_ZONE. NULL callbacks drop the zones.
+void SetProfileZoneCallbacks(ImGridProfileZoneFunc begin,
+                             ImGridProfileZoneFunc end,
+                             void *user_data = NULL);
+
+// Built-in stand-in profiler: writes every zone to file_name as Chrome trace
+// event JSON (chrome://tracing, ui.perfetto.dev) until EndProfileCapture(),
+// replacing the zone callbacks meanwhile. Returns false if the file can't be
+// created or the zones aren't compiled in.
+bool BeginProfileCapture(const char *file_name);
+void EndProfileCapture();
+
+} // namespace ImGrid
@@ -0,0 +1,789 @@
+// Regression tests for the headless layout engine, run by ctest.
+//
+//   imgrid_engine_tests [<substring>]
+//
+// Each case builds a small engine by hand and checks one behaviour of it.
+// Runs every case whose name contains the substring and exits non-zero if any
+// of them fails. Built against the full library, the ImGui layer's id map and
+// the grid state save and load cases run as well.
+
+#include "imgrid_grid_engine.h"
+#ifdef IMGRID_TESTS_UI
+#include "imgrid_internal.h"
+#endif
+
+#include <algorithm>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+
+using namespace ImGrid;
+
+namespace {
+
+static const int TestColumns = 12;
+
+struct TestCase {
+  const char *Name;
+  bool (*Run)();
+};
+
+// Entry storage is sized up front so the engine's pointers stay valid.
+struct TestGrid {
+  ImGridEngine Ctx;
+  ImGridVector<ImGridEntry> Storage;
+
+  TestGrid(int capacity) {
+    Ctx.Column = TestColumns;
+    Ctx.Options.Column = {false, TestColumns};
+    Ctx.ParentContext = NULL;
+    Storage.reserve(capacity);
+  }
+
+  ImGridEntry *Add(int id, ImGridPosition position, bool moving = false,
+                   bool auto_position = false) {
+    IM_ASSERT(Storage.Size < Storage.Capacity);
+    ImGridEntry entry(id, position);
+    entry.AutoPosition = auto_position;
+    entry.ParentContext = &Ctx;
+    entry.Moving = moving;
+    Storage.push_back(entry);
+    return Engine::GridAddNode(Ctx, &Storage.back(), false);
+  }
+};
+
+// xorshift32, the generated cases have to be identical between runs
+struct TestRandom {
+  unsigned int State;
+  TestRandom(unsigned int seed) : State(seed) {}
+  int Next(int min, int max) {
+    State ^= State << 13;
+    State ^= State >> 17;
+    State ^= State << 5;
+    return min + static_cast<int>(State % static_cast<unsigned>(max - min + 1));
+  }
+};
+
+bool CheckPosition(const ImGridEntry *entry, ImGridPosition expected) {
+  const ImGridPosition &p = entry->Position;
+  if (p.x == expected.x && p.y == expected.y && p.w == expected.w &&
+      p.h == expected.h)
+    return true;
+  fprintf(stderr, "  entry %d at (%g,%g,%g,%g), expected (%g,%g,%g,%g)\n",
+          entry->Id, p.x, p.y, p.w, p.h, expected.x, expected.y, expected.w,
+          expected.h);
+  return false;
+}
+
+// Compares GridPackedInterceptMask() with the scalar reference for every
+// start offset of random packed grids, so unaligned batches and the tail are
+// covered too. CMake builds this case for both x86-64 kernels where it can.
+bool TestPackedKernelMatchesScalar() {
+  TestRandom rng(0xC0FFEEu);
+  for (int round = 0; round < 200; ++round) {
+    const int count = rng.Next(1, 100);
+    ImGridVector<ImGridEntry> storage;
+    storage.reserve(count);
+    ImGridEngine ctx;
+    for (int i = 0; i < count; ++i) {
+      // mostly small coordinates, some sentinels and some near the limits
+      const int range = rng.Next(0, 3) == 0 ? SHRT_MAX - 8 : 20;
+      const int x = rng.Next(0, 9) == 0 ? -1 : rng.Next(-2, range);
+      const int y = rng.Next(0, 9) == 0 ? -1 : rng.Next(-2, range);
+      storage.push_back(ImGridEntry(rng.Next(-1, 8),
+                                    ImGridPosition(float(x), float(y),
+                                                   float(rng.Next(-1, 6)),
+                                                   float(rng.Next(-1, 6)))));
+      ctx.Entries.push_back(&storage.back());
+    }
+    Engine::GridPackedRebuild(ctx);
+
+    for (int query = 0; query < 20; ++query) {
+      const ImS16 area[4] = {(ImS16)rng.Next(-2, 24), (ImS16)rng.Next(-2, 24),
+                             (ImS16)rng.Next(0, 8), (ImS16)rng.Next(0, 8)};
+      const int skip_id = rng.Next(-1, 8);
+      const int skip2_id = rng.Next(0, 1) == 0 ? INT_MIN : rng.Next(-1, 8);
+      for (int start = 0; start < count; ++start) {
+        const ImU32 simd = Engine::GridPackedInterceptMask(
+            ctx.Packed, start, area, skip_id, skip2_id);
+        const ImU32 scalar = Engine::GridPackedInterceptMaskScalar(
+            ctx.Packed, start, area, skip_id, skip2_id);
+        if (simd != scalar) {
+          fprintf(stderr,
+                  "  %s kernel mismatch: count %d start %d mask %08x, "
+                  "expected %08x\n",
+                  Engine::GridPackedKernelName(), count, start, simd, scalar);
+          return false;
+        }
+      }
+    }
+  }
+  return true;
+}
+
+// On a grid without MaxRow the free space search used to be bounded by
+// Column * MaxRow = 0, so auto-positioned entries were left where they were
+// given and pushed down one under the other instead of filling the row. The
+// grid floats so that only the search places them.
+bool TestAutoPositionUnbounded() {
+  TestGrid grid(3);
+  grid.Ctx.Float = true;
+  ImGridEntry *first = grid.Add(0, ImGridPosition(0, 0, 6, 2), false, true);
+  ImGridEntry *second = grid.Add(1, ImGridPosition(0, 0, 6, 2), false, true);
+  ImGridEntry *third = grid.Add(2, ImGridPosition(0, 0, 4, 1), false, true);
+  return CheckPosition(first, ImGridPosition(0, 0, 6, 2)) &&
+         CheckPosition(second, ImGridPosition(6, 0, 6, 2)) &&
+         CheckPosition(third, ImGridPosition(0, 2, 4, 1));
+}
+
+// GridMoveNode() used to return true when the entry stayed put, the opposite
+// of the bounded GridEntryMoveCheck() path. Both now mean "moved", whether or
+// not the grid has a MaxRow.
+bool CheckMoveResult(int max_row) {
+  TestGrid grid(2);
+  grid.Ctx.MaxRow = max_row;
+  ImGridEntry *moved = grid.Add(0, ImGridPosition(0, 0, 2, 2));
+  ImGridEntry *below = grid.Add(1, ImGridPosition(0, 2, 2, 2));
+
+  ImGridMoveOptions opts;
+  opts.Position = ImGridPosition(4, 0, 2, 2);
+  if (!Engine::GridEntryMoveCheck(grid.Ctx, moved, opts)) {
+    fprintf(stderr, "  move into an empty cell reported as not moved\n");
+    return false;
+  }
+  if (Engine::GridEntryMoveCheck(grid.Ctx, moved, opts)) {
+    fprintf(stderr, "  move onto its own cell reported as moved\n");
+    return false;
+  }
+  opts.Position = ImGridPosition(8, 0, 2, 2);
+  if (!Engine::GridMoveNode(grid.Ctx, moved, opts)) {
+    fprintf(stderr, "  GridMoveNode() reported a move as not moved\n");
+    return false;
+  }
+  return CheckPosition(moved, ImGridPosition(8, 0, 2, 2)) &&
+         CheckPosition(below, ImGridPosition(0, 0, 2, 2));
+}
+
+bool TestMoveResultUnbounded() { return CheckMoveResult(0); }
+
+bool TestMoveResultBounded() { return CheckMoveResult(4); }
+
+// While loading, an entry dropped onto another one is moved below it and the
+// search continues from its new place. It used to keep testing the place it
+// was dropped on and never got past the first collision. The grid floats so
+// that the final pack doesn't move them again.
+bool TestLoadingMovesBelowCollisions() {
+  TestGrid grid(3);
+  grid.Ctx.Float = true;
+  Engine::GridBatchUpdate(grid.Ctx, true);
+  grid.Ctx.Loading = true;
+  ImGridEntry *first = grid.Add(0, ImGridPosition(0, 0, 2, 2));
+  ImGridEntry *second = grid.Add(1, ImGridPosition(0, 0, 2, 2));
+  ImGridEntry *third = grid.Add(2, ImGridPosition(0, 1, 2, 1));
+  grid.Ctx.Loading = false;
+  Engine::GridBatchUpdate(grid.Ctx, false);
+  return CheckPosition(first, ImGridPosition(0, 0, 2, 2)) &&
+         CheckPosition(second, ImGridPosition(0, 2, 2, 2)) &&
+         CheckPosition(third, ImGridPosition(0, 4, 2, 1));
+}
+
+// Dragging an entry down over a wider one sets its SkipDown flag while it is
+// moved below. A rolled back trial has to clear the flag again, or the next
+// drag step skips the push down; LastTried is restored along with it.
+bool TestRollbackRestoresMoveState() {
+  TestGrid grid(2);
+  ImGridEngine &ctx = grid.Ctx;
+  ImGridEntry *dragged = grid.Add(0, ImGridPosition(0, 0, 2, 2));
+  ImGridEntry *below = grid.Add(1, ImGridPosition(0, 2, 4, 2));
+  dragged->Moving = true;
+  dragged->LastTried = ImGridPosition(0, 2, 2, 2);
+  dragged->Rect = dragged->Position;
+  below->Rect = below->Position;
+
+  Engine::GridBeginSpeculativeMove(ctx);
+  ImGridMoveOptions opts;
+  opts.Position = ImGridPosition(0, 2, 2, 2);
+  opts.Rect = opts.Position;
+  Engine::GridMoveNode(ctx, dragged, opts);
+  const bool skipped = dragged->SkipDown;
+  Engine::GridRollbackMove(ctx);
+
+  if (!skipped) {
+    fprintf(stderr, "  trial move didn't set SkipDown\n");
+    return false;
+  }
+  if (dragged->SkipDown ||
+      !(dragged->LastTried == ImGridPosition(0, 2, 2, 2))) {
+    fprintf(stderr, "  SkipDown or LastTried not restored by the rollback\n");
+    return false;
+  }
+  return CheckPosition(dragged, ImGridPosition(0, 0, 2, 2)) &&
+         CheckPosition(below, ImGridPosition(0, 2, 4, 2));
+}
+
+// A moving entry added where it collides with nothing has nothing to swap
+// with; GridFixCollisions() used to dereference the missing collision.
+bool TestAddMovingEntryWithoutCollision() {
+  TestGrid grid(2);
+  ImGridEntry *still = grid.Add(0, ImGridPosition(0, 0, 2, 2));
+  ImGridEntry *moving = grid.Add(1, ImGridPosition(4, 0, 2, 2), true);
+  return moving != NULL && CheckPosition(still, ImGridPosition(0, 0, 2, 2)) &&
+         CheckPosition(moving, ImGridPosition(4, 0, 2, 2)) &&
+         grid.Ctx.Entries.Size == 2;
+}
+
+// GridFindEmptyPosition() answers from the occupancy index when it searches
+// ctx.Entries and scans every entry otherwise; both have to find the same
+// slot on fragmented grids, including bounded ones with no room left.
+bool TestFirstFitMatchesScan() {
+  TestRandom rng(0xF1F1u);
+  for (int round = 0; round < 100; ++round) {
+    const int count = rng.Next(1, 80);
+    TestGrid grid(count);
+    ImGridEngine &ctx = grid.Ctx;
+    for (int i = 0; i < count; ++i) {
+      const int x = rng.Next(0, TestColumns - 1);
+      grid.Add(i, ImGridPosition(float(x), float(rng.Next(0, 40)),
+                                 float(rng.Next(1, TestColumns - x)),
+                                 float(rng.Next(1, 3))));
+    }
+    ctx.MaxRow = rng.Next(0, 1) == 0 ? 0 : rng.Next(1, 40);
+    ImGridVector<ImGridEntry *> copy = ctx.Entries;
+
+    for (int query = 0; query < 40; ++query) {
+      const ImGridPosition size(0, 0, float(rng.Next(1, TestColumns)),
+                                float(rng.Next(1, 4)));
+      ImGridEntry *after = rng.Next(0, 2) == 0
+                               ? NULL
+                               : ctx.Entries[rng.Next(0, count - 1)];
+      ImGridEntry indexed(-1, size), scanned(-1, size);
+      const bool found = Engine::GridFindEmptyPosition(
+          ctx, indexed, TestColumns, ctx.Entries, after);
+      const bool expected = Engine::GridFindEmptyPosition(
+          ctx, scanned, TestColumns, copy, after);
+      if (found != expected ||
+          (found && !(indexed.Position == scanned.Position))) {
+        fprintf(stderr,
+                "  %gx%g slot at (%g,%g) found %d, expected (%g,%g) found "
+                "%d\n",
+                size.w, size.h, indexed.Position.x, indexed.Position.y, found,
+                scanned.Position.x, scanned.Position.y, expected);
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+#ifdef IMGRID_TESTS_UI
+// ImIdIndexMap::Remove() closes the hole it leaves by pulling back later
+// slots of the probe run. Ids sharing a home slot with the removed one, and
+// one whose home is the next slot, all have to stay reachable.
+bool TestIdIndexMapRemoveKeepsRun() {
+  ImIdIndexMap map;
+  map.Reserve(4); // 16 slots
+  const ImU32 mask = 15;
+  ImGuiID ids[5];
+  int found = 0;
+  for (ImGuiID id = 1; found < 5; ++id) {
+    const ImU32 home = ImIdIndexMap::Hash(id) & mask;
+    if ((found < 4 && home == 3) || (found == 4 && home == 4))
+      ids[found++] = id;
+  }
+  for (int i = 0; i < 5; ++i)
+    map.SetIndex(ids[i], i);
+
+  map.Remove(ids[0]);
+  if (map.GetIndex(ids[0]) != -1 || map.Count != 4) {
+    fprintf(stderr, "  removed id %u still found\n", ids[0]);
+    return false;
+  }
+  for (int i = 1; i < 5; ++i) {
+    if (map.GetIndex(ids[i]) != i) {
+      fprintf(stderr, "  id %u at %d, expected %d\n", ids[i],
+              map.GetIndex(ids[i]), i);
+      return false;
+    }
+  }
+  return true;
+}
+#endif
+
+// A handle kept past its entry's release resolves to NULL, also once the
+// slot has been reused by another entry.
+bool TestStaleHandleResolvesToNull() {
+  TestGrid grid(2);
+  ImGridEngine &ctx = grid.Ctx;
+  ImGridEntry *removed = grid.Add(0, ImGridPosition(0, 0, 2, 2));
+  const ImGridEntryHandle stale = removed->Handle;
+  Engine::GridRemoveEntry(ctx, removed);
+  Engine::GridReleaseHandle(ctx, removed);
+  if (Engine::GridResolveEntry(ctx, stale) != NULL) {
+    fprintf(stderr, "  released handle still resolves\n");
+    return false;
+  }
+
+  ImGridEntry *added = grid.Add(1, ImGridPosition(0, 0, 2, 2));
+  if (Engine::GridResolveEntry(ctx, stale) != NULL) {
+    fprintf(stderr, "  stale handle resolves to the slot's new entry\n");
+    return false;
+  }
+  return added->Handle != stale &&
+         Engine::GridResolveEntry(ctx, added->Handle) == added;
+}
+
+// GridRemoveEntry() moves the last entry into the removed one's slot; its
+// EngineIdx and PackedIdx have to follow, or the next lookup misses it. The
+// batch keeps the pack from sorting and reindexing the entries afterwards.
+bool TestSwapRemoveFixesIndices() {
+  TestGrid grid(4);
+  ImGridEngine &ctx = grid.Ctx;
+  for (int i = 0; i < 4; ++i)
+    grid.Add(i, ImGridPosition(float(i * 3), 0, 2, 2));
+  Engine::GridPackedRebuild(ctx);
+  ImGridEntry *removed = &grid.Storage[1];
+  ImGridEntry *last = ctx.Entries.back();
+  const int slot = Engine::GridEntryIndex(ctx, removed);
+  IM_ASSERT(slot >= 0 && slot < ctx.Entries.Size - 1);
+  Engine::GridBatchUpdate(ctx, true);
+  Engine::GridRemoveEntry(ctx, removed);
+
+  if (Engine::GridEntryIndex(ctx, removed) != -1 || ctx.Entries.Size != 3 ||
+      ctx.Entries[slot] != last) {
+    fprintf(stderr, "  last entry not moved into the removed slot\n");
+    return false;
+  }
+  for (int i = 0; i < ctx.Entries.Size; ++i) {
+    const ImGridEntry *entry = ctx.Entries[i];
+    if (entry->EngineIdx != i ||
+        (ctx.Packed.Valid &&
+         Engine::GridResolveEntry(ctx, ctx.Packed.Handles[entry->PackedIdx]) !=
+             entry)) {
+      fprintf(stderr, "  entry %d in slot %d has EngineIdx %d PackedIdx %d\n",
+              entry->Id, i, entry->EngineIdx, entry->PackedIdx);
+      return false;
+    }
+  }
+  return true;
+}
+
+// Entries listed without GridAddNode(), as the UI does, get their handle
+// once the packed mirror is built. Collision queries answered from the mirror
+// resolve its handles back to them.
+bool TestPackedQueryResolvesListedEntries() {
+  TestGrid grid(2);
+  ImGridEngine &ctx = grid.Ctx;
+  for (int i = 0; i < 2; ++i) {
+    // overlapping, so the occupancy index leaves the query to the mirror
+    grid.Storage.push_back(ImGridEntry(i, ImGridPosition(float(i), 0, 2, 2)));
+    ImGridEntry *entry = &grid.Storage.back();
+    entry->ParentContext = &ctx;
+    entry->EngineIdx = ctx.Entries.Size;
+    ctx.Entries.push_back(entry);
+  }
+  ImGridEntry probe(-1, ImGridPosition(1, 1, 1, 1));
+  Engine::GridOccupancyBegin(ctx);
+  ImGridEntry *hit = Engine::GridCollide(ctx, &probe, probe.Position, NULL);
+  const ImGridVector<ImGridEntry *> all =
+      Engine::GridCollideAll(ctx, &probe, probe.Position, NULL);
+  Engine::GridOccupancyEnd(ctx);
+
+  if (hit != &grid.Storage[0] || all.Size != 2 ||
+      !all.contains(&grid.Storage[0]) || !all.contains(&grid.Storage[1])) {
+    fprintf(stderr, "  listed entries not resolved from the packed mirror\n");
+    return false;
+  }
+  return true;
+}
+
+// Lifting an entry out of a column leaves a hole under entries that stay put.
+// The region pack must keep following the column past them, down to the
+// changed rows, so the entry under the hole still rises into it.
+bool TestPackFillsHoleUnderStillEntries() {
+  TestGrid grid(5);
+  for (int i = 0; i < 5; ++i)
+    grid.Add(i, ImGridPosition(0, float(i), 2, 1));
+  ImGridEngine &ctx = grid.Ctx;
+  ImGridEntry *lifted = &grid.Storage[3];
+  Engine::GridOccupancyBegin(ctx);
+  lifted->Position = ImGridPosition(2, 0, 2, 1);
+  Engine::GridOccupancyUpdate(ctx, lifted);
+  Engine::GridPackEntries(ctx);
+  Engine::GridOccupancyEnd(ctx);
+  return CheckPosition(lifted, ImGridPosition(2, 0, 2, 1)) &&
+         CheckPosition(&grid.Storage[2], ImGridPosition(0, 2, 2, 1)) &&
+         CheckPosition(&grid.Storage[4], ImGridPosition(0, 3, 2, 1));
+}
+
+// GridPrecomputeLayouts() keeps its layouts apart from the ones saved per
+// column count in CacheLayouts. A column change copies the precomputed
+// layout, and a committed move marks it stale until it is solved again.
+bool TestPrecomputedLayoutsKeepCacheLayouts() {
+  TestGrid grid(4);
+  ImGridEngine &ctx = grid.Ctx;
+  for (int i = 0; i < 4; ++i)
+    grid.Add(i, ImGridPosition(float(i * 3), 0, 3, 1));
+  ImGridVector<ImGridEntry> &saved = ctx.CacheLayouts[6];
+  saved.push_back(ImGridEntry(7, ImGridPosition(1, 2, 3, 4)));
+  ImGridColumnOpts opts;
+  opts.ColumnMax = TestColumns;
+  opts.Breakpoints.push_back({800, 6, ImGridColumnFlags_None});
+  Engine::GridPrecomputeLayouts(ctx, opts);
+
+  const ImGridVector<ImGridEntry> &kept = ctx.CacheLayouts[6];
+  if (kept.Size != 1 || kept[0].Id != 7 ||
+      !(kept[0].Position == ImGridPosition(1, 2, 3, 4))) {
+    fprintf(stderr, "  precompute replaced the saved layout of column 6\n");
+    return false;
+  }
+  if (Engine::GridPrecomputedLayoutsStale(ctx)) {
+    fprintf(stderr, "  stale right after the precompute\n");
+    return false;
+  }
+
+  // the column change has to take the position from the precomputed layout
+  for (ImGridEntry &solved : ctx.Precomputed.Layouts) {
+    if (solved.Id == 3)
+      solved.Position = ImGridPosition(0, 5, 3, 1);
+  }
+  ctx.Column = 6;
+  Engine::GridColumnChanged(ctx, TestColumns, 6);
+  if (!CheckPosition(&grid.Storage[3], ImGridPosition(0, 5, 3, 1)))
+    return false;
+
+  Engine::GridTriggerChangeEvent(ctx);
+  Engine::GridPrecomputeLayouts(ctx, opts);
+  ImGridMoveOptions move;
+  move.Position = ImGridPosition(3, 6, 3, 1);
+  move.Rect = move.Position;
+  Engine::GridMoveNode(ctx, &grid.Storage[3], move);
+  Engine::GridTriggerChangeEvent(ctx);
+  if (!Engine::GridPrecomputedLayoutsStale(ctx)) {
+    fprintf(stderr, "  a committed move left the layouts fresh\n");
+    return false;
+  }
+  return true;
+}
+
+// Past 2048 entries GridSortNodesInplace() radix sorts (y, x) keys. It has to
+// give the order of a stable comparison sort, unset (-1) coordinates last and
+// reversed when sorting upwards, with ties kept in their original order.
+bool TestRadixSortMatchesComparison() {
+  const int count = 3000;
+  ImGridVector<ImGridEntry> storage;
+  storage.reserve(count);
+  TestRandom rng(0x5EED5u);
+  ImGridVector<ImGridEntry *> nodes;
+  for (int i = 0; i < count; ++i) {
+    const int x = rng.Next(0, 15) == 0 ? -1 : rng.Next(0, TestColumns - 1);
+    const int y = rng.Next(0, 15) == 0 ? -1 : rng.Next(0, 300);
+    storage.push_back(ImGridEntry(i, ImGridPosition(float(x), float(y), 1, 1)));
+    nodes.push_back(&storage.back());
+  }
+
+  for (int upwards = 0; upwards < 2; ++upwards) {
+    ImGridVector<ImGridEntry *> sorted = nodes;
+    Engine::GridSortNodesInplace(sorted, upwards != 0);
+
+    ImGridVector<ImGridEntry *> expected = nodes;
+    const float direction = upwards ? -1.0f : 1.0f;
+    std::stable_sort(expected.begin(), expected.end(),
+                     [&](ImGridEntry *a, ImGridEntry *b) {
+                       const float und = 10000;
+                       const ImGridPosition &pa = a->Position;
+                       const ImGridPosition &pb = b->Position;
+                       const float ay = pa.y == -1 ? und : pa.y;
+                       const float by = pb.y == -1 ? und : pb.y;
+                       if (ay != by)
+                         return direction * (ay - by) < 0;
+                       const float ax = pa.x == -1 ? und : pa.x;
+                       const float bx = pb.x == -1 ? und : pb.x;
+                       return direction * (ax - bx) < 0;
+                     });
+    for (int i = 0; i < count; ++i) {
+      if (sorted[i] != expected[i]) {
+        fprintf(stderr, "  %s sort differs at %d: entry %d, expected %d\n",
+                upwards ? "upwards" : "downwards", i, sorted[i]->Id,
+                expected[i]->Id);
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+#ifdef IMGRID_TESTS_UI
+// Only built when linking the full library, these lay out a grid with real
+// ImGui frames before saving it.
+
+// Sets up an ImGui context able to run frames with a current grid context,
+// destroying both when it goes out of scope.
+struct TestUIContext {
+  ImGuiContext *ImGuiCtx;
+
+  TestUIContext() {
+    ImGuiCtx = ImGui::CreateContext();
+    ImGuiIO &io = ImGui::GetIO();
+    io.IniFilename = NULL;
+    io.DisplaySize = ImVec2(1280, 720);
+    unsigned char *pixels;
+    int width, height;
+    io.Fonts->GetTexDataAsRGBA32(&pixels, &width, &height);
+    ImGrid::SetCurrentContext(ImGrid::CreateContext());
+  }
+  TestUIContext(const TestUIContext &) = delete;
+  TestUIContext &operator=(const TestUIContext &) = delete;
+  ~TestUIContext() {
+    ImGrid::DestroyContext();
+    ImGui::DestroyContext(ImGuiCtx);
+  }
+};
+
+void TestUIFrame(int count) {
+  ImGuiIO &io = ImGui::GetIO();
+  io.DeltaTime = 1.0f / 60.0f;
+  ImGui::NewFrame();
+  ImGui::SetNextWindowPos(ImVec2(0, 0));
+  ImGui::SetNextWindowSize(io.DisplaySize);
+  ImGui::Begin("Grid");
+  ImGrid::BeginGrid();
+  for (int id = 0; id < count; ++id) {
+    if (ImGrid::BeginEntry(id))
+      ImGui::Text("Entry %d", id);
+    ImGrid::EndEntry();
+  }
+  ImGrid::EndGrid();
+  ImGui::End();
+  ImGui::Render();
+}
+
+// Copies the buffer returned by the save functions, which the next save
+// overwrites.
+ImVector<char> CopySaved(const void *data, size_t size) {
+  ImVector<char> copy;
+  copy.resize(static_cast<int>(size));
+  memcpy(copy.Data, data, size);
+  return copy;
+}
+
+ImVector<char> SaveIni(const ImGridContext *ctx) {
+  size_t size = 0;
+  const char *data = ImGrid::SaveGridStateToIniString(ctx, &size);
+  return CopySaved(data, size);
+}
+
+ImVector<char> SaveBinary(const ImGridContext *ctx) {
+  size_t size = 0;
+  const void *data = ImGrid::SaveGridStateToMemory(ctx, &size);
+  return CopySaved(data, size);
+}
+
+bool SameBytes(const ImVector<char> &a, const ImVector<char> &b) {
+  return a.Size == b.Size && memcmp(a.Data, b.Data, a.Size) == 0;
+}
+
+// Saving a laid out grid as INI text and as a binary snapshot, loading either
+// into a new context and saving that again gives back the same data.
+bool TestGridStateRoundTrip() {
+  TestUIContext context;
+  for (int frame = 0; frame < 3; ++frame)
+    TestUIFrame(5);
+
+  const ImVector<char> ini = SaveIni(ImGrid::GetCurrentContext());
+  const ImVector<char> binary = SaveBinary(ImGrid::GetCurrentContext());
+  int saved_entries = 0;
+  for (int i = 0; i + 7 <= ini.Size; ++i)
+    saved_entries += memcmp(ini.Data + i, "[entry.", 7) == 0 ? 1 : 0;
+  if (saved_entries != 5) {
+    fprintf(stderr, "  %d entries saved, expected 5\n", saved_entries);
+    return false;
+  }
+
+  ImGridContext *from_ini = ImGrid::CreateContext();
+  ImGrid::LoadGridStateFromIniString(from_ini, ini.Data, ini.Size);
+  const bool ini_same = SameBytes(ini, SaveIni(from_ini));
+  ImGrid::DestroyContext(from_ini);
+
+  ImGridContext *from_binary = ImGrid::CreateContext();
+  const bool loaded =
+      ImGrid::LoadGridStateFromMemory(from_binary, binary.Data, binary.Size);
+  const bool binary_same = loaded && SameBytes(binary, SaveBinary(from_binary));
+  ImGrid::DestroyContext(from_binary);
+
+  if (!ini_same)
+    fprintf(stderr, "  INI text changed by a load and save\n");
+  if (!binary_same)
+    fprintf(stderr, "  snapshot %s by a load and save\n",
+            loaded ? "changed" : "rejected");
+  return ini_same && binary_same;
+}
+
+bool WriteFileBytes(const char *file_name, const ImVector<char> &bytes) {
+  FILE *file = fopen(file_name, "wb");
+  if (file == NULL)
+    return false;
+  const size_t size = static_cast<size_t>(bytes.Size);
+  const bool written = fwrite(bytes.Data, 1, size, file) == size;
+  return fclose(file) == 0 && written;
+}
+
+// A snapshot file with a flipped bit in an entry record is rejected as a
+// whole, leaving the state loaded before it untouched.
+bool TestCorruptSnapshotFileRejected() {
+  TestUIContext context;
+  for (int frame = 0; frame < 3; ++frame)
+    TestUIFrame(5);
+
+  const char *file_name = "imgrid_tests.snap";
+  ImVector<char> binary = SaveBinary(ImGrid::GetCurrentContext());
+  ImGridContext *loaded_ctx = ImGrid::CreateContext();
+  const bool saved = ImGrid::SaveGridStateToSnapshotFile(
+      ImGrid::GetCurrentContext(), file_name);
+  const bool loaded =
+      saved && ImGrid::LoadGridStateFromSnapshotFile(loaded_ctx, file_name);
+  const ImVector<char> before = SaveBinary(loaded_ctx);
+
+  // without cached layouts the file ends with the last entry record
+  binary[binary.Size - 5] ^= 0x10;
+  const bool rejected =
+      WriteFileBytes(file_name, binary) &&
+      !ImGrid::LoadGridStateFromSnapshotFile(loaded_ctx, file_name);
+  const bool unchanged = SameBytes(before, SaveBinary(loaded_ctx));
+  ImGrid::DestroyContext(loaded_ctx);
+  remove(file_name);
+
+  if (!loaded)
+    fprintf(stderr, "  snapshot file not %s\n", saved ? "loaded" : "saved");
+  if (!rejected)
+    fprintf(stderr, "  corrupt snapshot file loaded\n");
+  if (!unchanged)
+    fprintf(stderr, "  rejected snapshot file changed the state\n");
+  return loaded && rejected && unchanged;
+}
+
+long FileSize(const char *file_name) {
+  FILE *file = fopen(file_name, "rb");
+  if (file == NULL)
+    return -1;
+  fseek(file, 0, SEEK_END);
+  const long size = ftell(file);
+  fclose(file);
+  return size;
+}
+
+float EntryX(const ImGridContext *ctx, int id) {
+  const int idx = ObjectPoolFind(ctx->Entries, id);
+  return idx >= 0 ? ctx->Entries.Pool[idx].Position.x : -1;
+}
+
+// Moves an entry along its row the way a drag does and sends the change
+// event the journal records.
+void MoveEntryX(ImGridContext *ctx, int id, float x) {
+  ImGridEntry &entry = ctx->Entries.Pool[ObjectPoolFind(ctx->Entries, id)];
+  ImGridMoveOptions opts;
+  opts.Position = entry.Position;
+  opts.Position.x = x;
+  Engine::GridEntryMoveCheck(*ctx->Engine, &entry, opts);
+  Engine::GridTriggerChangeEvent(*ctx->Engine);
+}
+
+// A move lands in the journal only, loading the journal replays it on top
+// of the snapshot. Going past the compaction threshold writes the moves into
+// the snapshot and leaves just the journal header.
+bool TestJournalReplayAndCompaction() {
+  TestUIContext context;
+  for (int frame = 0; frame < 3; ++frame)
+    TestUIFrame(5);
+
+  const char *snapshot_file = "imgrid_tests_journal.snap";
+  const char *journal_file = "imgrid_tests.journal";
+  const long journal_header_size = 12;
+  ImGridContext *ctx = ImGrid::GetCurrentContext();
+  const float start_x = EntryX(ctx, 4);
+
+  bool passed = ImGrid::OpenGridStateJournal(snapshot_file, journal_file);
+  MoveEntryX(ctx, 4, 40);
+  ImGrid::CloseGridStateJournal();
+
+  ImGridContext *replayed = ImGrid::CreateContext();
+  ImGridContext *snapshot_only = ImGrid::CreateContext();
+  passed = passed &&
+           ImGrid::LoadGridStateFromJournal(snapshot_file, journal_file,
+                                            replayed) &&
+           ImGrid::LoadGridStateFromSnapshotFile(snapshot_only, snapshot_file);
+  const bool replayed_move = EntryX(ctx, 4) == 40 &&
+                             EntryX(replayed, 4) == 40 &&
+                             EntryX(snapshot_only, 4) == start_x;
+  if (passed && !replayed_move)
+    fprintf(stderr, "  moved to x %g, journal %g, snapshot %g (was %g)\n",
+            EntryX(ctx, 4), EntryX(replayed, 4), EntryX(snapshot_only, 4),
+            start_x);
+  ImGrid::DestroyContext(replayed);
+  ImGrid::DestroyContext(snapshot_only);
+
+  // each move appends one record, the second one goes past a threshold of 1
+  passed = passed &&
+           ImGrid::OpenGridStateJournal(snapshot_file, journal_file, 1);
+  MoveEntryX(ctx, 4, 60);
+  const bool appended = FileSize(journal_file) > journal_header_size;
+  MoveEntryX(ctx, 4, 80);
+  const bool compacted = FileSize(journal_file) == journal_header_size;
+  ImGrid::CloseGridStateJournal();
+
+  snapshot_only = ImGrid::CreateContext();
+  const bool snapshot_latest =
+      ImGrid::LoadGridStateFromSnapshotFile(snapshot_only, snapshot_file) &&
+      EntryX(snapshot_only, 4) == 80;
+  ImGrid::DestroyContext(snapshot_only);
+  remove(snapshot_file);
+  remove(journal_file);
+
+  if (!passed)
+    fprintf(stderr, "  journal not opened or loaded\n");
+  if (!appended || !compacted || !snapshot_latest)
+    fprintf(stderr, "  journal not compacted past its threshold\n");
+  return passed && replayed_move && appended && compacted && snapshot_latest;
+}
+
+#endif
+
+const TestCase GTestCases[] = {
+    {"PackedKernelMatchesScalar", TestPackedKernelMatchesScalar},
+    {"AutoPositionUnbounded", TestAutoPositionUnbounded},
+    {"MoveResultUnbounded", TestMoveResultUnbounded},
+    {"MoveResultBounded", TestMoveResultBounded},
+    {"LoadingMovesBelowCollisions", TestLoadingMovesBelowCollisions},
+    {"RollbackRestoresMoveState", TestRollbackRestoresMoveState},
+    {"AddMovingEntryWithoutCollision", TestAddMovingEntryWithoutCollision},
+    {"FirstFitMatchesScan", TestFirstFitMatchesScan},
+#ifdef IMGRID_TESTS_UI
+    {"IdIndexMapRemoveKeepsRun", TestIdIndexMapRemoveKeepsRun},
+#endif
+    {"StaleHandleResolvesToNull", TestStaleHandleResolvesToNull},
+    {"SwapRemoveFixesIndices", TestSwapRemoveFixesIndices},
+    {"PackedQueryResolvesListedEntries", TestPackedQueryResolvesListedEntries},
+    {"PackFillsHoleUnderStillEntries", TestPackFillsHoleUnderStillEntries},
+    {"PrecomputedLayoutsKeepCacheLayouts",
+     TestPrecomputedLayoutsKeepCacheLayouts},
+    {"RadixSortMatchesComparison", TestRadixSortMatchesComparison},
+#ifdef IMGRID_TESTS_UI
+    {"GridStateRoundTrip", TestGridStateRoundTrip},
+    {"CorruptSnapshotFileRejected", TestCorruptSnapshotFileRejected},
+    {"JournalReplayAndCompaction", TestJournalReplayAndCompaction},
+#endif
+};
+
+} // namespace
+
+int main(int argc, char **argv) {
+  const char *filter = argc > 1 ? argv[1] : NULL;
+  int failed = 0;
+  for (const TestCase &test : GTestCases) {
+    if (filter != NULL && strstr(test.Name, filter) == NULL)
+      continue;
+    const bool passed = test.Run();
+    fprintf(stderr, "%-40s %s\n", test.Name, passed ? "ok" : "FAILED");
+    failed += passed ? 0 : 1;
+  }
+  return failed == 0 ? 0 : 1;
+}